@@ -2,6 +2,87 @@
 
 #include "LearnedMM.h"
 #include "Modules/ModuleManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+
+#include "MMBench.h"
+#include "MMNNet.h"
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, LearnedMM, "LearnedMM" );
- 
\ No newline at end of file
+
+//--------------------------------------------------------------------------//
+//					 Motion matching micro-benchmarks
+
+static void RunLearnedMMBench(const TArray<FString>& Args)
+{
+	const FString Filename = FPaths::ConvertRelativePathToFull(FPaths::ProjectSavedDir() / TEXT("LearnedMMBench.json"));
+
+	FILE* f = fopen(TCHAR_TO_UTF8(*Filename), "w");
+	if (f == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not open '%s' for writing"), *Filename);
+		return;
+	}
+
+	bench_run_all(f, Args.Num() > 0 ? TCHAR_TO_UTF8(*Args[0]) : nullptr);
+	fclose(f);
+
+	UE_LOG(LogTemp, Log, TEXT("Motion matching benchmark results written to '%s'"), *Filename);
+}
+
+static FAutoConsoleCommand LearnedMMBenchCommand(
+	TEXT("mm.Bench"),
+	TEXT("Runs the motion matching micro-benchmarks and writes the results to Saved/LearnedMMBench.json. Takes an optional name filter."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(RunLearnedMMBench));
+
+//--------------------------------------------------------------------------//
+//					 Network weight quantization
+
+static void QuantizeLearnedMMNetwork(const TArray<FString>& Args)
+{
+	if (Args.Num() < 3 || (Args[2] != TEXT("int8") && Args[2] != TEXT("fp16")))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Usage: mm.QuantizeNetwork <source> <destination> <int8|fp16> [tolerance]"));
+		return;
+	}
+
+	const FString SourcePath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / Args[0]);
+	const FString DestinationPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / Args[1]);
+	const int Format = Args[2] == TEXT("int8") ? QUANTIZED_INT8 : QUANTIZED_FP16;
+	const float Tolerance = Args.Num() > 3 ? FCString::Atof(*Args[3]) : -1.0f;
+
+	nnet Reference;
+	if (!nnet_load(Reference, TCHAR_TO_UTF8(*SourcePath)) || Reference.format != QUANTIZED_NONE)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not load float network '%s'"), *SourcePath);
+		return;
+	}
+
+	nnet Quantized = Reference;
+	nnet_quantize(Quantized, Format);
+
+	// Compared on the output after denormalization, so in the units
+	// of the pose or features the network predicts
+	const float Error = nnet_max_error(Reference, Quantized);
+
+	UE_LOG(LogTemp, Log, TEXT("'%s' as %s: max output error %f"), *SourcePath, *Args[2], Error);
+
+	if (Tolerance >= 0.0f && Error > Tolerance)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Error is above the tolerance of %f, '%s' not written"), Tolerance, *DestinationPath);
+		return;
+	}
+
+	if (!nnet_save_quantized(Quantized, TCHAR_TO_UTF8(*DestinationPath)))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not write '%s'"), *DestinationPath);
+		return;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Quantized network written to '%s'"), *DestinationPath);
+}
+
+static FAutoConsoleCommand LearnedMMQuantizeCommand(
+	TEXT("mm.QuantizeNetwork"),
+	TEXT("Quantizes the weights of a network file in Content to int8 or fp16 and reports the largest output error against the float weights. With a tolerance the file is only written if the error is within it."),
+	FConsoleCommandWithArgsDelegate::CreateStatic(QuantizeLearnedMMNetwork));
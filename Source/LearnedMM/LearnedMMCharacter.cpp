@@ -2,6 +2,7 @@
 #include "LearnedMMCharacter.h"
 #include "Engine/LocalPlayer.h"
 #include "Camera/CameraComponent.h"
+#include "Camera/PlayerCameraManager.h"
 #include "Components/CapsuleComponent.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/SpringArmComponent.h"
@@ -13,12 +14,16 @@
 #include "DrawDebugHelpers.h"
 #include "Engine/World.h"
 #include "Kismet/GameplayStatics.h"
+#include "Misc/Paths.h"
 
 #include "MMCommon.h"
 #include "MMArray.h"
 #include "MMQuat.h"
 #include "MMVec.h"
 #include "MMSpring.h"
+#include "MMDatabase.h"
+#include "MMLmm.h"
+#include "MMSearchSubsystem.h"
 
 
 
@@ -93,23 +98,24 @@ FQuat CalculateJoystickAngle_FQuat(FVector2D JoyStick)
 //--------------------------------------------------------------------------//
 void ALearnedMMCharacter::OnStrafe(const FInputActionValue& Value)
 {
-	bStrafe = true;
+	if (bExternalInput) { return; }
+
+	MotionMatchingInput.bStrafe = true;
 }
 
 void ALearnedMMCharacter::StopStrafe(const FInputActionValue& Value)
 {
-	bStrafe = false;	
+	if (bExternalInput) { return; }
+
+	MotionMatchingInput.bStrafe = false;
 }
 
 void ALearnedMMCharacter::desired_gait_update(float& desired_gait, float& desired_gait_velocity, const float dt, const float gait_change_halflife = 0.1f)
-{	
-	APlayerController* PlayerController = UGameplayStatics::GetPlayerController(this, 0);
-	if (PlayerController == nullptr) return;
-	
+{
 	simple_spring_damper_exact(
 		desired_gait,
 		desired_gait_velocity,
-		PlayerController->IsInputKeyDown(EKeys::Gamepad_FaceButton_Bottom) ? 1.0f : 0.0f,
+		MotionMatchingInput.bWalk ? 1.0f : 0.0f,
 		gait_change_halflife,
 		dt);
 }
@@ -185,6 +191,415 @@ quat desired_rotation_update(
 }
 
 
+//--------------------------------------------------------------------------//
+//					 Motion matching controller
+
+// Database frame rate, and the time between trajectory samples
+// used as matching features (20 frames)
+static const float MotionMatchingDt = 1.0f / 60.0f;
+static const float TrajectorySampleDt = 20.0f * MotionMatchingDt;
+
+// Layout of the matching features: left and right foot positions, 
+// left and right foot velocities, hip velocity, then three future
+// trajectory positions and directions projected onto the ground
+static const int FeatureCount = 27;
+
+static const float simulation_velocity_halflife = 0.27f;
+static const float simulation_rotation_halflife = 0.27f;
+static const float simulation_run_fwrd_speed = 4.0f;
+static const float simulation_run_side_speed = 3.0f;
+static const float simulation_run_back_speed = 2.5f;
+static const float simulation_walk_fwrd_speed = 1.75f;
+static const float simulation_walk_side_speed = 1.5f;
+static const float simulation_walk_back_speed = 1.25f;
+
+static const float desired_velocity_change_threshold = 50.0f;
+static const float desired_rotation_change_threshold = 50.0f;
+
+// The database is Y up and in meters, facing +z with +x to the left. 
+// Unreal is Z up and in centimeters, facing +X with +Y to the right.
+static FVector to_unreal(const vec3 v)
+{
+	return FVector(v.z, -v.x, v.y) * 100.0f;
+}
+
+// Same change of basis for rotations. It includes a mirror, which 
+// flips the sign of the axis.
+static FQuat to_unreal(const quat q)
+{
+	return FQuat(-q.z, q.x, -q.y, q.w);
+}
+
+void simulation_positions_update(
+	vec3& position,
+	vec3& velocity,
+	vec3& acceleration,
+	const vec3 desired_velocity,
+	const float halflife,
+	const float dt)
+{
+	float y = halflife_to_damping(halflife) / 2.0f;
+	vec3 j0 = velocity - desired_velocity;
+	vec3 j1 = acceleration + j0 * y;
+	float eydt = fast_negexpf(y * dt);
+
+	vec3 position_prev = position;
+
+	position = eydt * (((-j1) / (y * y)) + ((-j0 - j1 * dt) / y)) +
+		(j1 / (y * y)) + j0 / y + desired_velocity * dt + position_prev;
+	velocity = eydt * (j0 + j1 * dt) + desired_velocity;
+	acceleration = eydt * (acceleration - j1 * y * dt);
+}
+
+void simulation_rotations_update(
+	quat& rotation,
+	vec3& angular_velocity,
+	const quat desired_rotation,
+	const float halflife,
+	const float dt)
+{
+	simple_spring_damper_exact(
+		rotation,
+		angular_velocity,
+		desired_rotation,
+		halflife, dt);
+}
+
+// Predict what the desired rotation will be in the future. The camera
+// is assumed to stay where it is.
+void trajectory_desired_rotations_predict(
+	slice1d<quat> desired_rotations,
+	const slice1d<vec3> desired_velocities,
+	const quat desired_rotation,
+	const float camera_azimuth,
+	const vec3 gamepadstick_left,
+	const vec3 gamepadstick_right,
+	const bool desired_strafe,
+	const float dt)
+{
+	desired_rotations(0) = desired_rotation;
+
+	for (int i = 1; i < desired_rotations.size; i++)
+	{
+		desired_rotations(i) = desired_rotation_update(
+			desired_rotations(i - 1),
+			gamepadstick_left,
+			gamepadstick_right,
+			camera_azimuth,
+			desired_strafe,
+			desired_velocities(i));
+	}
+}
+
+void trajectory_rotations_predict(
+	slice1d<quat> rotations,
+	slice1d<vec3> angular_velocities,
+	const quat rotation,
+	const vec3 angular_velocity,
+	const slice1d<quat> desired_rotations,
+	const float halflife,
+	const float dt)
+{
+	rotations.set(rotation);
+	angular_velocities.set(angular_velocity);
+
+	for (int i = 1; i < rotations.size; i++)
+	{
+		simulation_rotations_update(
+			rotations(i),
+			angular_velocities(i),
+			desired_rotations(i),
+			halflife,
+			i * dt);
+	}
+}
+
+void trajectory_desired_velocities_predict(
+	slice1d<vec3> desired_velocities,
+	const slice1d<quat> trajectory_rotations,
+	const vec3 desired_velocity,
+	const float camera_azimuth,
+	const vec3 gamepadstick_left,
+	const float fwrd_speed,
+	const float side_speed,
+	const float back_speed,
+	const float dt)
+{
+	desired_velocities(0) = desired_velocity;
+
+	for (int i = 1; i < desired_velocities.size; i++)
+	{
+		desired_velocities(i) = desired_velocity_update(
+			gamepadstick_left,
+			camera_azimuth,
+			trajectory_rotations(i),
+			fwrd_speed,
+			side_speed,
+			back_speed);
+	}
+}
+
+void trajectory_positions_predict(
+	slice1d<vec3> positions,
+	slice1d<vec3> velocities,
+	slice1d<vec3> accelerations,
+	const vec3 position,
+	const vec3 velocity,
+	const vec3 acceleration,
+	const slice1d<vec3> desired_velocities,
+	const float halflife,
+	const float dt)
+{
+	positions(0) = position;
+	velocities(0) = velocity;
+	accelerations(0) = acceleration;
+
+	for (int i = 1; i < positions.size; i++)
+	{
+		positions(i) = positions(i - 1);
+		velocities(i) = velocities(i - 1);
+		accelerations(i) = accelerations(i - 1);
+
+		simulation_positions_update(
+			positions(i),
+			velocities(i),
+			accelerations(i),
+			desired_velocities(i),
+			halflife,
+			dt);
+	}
+}
+
+// Copy a part of a feature vector from the matching database
+void query_copy_denormalized_feature(
+	slice1d<float> query,
+	int& offset,
+	const int size,
+	const slice1d<float> features,
+	const slice1d<float> features_offset,
+	const slice1d<float> features_scale)
+{
+	for (int i = 0; i < size; i++)
+	{
+		query(offset + i) = features(offset + i) * features_scale(offset + i) + features_offset(offset + i);
+	}
+
+	offset += size;
+}
+
+// Compute the query feature vector for the future trajectory positions, 
+// local to the root and projected onto the ground
+void query_compute_trajectory_position_feature(
+	slice1d<float> query,
+	int& offset,
+	const vec3 root_position,
+	const quat root_rotation,
+	const slice1d<vec3> trajectory_positions)
+{
+	for (int i = 1; i < trajectory_positions.size; i++)
+	{
+		vec3 traj = quat_inv_mul_vec3(root_rotation, trajectory_positions(i) - root_position);
+		query(offset + 0) = traj.x;
+		query(offset + 1) = traj.z;
+		offset += 2;
+	}
+}
+
+// Same but for the trajectory facing directions
+void query_compute_trajectory_direction_feature(
+	slice1d<float> query,
+	int& offset,
+	const quat root_rotation,
+	const slice1d<quat> trajectory_rotations)
+{
+	for (int i = 1; i < trajectory_rotations.size; i++)
+	{
+		vec3 traj = quat_inv_mul_vec3(root_rotation, quat_mul_vec3(trajectory_rotations(i), vec3(0, 0, 1)));
+		query(offset + 0) = traj.x;
+		query(offset + 1) = traj.z;
+		offset += 2;
+	}
+}
+
+void inertialize_pose_reset(
+	slice1d<vec3> bone_offset_positions,
+	slice1d<vec3> bone_offset_velocities,
+	slice1d<quat> bone_offset_rotations,
+	slice1d<vec3> bone_offset_angular_velocities,
+	vec3& transition_src_position,
+	quat& transition_src_rotation,
+	vec3& transition_dst_position,
+	quat& transition_dst_rotation,
+	const vec3 root_position,
+	const quat root_rotation)
+{
+	bone_offset_positions.zero();
+	bone_offset_velocities.zero();
+	bone_offset_rotations.set(quat());
+	bone_offset_angular_velocities.zero();
+
+	transition_src_position = root_position;
+	transition_src_rotation = root_rotation;
+	transition_dst_position = vec3();
+	transition_dst_rotation = quat();
+}
+
+// Records the offsets between the pose being played and the pose
+// being transitioned to. The root is handled separately, as the
+// destination root is moved to where the character currently is.
+void inertialize_pose_transition(
+	slice1d<vec3> bone_offset_positions,
+	slice1d<vec3> bone_offset_velocities,
+	slice1d<quat> bone_offset_rotations,
+	slice1d<vec3> bone_offset_angular_velocities,
+	vec3& transition_src_position,
+	quat& transition_src_rotation,
+	vec3& transition_dst_position,
+	quat& transition_dst_rotation,
+	const vec3 root_position,
+	const vec3 root_velocity,
+	const quat root_rotation,
+	const vec3 root_angular_velocity,
+	const slice1d<vec3> bone_src_positions,
+	const slice1d<vec3> bone_src_velocities,
+	const slice1d<quat> bone_src_rotations,
+	const slice1d<vec3> bone_src_angular_velocities,
+	const slice1d<vec3> bone_dst_positions,
+	const slice1d<vec3> bone_dst_velocities,
+	const slice1d<quat> bone_dst_rotations,
+	const slice1d<vec3> bone_dst_angular_velocities)
+{
+	transition_dst_position = root_position;
+	transition_dst_rotation = root_rotation;
+	transition_src_position = bone_dst_positions(0);
+	transition_src_rotation = bone_dst_rotations(0);
+
+	vec3 world_space_dst_velocity = quat_mul_vec3(transition_dst_rotation,
+		quat_inv_mul_vec3(transition_src_rotation, bone_dst_velocities(0)));
+
+	vec3 world_space_dst_angular_velocity = quat_mul_vec3(transition_dst_rotation,
+		quat_inv_mul_vec3(transition_src_rotation, bone_dst_angular_velocities(0)));
+
+	inertialize_transition(
+		bone_offset_positions(0),
+		bone_offset_velocities(0),
+		root_position,
+		root_velocity,
+		root_position,
+		world_space_dst_velocity);
+
+	inertialize_transition(
+		bone_offset_rotations(0),
+		bone_offset_angular_velocities(0),
+		root_rotation,
+		root_angular_velocity,
+		root_rotation,
+		world_space_dst_angular_velocity);
+
+	for (int i = 1; i < bone_offset_positions.size; i++)
+	{
+		inertialize_transition(
+			bone_offset_positions(i),
+			bone_offset_velocities(i),
+			bone_src_positions(i),
+			bone_src_velocities(i),
+			bone_dst_positions(i),
+			bone_dst_velocities(i));
+
+		inertialize_transition(
+			bone_offset_rotations(i),
+			bone_offset_angular_velocities(i),
+			bone_src_rotations(i),
+			bone_src_angular_velocities(i),
+			bone_dst_rotations(i),
+			bone_dst_angular_velocities(i));
+	}
+}
+
+void inertialize_pose_update(
+	slice1d<vec3> bone_positions,
+	slice1d<vec3> bone_velocities,
+	slice1d<quat> bone_rotations,
+	slice1d<vec3> bone_angular_velocities,
+	slice1d<vec3> bone_offset_positions,
+	slice1d<vec3> bone_offset_velocities,
+	slice1d<quat> bone_offset_rotations,
+	slice1d<vec3> bone_offset_angular_velocities,
+	const slice1d<vec3> bone_input_positions,
+	const slice1d<vec3> bone_input_velocities,
+	const slice1d<quat> bone_input_rotations,
+	const slice1d<vec3> bone_input_angular_velocities,
+	const vec3 transition_src_position,
+	const quat transition_src_rotation,
+	const vec3 transition_dst_position,
+	const quat transition_dst_rotation,
+	const float halflife,
+	const float dt)
+{
+	// Move the root of the input animation from its own space into 
+	// the space of the animation which was playing at the transition
+	vec3 world_space_position = quat_mul_vec3(transition_dst_rotation,
+		quat_inv_mul_vec3(transition_src_rotation,
+			bone_input_positions(0) - transition_src_position)) + transition_dst_position;
+
+	vec3 world_space_velocity = quat_mul_vec3(transition_dst_rotation,
+		quat_inv_mul_vec3(transition_src_rotation, bone_input_velocities(0)));
+
+	// Normalize here because quat inv mul can sometimes produce 
+	// unstable returns when the two rotations are very close.
+	quat world_space_rotation = quat_normalize(quat_mul(transition_dst_rotation,
+		quat_inv_mul(transition_src_rotation, bone_input_rotations(0))));
+
+	vec3 world_space_angular_velocity = quat_mul_vec3(transition_dst_rotation,
+		quat_inv_mul_vec3(transition_src_rotation, bone_input_angular_velocities(0)));
+
+	inertialize_update(
+		bone_positions(0),
+		bone_velocities(0),
+		bone_offset_positions(0),
+		bone_offset_velocities(0),
+		world_space_position,
+		world_space_velocity,
+		halflife,
+		dt);
+
+	inertialize_update(
+		bone_rotations(0),
+		bone_angular_velocities(0),
+		bone_offset_rotations(0),
+		bone_offset_angular_velocities(0),
+		world_space_rotation,
+		world_space_angular_velocity,
+		halflife,
+		dt);
+
+	// The rest of the bones are updated all at once
+	const int nbones = bone_positions.size - 1;
+
+	inertialize_update_batch(
+		slice1d<vec3>(nbones, bone_positions.data + 1),
+		slice1d<vec3>(nbones, bone_velocities.data + 1),
+		slice1d<vec3>(nbones, bone_offset_positions.data + 1),
+		slice1d<vec3>(nbones, bone_offset_velocities.data + 1),
+		slice1d<vec3>(nbones, bone_input_positions.data + 1),
+		slice1d<vec3>(nbones, bone_input_velocities.data + 1),
+		halflife,
+		dt);
+
+	inertialize_update_batch(
+		slice1d<quat>(nbones, bone_rotations.data + 1),
+		slice1d<vec3>(nbones, bone_angular_velocities.data + 1),
+		slice1d<quat>(nbones, bone_offset_rotations.data + 1),
+		slice1d<vec3>(nbones, bone_offset_angular_velocities.data + 1),
+		slice1d<quat>(nbones, bone_input_rotations.data + 1),
+		slice1d<vec3>(nbones, bone_input_angular_velocities.data + 1),
+		halflife,
+		dt);
+}
+
+//--------------------------------------------------------------------------//
+
+
 DEFINE_LOG_CATEGORY(LogTemplateCharacter);
 // ALearnedMMCharacter
 
@@ -249,40 +664,1124 @@ void ALearnedMMCharacter::BeginPlay()
 		}
 	}
 
-	//PlayerController = UGameplayStatics::GetPlayerController(this, 0);
+	CachedPlayerController = Cast<APlayerController>(Controller);
+
+	BuildPoseBoneTable();
+
+	if (bLearnedMotionMatching)
+	{
+		// Load (or share with other characters) the networks
+		const FString DecompressorPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / DecompressorFile);
+		const FString StepperPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / StepperFile);
+		const FString ProjectorPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / ProjectorFile);
+		const FString LmmFeaturesPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / FeaturesFile);
+
+		Lmm = lmm_acquire(
+			TCHAR_TO_UTF8(*DecompressorPath),
+			TCHAR_TO_UTF8(*StepperPath),
+			TCHAR_TO_UTF8(*ProjectorPath),
+			TCHAR_TO_UTF8(*LmmFeaturesPath));
+
+		if (Lmm == nullptr)
+		{
+			UE_LOG(LogTemplateCharacter, Warning, TEXT("'%s' Failed to load learned motion matching networks '%s'"), *GetNameSafe(this), *DecompressorPath);
+		}
+		else if (Lmm->nfeatures() != FeatureCount)
+		{
+			UE_LOG(LogTemplateCharacter, Error, TEXT("'%s' Learned motion matching features '%s' have %d features, expected %d"), *GetNameSafe(this), *LmmFeaturesPath, Lmm->nfeatures(), FeatureCount);
+			lmm_release(Lmm);
+			Lmm = nullptr;
+		}
+		else
+		{
+			MotionMatchingReset();
+
+			// Networks do not search, but the subsystem runs them along 
+			// with every other character's, and keeps their stats and 
+			// level of detail
+			SearchSubsystem = GetWorld()->GetSubsystem<UMMSearchSubsystem>();
+			if (SearchSubsystem != nullptr && bUseLod)
+			{
+				LodHandle = SearchSubsystem->AddLod();
+			}
+		}
+
+		return;
+	}
+
+	// Load (or share with other characters) the motion matching database
+	const FString DatabasePath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / DatabaseFile);
+	const FString FeaturesPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectContentDir() / FeaturesFile);
+
+	Database = database_acquire(
+		TCHAR_TO_UTF8(*DatabasePath),
+		FeaturesFile.IsEmpty() ? nullptr : (const char*)TCHAR_TO_UTF8(*FeaturesPath));
+
+	if (Database == nullptr)
+	{
+		UE_LOG(LogTemplateCharacter, Warning, TEXT("'%s' Failed to load motion matching database '%s'"), *GetNameSafe(this), *DatabasePath);
+	}
+	else if (Database->nfeatures() != FeatureCount || Database->nframes() == 0)
+	{
+		UE_LOG(LogTemplateCharacter, Error, TEXT("'%s' Motion matching database '%s' has %d features, expected %d"), *GetNameSafe(this), *DatabasePath, Database->nfeatures(), FeatureCount);
+		database_release(Database);
+		Database = nullptr;
+	}
+	else
+	{
+		MotionMatchingReset();
+
+		// Searches are gathered and run together by the subsystem, between 
+		// this actor's tick and the search tick function
+		SearchSubsystem = GetWorld()->GetSubsystem<UMMSearchSubsystem>();
+		if (SearchSubsystem != nullptr)
+		{
+			SearchTickFunction.Target = this;
+			SearchTickFunction.TickGroup = TG_PostPhysics;
+			SearchTickFunction.bCanEverTick = true;
+			SearchTickFunction.RegisterTickFunction(GetLevel());
+			SearchTickFunction.AddPrerequisite(this, PrimaryActorTick);
+			SearchTickFunction.AddPrerequisite(SearchSubsystem, SearchSubsystem->GetSearchTickFunction());
+
+			if (bUseLod)
+			{
+				LodHandle = SearchSubsystem->AddLod();
+			}
+		}
+	}
+}
+
+void ALearnedMMCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (SearchTickFunction.IsTickFunctionRegistered())
+	{
+		SearchTickFunction.UnRegisterTickFunction();
+	}
+
+	// A queued search still refers to the database
+	if (PendingSearchTicket != INDEX_NONE)
+	{
+		SearchSubsystem->GetResult(PendingSearchTicket);
+		PendingSearchTicket = INDEX_NONE;
+	}
+
+	// Likewise queued networks
+	if (PendingNetworkStage != INDEX_NONE)
+	{
+		SearchSubsystem->RunNetworks();
+	}
+
+	if (LodHandle != INDEX_NONE)
+	{
+		SearchSubsystem->RemoveLod(LodHandle);
+		LodHandle = INDEX_NONE;
+	}
+
+	SearchSubsystem = nullptr;
+
+	database_release(Database);
+	Database = nullptr;
+
+	lmm_release(Lmm);
+	Lmm = nullptr;
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void ALearnedMMCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	// ̽ƽ(̵) Ű Է  Է° ʱȭ.
-	APlayerController* PlayerController = UGameplayStatics::GetPlayerController(this, 0);
-	if (PlayerController)
+	// Sticks, strafe and walk arrive as input events. Without a walk 
+	// action the button is read here, once per frame, unless the 
+	// input is being set from outside.
+	if (WalkAction == nullptr && CachedPlayerController != nullptr && !bExternalInput)
 	{
-		if (!PlayerController->IsInputKeyDown(EKeys::Gamepad_LeftStick_Down) && !PlayerController->IsInputKeyDown(EKeys::Gamepad_LeftStick_Up)
-			&& !PlayerController->IsInputKeyDown(EKeys::Gamepad_LeftStick_Left) && !PlayerController->IsInputKeyDown(EKeys::Gamepad_LeftStick_Right))
+		MotionMatchingInput.bWalk = CachedPlayerController->IsInputKeyDown(EKeys::Gamepad_FaceButton_Bottom);
+	}
+
+	// The database is sampled at a fixed rate, so step the controller 
+	// as many times as needed to catch up with game time
+	if (Database != nullptr || Lmm != nullptr)
+	{
+		frame_arena_scope Scratch;
+
+		// In case the search tick did not get to run last frame
+		MotionMatchingPostSearch();
+
+		// A database which fails its checksums while streaming in has 
+		// nothing left to search, so stop using it
+		if (Database != nullptr && database_failed(*Database))
+		{
+			UE_LOG(LogTemplateCharacter, Error, TEXT("'%s' Motion matching database '%s' is corrupt and was dropped"), *GetNameSafe(this), *DatabaseFile);
+			database_release(Database);
+			Database = nullptr;
+			return;
+		}
+
+		// Distance to the camera picks the level of detail and the 
+		// priority of searches under the frame budget
+		if (SearchSubsystem != nullptr)
+		{
+			CameraDistance = 0.0f;
+			if (APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0))
+			{
+				CameraDistance = FVector::Dist(CameraManager->GetCameraLocation(), GetActorLocation());
+			}
+		}
+
+		// The tier given last frame is used while asking for the next one
+		if (LodHandle != INDEX_NONE)
+		{
+			LodTier = SearchSubsystem->GetLodTier(LodHandle);
+			SearchSubsystem->RequestLod(LodHandle, CameraDistance, lod_tier_from_distance(CameraDistance, LodReducedDistance, LodTrajectoryDistance));
+		}
+
+		MotionMatchingAccumulator = FMath::Min(MotionMatchingAccumulator + DeltaTime, 4.0f * MotionMatchingDt);
+
+		int32 Steps = FMath::FloorToInt(MotionMatchingAccumulator / MotionMatchingDt);
+		MotionMatchingAccumulator -= Steps * MotionMatchingDt;
+
+		if (LodTier == LOD_TRAJECTORY)
+		{
+			for (int32 Step = 0; Step < Steps; Step++)
+			{
+				MotionMatchingTrajectoryUpdate(MotionMatchingDt);
+			}
+
+			Steps = 0;
+		}
+
+		// Catch up steps search straight away. The last step's search 
+		// is handed to the subsystem and finished in the search tick, 
+		// or its networks are continued by the subsystem.
+		for (int32 Step = 0; Step < Steps - 1; Step++)
+		{
+			MotionMatchingUpdate(MotionMatchingDt, MotionMatchingSearchAllowed());
+		}
+
+		if (Steps > 0)
 		{
-			LeftStickValue = FVector2D(0, 0);
+			const bool bSearchAllowed = MotionMatchingSearchAllowed();
+
+			if (SearchSubsystem == nullptr)
+			{
+				MotionMatchingUpdate(MotionMatchingDt, bSearchAllowed);
+			}
+			else if (Lmm != nullptr)
+			{
+				LearnedMotionMatchingSubmit(MotionMatchingDt, MotionMatchingPrepare(MotionMatchingDt, bSearchAllowed));
+			}
+			else if (MotionMatchingPrepare(MotionMatchingDt, bSearchAllowed))
+			{
+				PendingSearchTicket = SearchSubsystem->Submit(Database, query, search_curr_index, bSearchUseBounds);
+				PendingSearchDt = MotionMatchingDt;
+			}
+			else
+			{
+				MotionMatchingFinish(MotionMatchingDt, local_best_index != -1, local_best_index);
+			}
 		}
+
+		// Otherwise the search tick or the subsystem submits it
+		if (PendingSearchTicket == INDEX_NONE && PendingNetworkStage == INDEX_NONE)
+		{
+			MotionMatchingSubmitPose();
+		}
+	}
+}
+
+void ALearnedMMCharacter::PossessedBy(AController* NewController)
+{
+	Super::PossessedBy(NewController);
+
+	CachedPlayerController = Cast<APlayerController>(NewController);
+}
+
+void ALearnedMMCharacter::UnPossessed()
+{
+	Super::UnPossessed();
+
+	CachedPlayerController = nullptr;
+}
+
+void FLearnedMMCharacterSearchTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (IsValid(Target))
+	{
+		Target->MotionMatchingPostSearch();
+	}
+}
+
+FString FLearnedMMCharacterSearchTickFunction::DiagnosticMessage()
+{
+	return Target != nullptr ? Target->GetFullName() + TEXT("[SearchTick]") : TEXT("FLearnedMMCharacterSearchTickFunction");
+}
+
+void ALearnedMMCharacter::MotionMatchingReset()
+{
+	search_timer = SearchTime;
+	force_search_timer = SearchTime;
+	MotionMatchingAccumulator = 0.0f;
+
+	if (Lmm != nullptr)
+	{
+		LearnedMotionMatchingReset();
+	}
+	else
+	{
+		const database& db = *Database;
+
+		frame_index = db.range_starts(0);
+		search_curr_index = frame_index;
+
+		bone_positions = db.bone_positions(frame_index);
+		bone_velocities = db.bone_velocities(frame_index);
+		bone_rotations = db.bone_rotations(frame_index);
+		bone_angular_velocities = db.bone_angular_velocities(frame_index);
+	}
+
+	bone_offset_positions.resize(bone_positions.size);
+	bone_offset_velocities.resize(bone_positions.size);
+	bone_offset_rotations.resize(bone_positions.size);
+	bone_offset_angular_velocities.resize(bone_positions.size);
+
+	simulation_position = vec3();
+	simulation_velocity = vec3();
+	simulation_acceleration = vec3();
+	simulation_rotation = quat();
+	simulation_angular_velocity = vec3();
+
+	desired_velocity = vec3();
+	desired_velocity_change_curr = vec3();
+	desired_velocity_change_prev = vec3();
+	desired_rotation = quat();
+	desired_rotation_change_curr = vec3();
+	desired_rotation_change_prev = vec3();
+
+	query.resize(FeatureCount);
+	last_search_query.resize(FeatureCount);
+	last_search_query.zero();
+	local_best_index = -1;
+
+	trajectory_desired_velocities.resize(4);
+	trajectory_desired_rotations.resize(4);
+	trajectory_positions.resize(4);
+	trajectory_velocities.resize(4);
+	trajectory_accelerations.resize(4);
+	trajectory_rotations.resize(4);
+	trajectory_angular_velocities.resize(4);
+
+	trajectory_desired_velocities.zero();
+	trajectory_desired_rotations.set(quat());
+
+	inertialize_pose_reset(
+		bone_offset_positions,
+		bone_offset_velocities,
+		bone_offset_rotations,
+		bone_offset_angular_velocities,
+		transition_src_position,
+		transition_src_rotation,
+		transition_dst_position,
+		transition_dst_rotation,
+		bone_positions(0),
+		bone_rotations(0));
+}
+
+void ALearnedMMCharacter::MotionMatchingUpdate(const float dt, const bool search_allowed)
+{
+	if (Lmm != nullptr)
+	{
+		LearnedMotionMatchingFinish(dt, MotionMatchingPrepare(dt, search_allowed));
+	}
+	else if (MotionMatchingPrepare(dt, search_allowed))
+	{
+		int best_index = search_curr_index;
+		float best_cost = FLT_MAX;
+
+		database_search(
+			best_index,
+			best_cost,
+			*Database,
+			query,
+			0.0f,
+			20,
+			20,
+			-1,
+			bSearchUseBounds);
+
+		MotionMatchingFinish(dt, true, best_index);
+	}
+	else
+	{
+		MotionMatchingFinish(dt, local_best_index != -1, local_best_index);
+	}
+}
+
+void ALearnedMMCharacter::MotionMatchingPostSearch()
+{
+	// Networks still queued run now, continuing this character
+	if (PendingNetworkStage != INDEX_NONE)
+	{
+		SearchSubsystem->RunNetworks();
 	}
 
-	// ̽ƽ(ȸ) Ű Էϴ üũ
-	if (PlayerController)
+	if (PendingSearchTicket == INDEX_NONE) { return; }
+
+	frame_arena_scope Scratch;
+
+	const int best_index = SearchSubsystem->GetResult(PendingSearchTicket);
+	PendingSearchTicket = INDEX_NONE;
+
+	MotionMatchingFinish(PendingSearchDt, true, best_index);
+	MotionMatchingSubmitPose();
+}
+
+bool ALearnedMMCharacter::MotionMatchingSearchAllowed()
+{
+	if (LodTier != LOD_REDUCED)
 	{
-		if (!PlayerController->IsInputKeyDown(EKeys::Gamepad_RightStick_Down) && !PlayerController->IsInputKeyDown(EKeys::Gamepad_RightStick_Up)
-			&& !PlayerController->IsInputKeyDown(EKeys::Gamepad_RightStick_Left) && !PlayerController->IsInputKeyDown(EKeys::Gamepad_RightStick_Right))
+		LodReducedStep = 0;
+		return true;
+	}
+
+	LodReducedStep = (LodReducedStep + 1) % FMath::Max(LodReducedRate, 1);
+	return LodReducedStep == 0;
+}
+
+void ALearnedMMCharacter::MotionMatchingSubmitPose()
+{
+	if (!bPoseChanged) { return; }
+
+	// Writing the bones and refreshing the mesh is charged to the 
+	// frame budget too. Over it the mesh keeps its last pose and 
+	// the newest one is written once a later frame has room
+	if (SearchSubsystem != nullptr && !SearchSubsystem->AdmitWork(
+		BUDGET_POSE,
+		budget_priority(CameraDistance, WasRecentlyRendered(0.2f), IsPlayerControlled(), PoseFramesWaited)))
+	{
+		PoseFramesWaited++;
+		return;
+	}
+
+	PoseFramesWaited = 0;
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	SubmitPose(bone_positions, bone_rotations);
+	bPoseChanged = false;
+
+	if (SearchSubsystem != nullptr)
+	{
+		SearchSubsystem->RecordWork(BUDGET_POSE, FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles));
+	}
+}
+
+void ALearnedMMCharacter::BuildPoseBoneTable()
+{
+	PoseBoneIndices.Reset();
+
+	if (PoseableMesh == nullptr || PoseableMesh->GetSkinnedAsset() == nullptr) { return; }
+
+	PoseBoneIndices.Reserve(PoseBoneNames.Num());
+
+	for (const FName& BoneName : PoseBoneNames)
+	{
+		int32 BoneIndex = BoneName.IsNone() ? INDEX_NONE : PoseableMesh->GetBoneIndex(BoneName);
+
+		if (!BoneName.IsNone() && BoneIndex == INDEX_NONE)
+		{
+			UE_LOG(LogTemplateCharacter, Warning, TEXT("'%s' Mesh has no bone '%s', it will not be posed"), *GetNameSafe(this), *BoneName.ToString());
+		}
+
+		PoseBoneIndices.Add(BoneIndex);
+	}
+}
+
+void ALearnedMMCharacter::SubmitPose(const slice1d<vec3> local_positions, const slice1d<quat> local_rotations)
+{
+	check(local_positions.size == local_rotations.size);
+
+	if (PoseBoneIndices.Num() == 0) { return; }
+
+	TArray<FTransform>& BoneSpaceTransforms = PoseableMesh->BoneSpaceTransforms;
+
+	const int32 Count = FMath::Min(local_positions.size, PoseBoneIndices.Num());
+
+	for (int32 i = 0; i < Count; i++)
+	{
+		const int32 BoneIndex = PoseBoneIndices[i];
+		if (!BoneSpaceTransforms.IsValidIndex(BoneIndex)) { continue; }
+
+		// Keeps the bone's scale
+		BoneSpaceTransforms[BoneIndex].SetRotation(to_unreal(local_rotations(i)));
+		BoneSpaceTransforms[BoneIndex].SetTranslation(to_unreal(local_positions(i)));
+	}
+
+	PoseableMesh->RefreshBoneTransforms();
+}
+
+void ALearnedMMCharacter::MotionMatchingDesiredUpdate(
+	vec3& gamepadstick_left,
+	vec3& gamepadstick_right,
+	float& simulation_fwrd_speed,
+	float& simulation_side_speed,
+	float& simulation_back_speed,
+	const float dt)
+{
+	// Sticks in the database's space, where forward on the stick is -z
+	gamepadstick_left = vec3(MotionMatchingInput.LeftStick.X, 0.0f, -MotionMatchingInput.LeftStick.Y);
+	gamepadstick_right = vec3(MotionMatchingInput.RightStick.X, 0.0f, -MotionMatchingInput.RightStick.Y);
+
+	if (length(gamepadstick_left) > 1.0f) { gamepadstick_left = normalize(gamepadstick_left); }
+	if (length(gamepadstick_right) > 1.0f) { gamepadstick_right = normalize(gamepadstick_right); }
+
+	// Get the desired gait (walk / run)
+	desired_gait_update(desired_gait, desired_gait_velocity, dt);
+
+	simulation_fwrd_speed = lerpf(simulation_run_fwrd_speed, simulation_walk_fwrd_speed, desired_gait);
+	simulation_side_speed = lerpf(simulation_run_side_speed, simulation_walk_side_speed, desired_gait);
+	simulation_back_speed = lerpf(simulation_run_back_speed, simulation_walk_back_speed, desired_gait);
+
+	// Get the desired velocity and rotation
+	vec3 desired_velocity_curr = desired_velocity_update(
+		gamepadstick_left,
+		Camera_Azimuth,
+		simulation_rotation,
+		simulation_fwrd_speed,
+		simulation_side_speed,
+		simulation_back_speed);
+
+	quat desired_rotation_curr = desired_rotation_update(
+		desired_rotation,
+		gamepadstick_left,
+		gamepadstick_right,
+		Camera_Azimuth,
+		MotionMatchingInput.bStrafe,
+		desired_velocity_curr);
+
+	// Check if we should force a search because input changed quickly
+	desired_velocity_change_prev = desired_velocity_change_curr;
+	desired_velocity_change_curr = (desired_velocity_curr - desired_velocity) / dt;
+	desired_velocity = desired_velocity_curr;
+
+	desired_rotation_change_prev = desired_rotation_change_curr;
+	desired_rotation_change_curr = quat_to_scaled_angle_axis(quat_abs(quat_mul_inv(desired_rotation_curr, desired_rotation))) / dt;
+	desired_rotation = desired_rotation_curr;
+}
+
+void ALearnedMMCharacter::MotionMatchingTrajectoryUpdate(const float dt)
+{
+	vec3 gamepadstick_left, gamepadstick_right;
+	float simulation_fwrd_speed, simulation_side_speed, simulation_back_speed;
+
+	MotionMatchingDesiredUpdate(
+		gamepadstick_left,
+		gamepadstick_right,
+		simulation_fwrd_speed,
+		simulation_side_speed,
+		simulation_back_speed,
+		dt);
+
+	const vec3 simulation_position_prev = simulation_position;
+	const quat simulation_rotation_prev = simulation_rotation;
+
+	simulation_positions_update(
+		simulation_position,
+		simulation_velocity,
+		simulation_acceleration,
+		desired_velocity,
+		simulation_velocity_halflife,
+		dt);
+
+	simulation_rotations_update(
+		simulation_rotation,
+		simulation_angular_velocity,
+		desired_rotation,
+		simulation_rotation_halflife,
+		dt);
+
+	// Move the root the way the simulation moved. The transition 
+	// moves with it so the animation carries on from here when 
+	// the pose updates again.
+	const quat delta_rotation = quat_mul_inv(simulation_rotation, simulation_rotation_prev);
+
+	bone_positions(0) = quat_mul_vec3(delta_rotation, bone_positions(0) - simulation_position_prev) + simulation_position;
+	bone_rotations(0) = quat_mul(delta_rotation, bone_rotations(0));
+	bone_velocities(0) = simulation_velocity;
+	bone_angular_velocities(0) = simulation_angular_velocity;
+
+	transition_dst_position = quat_mul_vec3(delta_rotation, transition_dst_position - simulation_position_prev) + simulation_position;
+	transition_dst_rotation = quat_mul(delta_rotation, transition_dst_rotation);
+
+	// Searches as soon as the pose updates again
+	search_timer -= dt;
+	force_search_timer -= dt;
+}
+
+bool ALearnedMMCharacter::MotionMatchingPrepare(const float dt, const bool search_allowed)
+{
+	vec3 gamepadstick_left, gamepadstick_right;
+	float simulation_fwrd_speed, simulation_side_speed, simulation_back_speed;
+
+	MotionMatchingDesiredUpdate(
+		gamepadstick_left,
+		gamepadstick_right,
+		simulation_fwrd_speed,
+		simulation_side_speed,
+		simulation_back_speed,
+		dt);
+
+	bool force_search = false;
+
+	if (force_search_timer <= 0.0f && (
+		(length(desired_velocity_change_prev) >= desired_velocity_change_threshold &&
+		 length(desired_velocity_change_curr) < desired_velocity_change_threshold) ||
+		(length(desired_rotation_change_prev) >= desired_rotation_change_threshold &&
+		 length(desired_rotation_change_curr) < desired_rotation_change_threshold)))
+	{
+		force_search = true;
+		force_search_timer = SearchTime;
+	}
+	else if (force_search_timer > 0.0f)
+	{
+		force_search_timer -= dt;
+	}
+
+	// Predict the future trajectory
+	trajectory_desired_rotations_predict(
+		trajectory_desired_rotations,
+		trajectory_desired_velocities,
+		desired_rotation,
+		Camera_Azimuth,
+		gamepadstick_left,
+		gamepadstick_right,
+		MotionMatchingInput.bStrafe,
+		TrajectorySampleDt);
+
+	trajectory_rotations_predict(
+		trajectory_rotations,
+		trajectory_angular_velocities,
+		simulation_rotation,
+		simulation_angular_velocity,
+		trajectory_desired_rotations,
+		simulation_rotation_halflife,
+		TrajectorySampleDt);
+
+	trajectory_desired_velocities_predict(
+		trajectory_desired_velocities,
+		trajectory_rotations,
+		desired_velocity,
+		Camera_Azimuth,
+		gamepadstick_left,
+		simulation_fwrd_speed,
+		simulation_side_speed,
+		simulation_back_speed,
+		TrajectorySampleDt);
+
+	trajectory_positions_predict(
+		trajectory_positions,
+		trajectory_velocities,
+		trajectory_accelerations,
+		simulation_position,
+		simulation_velocity,
+		simulation_acceleration,
+		trajectory_desired_velocities,
+		simulation_velocity_halflife,
+		TrajectorySampleDt);
+
+	// Make the query. The pose part comes from the frame being 
+	// played and the trajectory part is relative to the simulation.
+	int offset = 0;
+	if (Lmm != nullptr)
+	{
+		query_copy_denormalized_feature(query, offset, 15, features_curr, Lmm->features_offset, Lmm->features_scale);
+	}
+	else
+	{
+		query_copy_denormalized_feature(query, offset, 15, Database->features(frame_index), Database->features_offset, Database->features_scale);
+	}
+
+	query_compute_trajectory_position_feature(query, offset, simulation_position, simulation_rotation, trajectory_positions);
+	query_compute_trajectory_direction_feature(query, offset, simulation_rotation, trajectory_rotations);
+
+	assert(offset == FeatureCount);
+
+	// Check if we reached the end of the current anim. Networks 
+	// have no end.
+	bool end_of_anim = Lmm == nullptr && database_trajectory_index_clamp(*Database, frame_index, 1) == frame_index;
+
+	search_curr_index = end_of_anim ? -1 : frame_index;
+	local_best_index = -1;
+
+	// The stepper keeps following the last projection, so project 
+	// again early if the trajectory has since moved away from it
+	bool trajectory_changed = Lmm != nullptr && 
+		lmm_query_drift(*Lmm, query, last_search_query) > ProjectorDriftThreshold;
+
+	if (!force_search && !end_of_anim && !trajectory_changed && search_timer > 0.0f)
+	{
+		return false;
+	}
+
+	// The search waits for a step which allows it, unless there is
+	// nothing left of the animation to play in the meantime
+	if (!search_allowed && !end_of_anim)
+	{
+		search_timer = 0.0f;
+		return false;
+	}
+
+	// When the query has barely moved since the last full search 
+	// the best match is most likely close to the current frame, so 
+	// only search around it
+	if (bLazySearch && Lmm == nullptr && !force_search && !end_of_anim &&
+		database_query_drift(*Database, query, last_search_query) < LazySearchDriftThreshold)
+	{
+		float best_cost = FLT_MAX;
+		local_best_index = frame_index;
+
+		database_search_local(
+			local_best_index,
+			best_cost,
+			*Database,
+			query,
+			LazySearchRadius);
+
+		if (SearchSubsystem != nullptr) { SearchSubsystem->RecordSearch(false); }
+
+		return false;
+	}
+
+	// Over the frame budget the search waits, and happens as soon 
+	// as a later frame has room for it
+	if (SearchSubsystem != nullptr && !end_of_anim && !SearchSubsystem->AdmitWork(
+		Lmm != nullptr ? BUDGET_PROJECTOR : BUDGET_SEARCH,
+		budget_priority(CameraDistance, WasRecentlyRendered(0.2f), IsPlayerControlled(), BudgetFramesWaited)))
+	{
+		search_timer = 0.0f;
+		BudgetFramesWaited++;
+		return false;
+	}
+
+	BudgetFramesWaited = 0;
+	last_search_query = query;
+
+	if (SearchSubsystem != nullptr) { SearchSubsystem->RecordSearch(true); }
+
+	return true;
+}
+
+void ALearnedMMCharacter::MotionMatchingFinish(const float dt, const bool searched, const int best_index)
+{
+	const database& db = *Database;
+
+	if (searched)
+	{
+		// Transition if better frame found
+		if (best_index != frame_index && best_index != -1)
+		{
+			inertialize_pose_transition(
+				bone_offset_positions,
+				bone_offset_velocities,
+				bone_offset_rotations,
+				bone_offset_angular_velocities,
+				transition_src_position,
+				transition_src_rotation,
+				transition_dst_position,
+				transition_dst_rotation,
+				bone_positions(0),
+				bone_velocities(0),
+				bone_rotations(0),
+				bone_angular_velocities(0),
+				db.bone_positions(frame_index),
+				db.bone_velocities(frame_index),
+				db.bone_rotations(frame_index),
+				db.bone_angular_velocities(frame_index),
+				db.bone_positions(best_index),
+				db.bone_velocities(best_index),
+				db.bone_rotations(best_index),
+				db.bone_angular_velocities(best_index));
+
+			frame_index = best_index;
+		}
+
+		search_timer = SearchTime;
+	}
+
+	search_timer -= dt;
+
+	// Tick frame, staying inside the current range
+	frame_index = database_trajectory_index_clamp(db, frame_index, 1);
+
+	inertialize_pose_update(
+		bone_positions,
+		bone_velocities,
+		bone_rotations,
+		bone_angular_velocities,
+		bone_offset_positions,
+		bone_offset_velocities,
+		bone_offset_rotations,
+		bone_offset_angular_velocities,
+		db.bone_positions(frame_index),
+		db.bone_velocities(frame_index),
+		db.bone_rotations(frame_index),
+		db.bone_angular_velocities(frame_index),
+		transition_src_position,
+		transition_src_rotation,
+		transition_dst_position,
+		transition_dst_rotation,
+		InertializeBlendingHalflife,
+		dt);
+
+	bPoseChanged = true;
+
+	// Update the simulation
+	simulation_positions_update(
+		simulation_position,
+		simulation_velocity,
+		simulation_acceleration,
+		desired_velocity,
+		simulation_velocity_halflife,
+		dt);
+
+	simulation_rotations_update(
+		simulation_rotation,
+		simulation_angular_velocity,
+		desired_rotation,
+		simulation_rotation_halflife,
+		dt);
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingReset()
+{
+	const lmm& l = *Lmm;
+
+	frame_index = -1;
+	search_curr_index = -1;
+
+	features_curr = l.initial_features;
+	latent_curr = l.initial_latent;
+	features_proj.resize(l.nfeatures());
+	latent_proj.resize(l.nlatent());
+
+	nnet_evaluation_resize(decompressor_evaluation, l.decompressor);
+	nnet_evaluation_resize(stepper_evaluation, l.stepper);
+	nnet_evaluation_resize(projector_evaluation, l.projector);
+	network_input.resize(l.nfeatures() + l.nlatent());
+
+	curr_bone_positions.resize(l.nbones());
+	curr_bone_velocities.resize(l.nbones());
+	curr_bone_rotations.resize(l.nbones());
+	curr_bone_angular_velocities.resize(l.nbones());
+
+	trns_bone_positions.resize(l.nbones());
+	trns_bone_velocities.resize(l.nbones());
+	trns_bone_rotations.resize(l.nbones());
+	trns_bone_angular_velocities.resize(l.nbones());
+
+	// Start from the decompressed first frame at the origin
+	vec3 root_velocity, root_angular_velocity;
+
+	decompressor_evaluate(
+		curr_bone_positions,
+		curr_bone_velocities,
+		curr_bone_rotations,
+		curr_bone_angular_velocities,
+		root_velocity,
+		root_angular_velocity,
+		decompressor_evaluation,
+		l.decompressor,
+		features_curr,
+		latent_curr,
+		vec3(),
+		quat(),
+		0.0f);
+
+	bone_positions = curr_bone_positions;
+	bone_velocities = curr_bone_velocities;
+	bone_rotations = curr_bone_rotations;
+	bone_angular_velocities = curr_bone_angular_velocities;
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingFinish(const float dt, const bool searched)
+{
+	const lmm& l = *Lmm;
+
+	if (searched)
+	{
+		uint64 StartCycles = FPlatformTime::Cycles64();
+
+		projector_evaluate(
+			features_proj,
+			latent_proj,
+			projector_evaluation,
+			l.projector,
+			query);
+
+		RecordNetworkTime(LMM_PROJECTOR, StartCycles);
+
+		if (LearnedMotionMatchingProjected())
+		{
+			vec3 root_velocity, root_angular_velocity;
+
+			StartCycles = FPlatformTime::Cycles64();
+
+			decompressor_evaluate(
+				trns_bone_positions,
+				trns_bone_velocities,
+				trns_bone_rotations,
+				trns_bone_angular_velocities,
+				root_velocity,
+				root_angular_velocity,
+				decompressor_evaluation,
+				l.decompressor,
+				features_proj,
+				latent_proj,
+				curr_bone_positions(0),
+				curr_bone_rotations(0),
+				dt);
+
+			RecordNetworkTime(LMM_DECOMPRESSOR, StartCycles);
+
+			LearnedMotionMatchingTransition();
+		}
+	}
+
+	search_timer -= dt;
+
+	// Step forward and decompress the new pose
+	uint64 StartCycles = FPlatformTime::Cycles64();
+
+	stepper_evaluate(
+		features_curr,
+		latent_curr,
+		stepper_evaluation,
+		l.stepper,
+		dt);
+
+	RecordNetworkTime(LMM_STEPPER, StartCycles);
+
+	vec3 root_velocity, root_angular_velocity;
+
+	StartCycles = FPlatformTime::Cycles64();
+
+	decompressor_evaluate(
+		curr_bone_positions,
+		curr_bone_velocities,
+		curr_bone_rotations,
+		curr_bone_angular_velocities,
+		root_velocity,
+		root_angular_velocity,
+		decompressor_evaluation,
+		l.decompressor,
+		features_curr,
+		latent_curr,
+		curr_bone_positions(0),
+		curr_bone_rotations(0),
+		dt);
+
+	RecordNetworkTime(LMM_DECOMPRESSOR, StartCycles);
+
+	LearnedMotionMatchingPoseUpdate(dt);
+}
+
+bool ALearnedMMCharacter::LearnedMotionMatchingProjected()
+{
+	search_timer = ProjectorInterval;
+
+	// Transition if the projection is far enough from where we are
+	float distance = 0.0f;
+	for (int i = 0; i < features_curr.size; i++)
+	{
+		distance += squaref(features_curr(i) - features_proj(i));
+	}
+
+	return distance > ProjectionTransitionThreshold;
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingTransition()
+{
+	inertialize_pose_transition(
+		bone_offset_positions,
+		bone_offset_velocities,
+		bone_offset_rotations,
+		bone_offset_angular_velocities,
+		transition_src_position,
+		transition_src_rotation,
+		transition_dst_position,
+		transition_dst_rotation,
+		bone_positions(0),
+		bone_velocities(0),
+		bone_rotations(0),
+		bone_angular_velocities(0),
+		curr_bone_positions,
+		curr_bone_velocities,
+		curr_bone_rotations,
+		curr_bone_angular_velocities,
+		trns_bone_positions,
+		trns_bone_velocities,
+		trns_bone_rotations,
+		trns_bone_angular_velocities);
+
+	features_curr = features_proj;
+	latent_curr = latent_proj;
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingPoseUpdate(const float dt)
+{
+	inertialize_pose_update(
+		bone_positions,
+		bone_velocities,
+		bone_rotations,
+		bone_angular_velocities,
+		bone_offset_positions,
+		bone_offset_velocities,
+		bone_offset_rotations,
+		bone_offset_angular_velocities,
+		curr_bone_positions,
+		curr_bone_velocities,
+		curr_bone_rotations,
+		curr_bone_angular_velocities,
+		transition_src_position,
+		transition_src_rotation,
+		transition_dst_position,
+		transition_dst_rotation,
+		InertializeBlendingHalflife,
+		dt);
+
+	bPoseChanged = true;
+
+	// Update the simulation
+	simulation_positions_update(
+		simulation_position,
+		simulation_velocity,
+		simulation_acceleration,
+		desired_velocity,
+		simulation_velocity_halflife,
+		dt);
+
+	simulation_rotations_update(
+		simulation_rotation,
+		simulation_angular_velocity,
+		desired_rotation,
+		simulation_rotation_halflife,
+		dt);
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingSubmit(const float dt, const bool searched)
+{
+	PendingNetworkDt = dt;
+
+	if (searched)
+	{
+		PendingNetworkStage = LMM_PROJECTOR;
+		PendingNetworkTicket = SearchSubsystem->SubmitNetwork(this, LMM_PROJECTOR, &Lmm->projector, query);
+	}
+	else
+	{
+		LearnedMotionMatchingSubmitStep(features_curr, latent_curr);
+	}
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingSubmitStep(const slice1d<float> features, const slice1d<float> latent)
+{
+	search_timer -= PendingNetworkDt;
+
+	lmm_network_input(network_input, features, latent);
+
+	PendingNetworkStage = LMM_STEPPER;
+	PendingNetworkTicket = SearchSubsystem->SubmitNetwork(this, LMM_STEPPER, &Lmm->stepper, network_input);
+}
+
+void ALearnedMMCharacter::LearnedMotionMatchingContinue()
+{
+	if (PendingNetworkStage == INDEX_NONE) { return; }
+
+	frame_arena_scope Scratch;
+
+	const lmm& l = *Lmm;
+	const float dt = PendingNetworkDt;
+	const slice1d<float> output = SearchSubsystem->GetNetworkResult(PendingNetworkTicket);
+
+	if (PendingNetworkStage == LMM_PROJECTOR)
+	{
+		projector_apply(features_proj, latent_proj, output);
+
+		// On a transition the step starts from the projection, so its 
+		// pose can be decompressed in the same round as the stepper
+		if (LearnedMotionMatchingProjected())
 		{
-			IsHandlingRightStick = false;
+			lmm_network_input(network_input, features_proj, latent_proj);
+			PendingTransitionTicket = SearchSubsystem->SubmitNetwork(this, LMM_DECOMPRESSOR, &l.decompressor, network_input);
+
+			LearnedMotionMatchingSubmitStep(features_proj, latent_proj);
 		}
 		else
 		{
-			IsHandlingRightStick = true;
+			LearnedMotionMatchingSubmitStep(features_curr, latent_curr);
 		}
 	}
+	else if (PendingNetworkStage == LMM_STEPPER)
+	{
+		if (PendingTransitionTicket != INDEX_NONE)
+		{
+			vec3 root_velocity, root_angular_velocity;
+
+			decompressor_apply(
+				trns_bone_positions,
+				trns_bone_velocities,
+				trns_bone_rotations,
+				trns_bone_angular_velocities,
+				root_velocity,
+				root_angular_velocity,
+				SearchSubsystem->GetNetworkResult(PendingTransitionTicket),
+				curr_bone_positions(0),
+				curr_bone_rotations(0),
+				dt);
+
+			PendingTransitionTicket = INDEX_NONE;
+
+			LearnedMotionMatchingTransition();
+		}
 
+		stepper_apply(features_curr, latent_curr, output, dt);
 
+		lmm_network_input(network_input, features_curr, latent_curr);
 
+		PendingNetworkStage = LMM_DECOMPRESSOR;
+		PendingNetworkTicket = SearchSubsystem->SubmitNetwork(this, LMM_DECOMPRESSOR, &l.decompressor, network_input);
+	}
+	else
+	{
+		vec3 root_velocity, root_angular_velocity;
+
+		decompressor_apply(
+			curr_bone_positions,
+			curr_bone_velocities,
+			curr_bone_rotations,
+			curr_bone_angular_velocities,
+			root_velocity,
+			root_angular_velocity,
+			output,
+			curr_bone_positions(0),
+			curr_bone_rotations(0),
+			dt);
+
+		PendingNetworkStage = INDEX_NONE;
+		PendingNetworkTicket = INDEX_NONE;
+
+		LearnedMotionMatchingPoseUpdate(dt);
+		MotionMatchingSubmitPose();
+	}
+}
+
+void ALearnedMMCharacter::RecordNetworkTime(const int32 Stage, const uint64 StartCycles)
+{
+	if (SearchSubsystem != nullptr)
+	{
+		SearchSubsystem->RecordNetwork(Stage, FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles));
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -298,13 +1797,22 @@ void ALearnedMMCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInput
 
 		// Moving
 		EnhancedInputComponent->BindAction(MoveAction, ETriggerEvent::Triggered, this, &ALearnedMMCharacter::Move);
+		EnhancedInputComponent->BindAction(MoveAction, ETriggerEvent::Completed, this, &ALearnedMMCharacter::StopMove);
 
 		// Looking
 		EnhancedInputComponent->BindAction(LookAction, ETriggerEvent::Triggered, this, &ALearnedMMCharacter::Look);
+		EnhancedInputComponent->BindAction(LookAction, ETriggerEvent::Completed, this, &ALearnedMMCharacter::StopLook);
 
 		// Strafe
 		EnhancedInputComponent->BindAction(StrafeAction, ETriggerEvent::Started, this, &ALearnedMMCharacter::OnStrafe);
 		EnhancedInputComponent->BindAction(StrafeAction, ETriggerEvent::Completed, this, &ALearnedMMCharacter::StopStrafe);
+
+		// Walk
+		if (WalkAction != nullptr)
+		{
+			EnhancedInputComponent->BindAction(WalkAction, ETriggerEvent::Started, this, &ALearnedMMCharacter::OnWalk);
+			EnhancedInputComponent->BindAction(WalkAction, ETriggerEvent::Completed, this, &ALearnedMMCharacter::StopWalk);
+		}
 	}
 	else
 	{
@@ -336,6 +1844,13 @@ void ALearnedMMCharacter::Move(const FInputActionValue& Value)
 		AddMovementInput(RightDirection, MovementVector.X);
 	}
 
+	// Raw stick value for the motion matching controller, unless the 
+	// input is being set from outside
+	if (!bExternalInput)
+	{
+		MotionMatchingInput.LeftStick = MovementVector;
+	}
+
 	///// LeftStick Value ĳ Look Axis  ȸ ȯ.
 	//if (Controller != nullptr)
 	//{
@@ -343,7 +1858,7 @@ void ALearnedMMCharacter::Move(const FInputActionValue& Value)
 	//	const FRotator Rotation = Controller->GetControlRotation();
 	//	float Radian = -FMath::DegreesToRadians(Rotation.Yaw);
 
-	//	LeftStickValue = RotationTransForm2D(MovementVector, Radian);
+	//	MotionMatchingInput.LeftStick = RotationTransForm2D(MovementVector, Radian);
 	//}
 
 
@@ -374,6 +1889,11 @@ void ALearnedMMCharacter::Look(const FInputActionValue& Value)
 		AddControllerPitchInput(LookAxisVector.Y);
 	}
 
+	if (!bExternalInput)
+	{
+		MotionMatchingInput.RightStick = LookAxisVector;
+	}
+
 
 	//-----------------------------------------------------------------------------//
 	//CharacterGaolRotation = CalculateJoystickAngle_FRotator(LookAxisVector);
@@ -389,6 +1909,34 @@ void ALearnedMMCharacter::Look(const FInputActionValue& Value)
 
 }
 
+void ALearnedMMCharacter::StopMove(const FInputActionValue& Value)
+{
+	if (bExternalInput) { return; }
+
+	MotionMatchingInput.LeftStick = FVector2D::ZeroVector;
+}
+
+void ALearnedMMCharacter::StopLook(const FInputActionValue& Value)
+{
+	if (bExternalInput) { return; }
+
+	MotionMatchingInput.RightStick = FVector2D::ZeroVector;
+}
+
+void ALearnedMMCharacter::OnWalk(const FInputActionValue& Value)
+{
+	if (bExternalInput) { return; }
+
+	MotionMatchingInput.bWalk = true;
+}
+
+void ALearnedMMCharacter::StopWalk(const FInputActionValue& Value)
+{
+	if (bExternalInput) { return; }
+
+	MotionMatchingInput.bWalk = false;
+}
+
 //UCharacter Ŭ ϴ GetMesh() Լ  -> PosealbeMeshComponent .
 UPoseableMeshComponent* ALearnedMMCharacter::GetMesh() const
 {
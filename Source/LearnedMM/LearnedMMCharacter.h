@@ -5,6 +5,12 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
 #include "Logging/LogMacros.h"
+#include "MMArray.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+#include "MMNNet.h"
+#include "MMLod.h"
+#include "Engine/EngineBaseTypes.h"
 #include "LearnedMMCharacter.generated.h"
 
 
@@ -12,10 +18,54 @@ class USpringArmComponent;
 class UCameraComponent;
 class UInputMappingContext;
 class UInputAction;
+class APlayerController;
 struct FInputActionValue;
+class UMMSearchSubsystem;
+class ALearnedMMCharacter;
+struct database;
+struct lmm;
 
 DECLARE_LOG_CATEGORY_EXTERN(LogTemplateCharacter, Log, All);
 
+/** Finishes the motion matching update once the search subsystem has run this frame's searches */
+USTRUCT()
+struct FLearnedMMCharacterSearchTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	ALearnedMMCharacter* Target = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FLearnedMMCharacterSearchTickFunction> : public TStructOpsTypeTraitsBase2<FLearnedMMCharacterSearchTickFunction>
+{
+	enum { WithCopy = false };
+};
+
+/** Input read by the motion matching controller. The input callbacks fill it in as input events arrive, or it can be set directly to drive a character from recorded input. */
+USTRUCT(BlueprintType)
+struct FLearnedMMInput
+{
+	GENERATED_BODY()
+
+	/** Movement stick, forward is +Y */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Input)
+	FVector2D LeftStick = FVector2D::ZeroVector;
+
+	/** Look stick, used to face the camera's way while strafing */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Input)
+	FVector2D RightStick = FVector2D::ZeroVector;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Input)
+	bool bWalk = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Input)
+	bool bStrafe = false;
+};
+
 UCLASS(config=Game)
 class ALearnedMMCharacter : public ACharacter
 {
@@ -49,6 +99,10 @@ class ALearnedMMCharacter : public ACharacter
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
 	UInputAction* StrafeAction;
 
+	/** Walk Input Action. Without one the gamepad's bottom face button is read instead. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
+	UInputAction* WalkAction;
+
 public:
 	ALearnedMMCharacter();
 
@@ -60,6 +114,13 @@ protected:
 
 	/** Called for looking input */
 	void Look(const FInputActionValue& Value);
+
+	/** Called when the sticks are let go */
+	void StopMove(const FInputActionValue& Value);
+	void StopLook(const FInputActionValue& Value);
+
+	void OnWalk(const FInputActionValue& Value);
+	void StopWalk(const FInputActionValue& Value);
 			
 
 protected:
@@ -69,8 +130,14 @@ protected:
 	// To add mapping context
 	virtual void BeginPlay();
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void Tick(float DeltaTime) override;
 
+	// Keep the controller read for keys up to date
+	virtual void PossessedBy(AController* NewController) override;
+	virtual void UnPossessed() override;
+
 public:
 	/** Returns CameraBoom subobject **/
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
@@ -92,16 +159,17 @@ private:
 	UPROPERTY()
 	FRotator CharacterGaolRotation;
 
+	/** Sticks, gait and strafe for the motion matching controller */
 	UPROPERTY()
-	FVector2D LeftStickValue;
-	UPROPERTY()
-	FVector2D RightStickValue;
+	FLearnedMMInput MotionMatchingInput;
 
+	/** Controlling player, if any, for reading keys without an action */
 	UPROPERTY()
-	bool IsHandlingRightStick = false;
+	TObjectPtr<APlayerController> CachedPlayerController;
 
-	//UPROPERTY()
-	//class APlayerController* PlayerController;
+	/** Set by SetMotionMatchingInput, after which player input events and the walk button no longer write the input */
+	UPROPERTY()
+	bool bExternalInput = false;
 
 //  Լ
 public:
@@ -114,14 +182,295 @@ public:
 	UFUNCTION()
 	void StopStrafe(const FInputActionValue& Value);
 
+	/** Replaces the input the controller reads, e.g. when playing back recorded input. Keys are no longer polled into it until ClearMotionMatchingInput */
+	UFUNCTION(BlueprintCallable, Category = MotionMatching)
+	void SetMotionMatchingInput(const FLearnedMMInput& Input) { MotionMatchingInput = Input; bExternalInput = true; }
+
+	/** Hands the input back to the player after SetMotionMatchingInput */
+	UFUNCTION(BlueprintCallable, Category = MotionMatching)
+	void ClearMotionMatchingInput() { MotionMatchingInput = FLearnedMMInput(); bExternalInput = false; }
+
+	UFUNCTION(BlueprintCallable, Category = MotionMatching)
+	FLearnedMMInput GetMotionMatchingInput() const { return MotionMatchingInput; }
+
 // Ѷ 
 public:
-	UPROPERTY()
-	bool bStrafe = false;
-
 	// ī޶
 	UPROPERTY()
 	float Camera_Azimuth = 0.0f;
 
+// Motion matching
+public:
+	/** Animation database, relative to the project Content directory. Either a container holding everything or a legacy database.bin */
+	UPROPERTY(EditAnywhere, Category = MotionMatching)
+	FString DatabaseFile = TEXT("MotionMatching/database.bin");
+
+	/** Matching features for a legacy database.bin. Leave empty if DatabaseFile is a container */
+	UPROPERTY(EditAnywhere, Category = MotionMatching)
+	FString FeaturesFile = TEXT("MotionMatching/features.bin");
+
+	/** Time between searches when nothing forces one */
+	UPROPERTY(EditAnywhere, Category = MotionMatching)
+	float SearchTime = 0.1f;
+
+	/** Halflife used to blend out the pose difference after a transition */
+	UPROPERTY(EditAnywhere, Category = MotionMatching)
+	float InertializeBlendingHalflife = 0.1f;
+
+	/** Search using the bounding box hierarchy instead of comparing every frame */
+	UPROPERTY(EditAnywhere, Category = MotionMatching)
+	bool bSearchUseBounds = true;
+
+	/** When the query has barely changed since the last full search, only search the frames near the current one */
+	UPROPERTY(EditAnywhere, Category = MotionMatching)
+	bool bLazySearch = true;
+
+	/** Squared distance in normalized feature space the query must drift from the last full search before searching everything again */
+	UPROPERTY(EditAnywhere, Category = MotionMatching, meta = (EditCondition = "bLazySearch", ClampMin = "0.0"))
+	float LazySearchDriftThreshold = 0.25f;
+
+	/** Number of frames either side of the current frame a local search looks at */
+	UPROPERTY(EditAnywhere, Category = MotionMatching, meta = (EditCondition = "bLazySearch", ClampMin = "1"))
+	int32 LazySearchRadius = 60;
+
+	/** Use Learned Motion Matching, where networks replace the animation database. FeaturesFile is still needed for the feature normalization */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned")
+	bool bLearnedMotionMatching = false;
+
+	/** Networks relative to the project Content directory */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned", meta = (EditCondition = "bLearnedMotionMatching"))
+	FString DecompressorFile = TEXT("MotionMatching/decompressor.bin");
+
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned", meta = (EditCondition = "bLearnedMotionMatching"))
+	FString StepperFile = TEXT("MotionMatching/stepper.bin");
+
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned", meta = (EditCondition = "bLearnedMotionMatching"))
+	FString ProjectorFile = TEXT("MotionMatching/projector.bin");
+
+	/** Squared distance the projected features must be from the current ones to transition to them */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned", meta = (EditCondition = "bLearnedMotionMatching", ClampMin = "0.0"))
+	float ProjectionTransitionThreshold = 0.01f;
+
+	/** Time between projections when nothing forces one. In between only the stepper and decompressor run */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned", meta = (EditCondition = "bLearnedMotionMatching", ClampMin = "0.0"))
+	float ProjectorInterval = 0.2f;
+
+	/** Squared distance in normalized feature space the query must drift from the last projection to project again before the interval is up */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Learned", meta = (EditCondition = "bLearnedMotionMatching", ClampMin = "0.0"))
+	float ProjectorDriftThreshold = 1.0f;
+
+	/** Update distant characters less often, or only move their root, within the budget set by mm.LodMaxFull and mm.LodMaxReduced */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|LOD")
+	bool bUseLod = true;
+
+	/** Distance from the camera beyond which motion matching only searches every LodReducedRate steps */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|LOD", meta = (EditCondition = "bUseLod", ClampMin = "0.0"))
+	float LodReducedDistance = 1500.0f;
+
+	/** Distance from the camera beyond which only the root is moved, with no search or pose update */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|LOD", meta = (EditCondition = "bUseLod", ClampMin = "0.0"))
+	float LodTrajectoryDistance = 4000.0f;
+
+	/** Number of 60hz steps between searches at reduced rate. The pose is still updated every step */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|LOD", meta = (EditCondition = "bUseLod", ClampMin = "2"))
+	int32 LodReducedRate = 4;
+
+	/** Mesh bone driven by each bone of the database, in the database's order. Bones with no name, like the root which the actor carries, are not written. */
+	UPROPERTY(EditAnywhere, Category = "MotionMatching|Pose")
+	TArray<FName> PoseBoneNames = {
+		NAME_None, TEXT("Hips"),
+		TEXT("LeftUpLeg"), TEXT("LeftLeg"), TEXT("LeftFoot"), TEXT("LeftToe"),
+		TEXT("RightUpLeg"), TEXT("RightLeg"), TEXT("RightFoot"), TEXT("RightToe"),
+		TEXT("Spine"), TEXT("Spine1"), TEXT("Spine2"), TEXT("Neck"), TEXT("Head"),
+		TEXT("LeftShoulder"), TEXT("LeftArm"), TEXT("LeftForeArm"), TEXT("LeftHand"),
+		TEXT("RightShoulder"), TEXT("RightArm"), TEXT("RightForeArm"), TEXT("RightHand") };
+
+	// Writes a pose, local to each bone's parent and in the database's 
+	// space, to the poseable mesh and refreshes it. Bones go through 
+	// the index table built at BeginPlay so no names are looked up.
+	void SubmitPose(const slice1d<vec3> local_positions, const slice1d<quat> local_rotations);
+
+private:
+	friend struct FLearnedMMCharacterSearchTickFunction;
+	friend class UMMSearchSubsystem;
+
+	void MotionMatchingReset();
+	void MotionMatchingUpdate(const float dt, const bool search_allowed);
+
+	// An update is split around the search so the search can be 
+	// handed to the search subsystem and run with everyone else's.
+	// When the search is not allowed, one that is due waits for the 
+	// next step that allows it.
+	bool MotionMatchingPrepare(const float dt, const bool search_allowed);
+	void MotionMatchingFinish(const float dt, const bool searched, const int best_index);
+	void MotionMatchingPostSearch();
+
+	// At `LOD_REDUCED` only one step in `LodReducedRate` may search. 
+	// Called once per step.
+	bool MotionMatchingSearchAllowed();
+
+	// Reads the sticks and gait and updates the desired velocity 
+	// and rotation, giving the sticks and speeds to predict with
+	void MotionMatchingDesiredUpdate(
+		vec3& gamepadstick_left,
+		vec3& gamepadstick_right,
+		float& simulation_fwrd_speed,
+		float& simulation_side_speed,
+		float& simulation_back_speed,
+		const float dt);
+
+	// At `LOD_TRAJECTORY` only the simulation moves, carrying the 
+	// last pose along with it
+	void MotionMatchingTrajectoryUpdate(const float dt);
+
+	// Looks up the mesh bone of each entry of `PoseBoneNames`
+	void BuildPoseBoneTable();
+
+	// Submits the pose if an update changed it since the last submit
+	void MotionMatchingSubmitPose();
+
+	// With Learned Motion Matching the networks stand in for the
+	// search and the database pose
+	void LearnedMotionMatchingReset();
+	void LearnedMotionMatchingFinish(const float dt, const bool searched);
+
+	// Parts of an update shared by networks evaluated here and by 
+	// the subsystem. `LearnedMotionMatchingProjected` follows the 
+	// projector and returns true if the character should transition 
+	// to the projection, once decompressed into `trns_bone_*`.
+	bool LearnedMotionMatchingProjected();
+	void LearnedMotionMatchingTransition();
+	void LearnedMotionMatchingPoseUpdate(const float dt);
+
+	// With the subsystem the networks of the last step are queued 
+	// with everyone else's. The subsystem continues the character 
+	// after each round, which reads the output of one network and 
+	// queues the next, until the pose is updated.
+	void LearnedMotionMatchingSubmit(const float dt, const bool searched);
+	void LearnedMotionMatchingSubmitStep(const slice1d<float> features, const slice1d<float> latent);
+	void LearnedMotionMatchingContinue();
+
+	// Hands the time since `StartCycles` spent in a network, an 
+	// `lmm_stage`, to the subsystem's stats
+	void RecordNetworkTime(const int32 Stage, const uint64 StartCycles);
+
+	const database* Database = nullptr;
+	const lmm* Lmm = nullptr;
+
+	UPROPERTY()
+	TObjectPtr<UMMSearchSubsystem> SearchSubsystem;
+
+	FLearnedMMCharacterSearchTickFunction SearchTickFunction;
+
+	int32 PendingSearchTicket = INDEX_NONE;
+
+	// Time covered by the update waiting on the pending search
+	float PendingSearchDt = 0.0f;
+
+	// Mesh bone index of each database bone, or INDEX_NONE
+	TArray<int32> PoseBoneIndices;
+	bool bPoseChanged = false;
+
+	int32 LodHandle = INDEX_NONE;
+	int32 LodTier = LOD_FULL;
+
+	// Steps since the last one allowed to search at `LOD_REDUCED`
+	int32 LodReducedStep = 0;
+
+	// Sets the priority of searches under the frame budget, along 
+	// with the number of updates a search has been waiting
+	float CameraDistance = 0.0f;
+	int32 BudgetFramesWaited = 0;
+
+	// Updates a changed pose has been waiting on the frame budget
+	int32 PoseFramesWaited = 0;
+
+	// Seconds of game time not yet consumed by fixed 60hz updates
+	float MotionMatchingAccumulator = 0.0f;
+
+	float search_timer = 0.0f;
+	float force_search_timer = 0.0f;
+	int frame_index = -1;
+
+	// Query of the last prepared update and the frame to compare 
+	// it against, which is -1 at the end of an animation
+	array1d<float> query;
+	int search_curr_index = -1;
+
+	// Query of the last full search, and the result of a local 
+	// search done by the last prepared update instead of a full one
+	array1d<float> last_search_query;
+	int local_best_index = -1;
+
+	float desired_gait = 0.0f;
+	float desired_gait_velocity = 0.0f;
+
+	vec3 simulation_position;
+	vec3 simulation_velocity;
+	vec3 simulation_acceleration;
+	quat simulation_rotation;
+	vec3 simulation_angular_velocity;
+
+	vec3 desired_velocity;
+	vec3 desired_velocity_change_curr;
+	vec3 desired_velocity_change_prev;
+	quat desired_rotation;
+	vec3 desired_rotation_change_curr;
+	vec3 desired_rotation_change_prev;
+
+	array1d<vec3> trajectory_desired_velocities;
+	array1d<quat> trajectory_desired_rotations;
+	array1d<vec3> trajectory_positions;
+	array1d<vec3> trajectory_velocities;
+	array1d<vec3> trajectory_accelerations;
+	array1d<quat> trajectory_rotations;
+	array1d<vec3> trajectory_angular_velocities;
+
+	// Pose after inertialization, in the database's space
+	array1d<vec3> bone_positions;
+	array1d<vec3> bone_velocities;
+	array1d<quat> bone_rotations;
+	array1d<vec3> bone_angular_velocities;
+
+	array1d<vec3> bone_offset_positions;
+	array1d<vec3> bone_offset_velocities;
+	array1d<quat> bone_offset_rotations;
+	array1d<vec3> bone_offset_angular_velocities;
+
+	vec3 transition_src_position;
+	quat transition_src_rotation;
+	vec3 transition_dst_position;
+	quat transition_dst_rotation;
+
+	// Learned Motion Matching state, with the decompressed pose
+	// standing in for the database pose and the pose of the
+	// projection used for transitions
+	array1d<float> features_curr;
+	array1d<float> latent_curr;
+	array1d<float> features_proj;
+	array1d<float> latent_proj;
+
+	nnet_evaluation decompressor_evaluation;
+	nnet_evaluation stepper_evaluation;
+	nnet_evaluation projector_evaluation;
+
+	// Network the subsystem is running for this character, an 
+	// `lmm_stage`, with its ticket, and the transition pose being 
+	// decompressed alongside the stepper
+	int32 PendingNetworkStage = INDEX_NONE;
+	int32 PendingNetworkTicket = INDEX_NONE;
+	int32 PendingTransitionTicket = INDEX_NONE;
+	float PendingNetworkDt = 0.0f;
+	array1d<float> network_input;
+
+	array1d<vec3> curr_bone_positions;
+	array1d<vec3> curr_bone_velocities;
+	array1d<quat> curr_bone_rotations;
+	array1d<vec3> curr_bone_angular_velocities;
+
+	array1d<vec3> trns_bone_positions;
+	array1d<vec3> trns_bone_velocities;
+	array1d<quat> trns_bone_rotations;
+	array1d<vec3> trns_bone_angular_velocities;
 };
 
@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMAlloc.h"
+
+#if MM_WINDOWS
+#include <malloc.h>
+#endif
+
+//--------------------------------------
+
+std::atomic<uint64_t> heap_allocations(0);
+
+void* aligned_malloc(size_t bytes, size_t alignment)
+{
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+
+#if MM_WINDOWS
+    return _aligned_malloc(bytes, alignment);
+#else
+    void* ptr = NULL;
+    return posix_memalign(&ptr, alignment, bytes) == 0 ? ptr : NULL;
+#endif
+}
+
+void aligned_free(void* ptr)
+{
+#if MM_WINDOWS
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+//--------------------------------------
+
+void frame_arena_init(frame_arena& arena, size_t capacity)
+{
+    arena.base = (char*)aligned_malloc(capacity);
+    arena.capacity = arena.base != NULL ? capacity : 0;
+    arena.offset = 0;
+    arena.peak = 0;
+    arena.overflows = 0;
+}
+
+void frame_arena_free(frame_arena& arena)
+{
+    aligned_free(arena.base);
+    arena.base = NULL;
+    arena.capacity = 0;
+    arena.offset = 0;
+}
+
+struct frame_arena_owner
+{
+    frame_arena arena;
+
+    frame_arena_owner() { frame_arena_init(arena, MM_FRAME_ARENA_SIZE); }
+    ~frame_arena_owner() { frame_arena_free(arena); }
+};
+
+frame_arena& frame_arena_thread()
+{
+    static thread_local frame_arena_owner owner;
+    return owner.arena;
+}
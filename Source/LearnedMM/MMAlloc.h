@@ -0,0 +1,280 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+//--------------------------------------
+
+// The engine defines `PLATFORM_WINDOWS`, but the standalone
+// benchmarks are built without it and only have `_WIN32`
+#if PLATFORM_WINDOWS || defined(_WIN32)
+#define MM_WINDOWS 1
+#else
+#define MM_WINDOWS 0
+#endif
+
+//--------------------------------------
+
+// Allocator policies for `array1d` and `array2d`. Each policy
+// is a type with three static functions:
+//
+//   void* allocate(size_t bytes)
+//   void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes)
+//   void deallocate(void* ptr, size_t bytes)
+//
+// so arrays carry no extra state and stay the same size.
+
+enum
+{
+    MM_ALIGNMENT = 64,
+    MM_FRAME_ARENA_SIZE = 4 * 1024 * 1024,
+};
+
+static inline size_t align_up(size_t bytes, size_t alignment = MM_ALIGNMENT)
+{
+    return (bytes + alignment - 1) & ~(alignment - 1);
+}
+
+void* aligned_malloc(size_t bytes, size_t alignment = MM_ALIGNMENT);
+void aligned_free(void* ptr);
+
+// Counts every allocation which reached the system heap, so
+// benchmarks can check that hot paths stay allocation free.
+extern std::atomic<uint64_t> heap_allocations;
+
+// Plain `malloc`/`realloc`. Alignment is whatever the C 
+// runtime gives, usually 16 bytes.
+struct heap_allocator
+{
+    static void* allocate(size_t bytes) { heap_allocations.fetch_add(1, std::memory_order_relaxed); return malloc(bytes); }
+    static void* reallocate(void* ptr, size_t /*old_bytes*/, size_t new_bytes) { heap_allocations.fetch_add(1, std::memory_order_relaxed); return realloc(ptr, new_bytes); }
+    static void deallocate(void* ptr, size_t /*bytes*/) { free(ptr); }
+};
+
+// Cache line aligned heap memory, so rows of feature and weight
+// matrices can be read with aligned AVX loads. This is the 
+// default policy for arrays.
+struct aligned_allocator
+{
+    static void* allocate(size_t bytes) 
+    { 
+        return aligned_malloc(bytes); 
+    }
+
+    static void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes)
+    {
+        void* data = aligned_malloc(new_bytes);
+        if (data != NULL && ptr != NULL)
+        {
+            memcpy(data, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+        }
+        aligned_free(ptr);
+        return data;
+    }
+
+    static void deallocate(void* ptr, size_t /*bytes*/) 
+    { 
+        aligned_free(ptr); 
+    }
+};
+
+//--------------------------------------
+
+// Linear arena for per-frame scratch memory. Allocation bumps
+// an offset and freeing does nothing unless it is the most 
+// recent allocation. Memory is reclaimed in bulk when the 
+// enclosing `frame_arena_scope` ends.
+struct frame_arena
+{
+    char* base;
+    size_t capacity;
+    size_t offset;
+    size_t peak;
+    size_t overflows;
+};
+
+void frame_arena_init(frame_arena& arena, size_t capacity);
+void frame_arena_free(frame_arena& arena);
+
+// The arena bound to the calling thread, created on first use
+frame_arena& frame_arena_thread();
+
+static inline bool frame_arena_owns(const frame_arena& arena, const void* ptr)
+{
+    return (const char*)ptr >= arena.base && (const char*)ptr < arena.base + arena.capacity;
+}
+
+// Marks the current arena offset and restores it on exit. Any 
+// `frame_allocator` arrays made inside the scope must not outlive it.
+struct frame_arena_scope
+{
+    frame_arena& arena;
+    size_t mark;
+
+    frame_arena_scope() : arena(frame_arena_thread()), mark(arena.offset) {}
+    ~frame_arena_scope() { arena.offset = mark; }
+
+    frame_arena_scope(const frame_arena_scope&) = delete;
+    frame_arena_scope& operator=(const frame_arena_scope&) = delete;
+};
+
+// Allocates from the calling thread's frame arena. Should the 
+// arena run out, allocations fall back to the aligned heap and
+// are counted in `overflows` so the arena size can be tuned.
+struct frame_allocator
+{
+    static void* allocate(size_t bytes)
+    {
+        frame_arena& arena = frame_arena_thread();
+        size_t size = align_up(bytes);
+
+        if (arena.offset + size > arena.capacity)
+        {
+            arena.overflows++;
+            return aligned_malloc(bytes);
+        }
+
+        void* ptr = arena.base + arena.offset;
+        arena.offset += size;
+        arena.peak = arena.offset > arena.peak ? arena.offset : arena.peak;
+        return ptr;
+    }
+
+    static void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes)
+    {
+        frame_arena& arena = frame_arena_thread();
+
+        // Grow or shrink in place if this is the top allocation
+        if (frame_arena_owns(arena, ptr) &&
+            (char*)ptr + align_up(old_bytes) == arena.base + arena.offset &&
+            (size_t)((char*)ptr - arena.base) + align_up(new_bytes) <= arena.capacity)
+        {
+            arena.offset = (size_t)((char*)ptr - arena.base) + align_up(new_bytes);
+            arena.peak = arena.offset > arena.peak ? arena.offset : arena.peak;
+            return ptr;
+        }
+
+        void* data = allocate(new_bytes);
+        if (data != NULL && ptr != NULL)
+        {
+            memcpy(data, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+        }
+        deallocate(ptr, old_bytes);
+        return data;
+    }
+
+    static void deallocate(void* ptr, size_t bytes)
+    {
+        frame_arena& arena = frame_arena_thread();
+
+        if (!frame_arena_owns(arena, ptr))
+        {
+            aligned_free(ptr);
+        }
+        else if ((char*)ptr + align_up(bytes) == arena.base + arena.offset)
+        {
+            arena.offset = (size_t)((char*)ptr - arena.base);
+        }
+    }
+};
+
+//--------------------------------------
+
+// Fixed size block pool shared by all arrays using the same
+// `BlockSize` and `BlockCount`. Blocks are recycled through a 
+// free list, so small arrays which are repeatedly created and
+// destroyed never reach the heap. Requests larger than a block,
+// or made while the pool is empty, fall back to the aligned heap.
+template<size_t BlockSize, int BlockCount>
+struct pool_allocator
+{
+    static_assert(BlockSize % MM_ALIGNMENT == 0, "Pool block size must be a multiple of the alignment");
+
+    struct pool
+    {
+        std::mutex mutex;
+        char* base;
+        void* free_list;
+
+        pool() : base(NULL), free_list(NULL)
+        {
+            base = (char*)aligned_malloc(BlockSize * BlockCount);
+            assert(base != NULL);
+
+            for (int i = BlockCount - 1; i >= 0; i--)
+            {
+                *(void**)(base + BlockSize * i) = free_list;
+                free_list = base + BlockSize * i;
+            }
+        }
+
+        ~pool() { aligned_free(base); }
+
+        bool owns(const void* ptr) const
+        {
+            return (const char*)ptr >= base && (const char*)ptr < base + BlockSize * BlockCount;
+        }
+    };
+
+    static pool& instance()
+    {
+        static pool p;
+        return p;
+    }
+
+    static void* allocate(size_t bytes)
+    {
+        if (bytes <= BlockSize)
+        {
+            pool& p = instance();
+            std::lock_guard<std::mutex> lock(p.mutex);
+
+            if (p.free_list != NULL)
+            {
+                void* ptr = p.free_list;
+                p.free_list = *(void**)ptr;
+                return ptr;
+            }
+        }
+
+        return aligned_malloc(bytes);
+    }
+
+    static void* reallocate(void* ptr, size_t old_bytes, size_t new_bytes)
+    {
+        if (instance().owns(ptr) && new_bytes <= BlockSize)
+        {
+            return ptr;
+        }
+
+        void* data = allocate(new_bytes);
+        if (data != NULL && ptr != NULL)
+        {
+            memcpy(data, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+        }
+        deallocate(ptr, old_bytes);
+        return data;
+    }
+
+    static void deallocate(void* ptr, size_t /*bytes*/)
+    {
+        pool& p = instance();
+
+        if (p.owns(ptr))
+        {
+            std::lock_guard<std::mutex> lock(p.mutex);
+            *(void**)ptr = p.free_list;
+            p.free_list = ptr;
+        }
+        else
+        {
+            aligned_free(ptr);
+        }
+    }
+};
@@ -3,10 +3,172 @@
 
 #include "MMArray.h"
 
-MMArray::MMArray()
+#include <stdlib.h>
+#include <mutex>
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <windows.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#elif MM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//--------------------------------------
+
+static std::mutex mapped_files_mutex;
+static mapped_file* mapped_files = NULL;
+
+static bool mapped_file_map(mapped_file* file, const char* filename)
 {
+#if MM_WINDOWS
+    HANDLE f = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(f, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(f);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(f);
+    if (mapping == NULL) { return false; }
+
+    const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    file->data = (const char*)data;
+    file->size = (size_t)size.QuadPart;
+    file->handle = mapping;
+    return true;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return false; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return false; }
+
+    file->data = (const char*)data;
+    file->size = (size_t)st.st_size;
+    file->handle = NULL;
+    return true;
+#endif
+}
+
+static void mapped_file_unmap(mapped_file* file)
+{
+#if MM_WINDOWS
+    UnmapViewOfFile(file->data);
+    CloseHandle((HANDLE)file->handle);
+#else
+    munmap((void*)file->data, file->size);
+#endif
 }
 
-MMArray::~MMArray()
+mapped_file* mapped_file_open(const char* filename)
 {
+    std::lock_guard<std::mutex> lock(mapped_files_mutex);
+
+    for (mapped_file* file = mapped_files; file != NULL; file = file->next)
+    {
+        if (strcmp(file->filename, filename) == 0)
+        {
+            file->refs++;
+            return file;
+        }
+    }
+
+    mapped_file* file = (mapped_file*)malloc(sizeof(mapped_file));
+    assert(file != NULL);
+
+    if (!mapped_file_map(file, filename))
+    {
+        free(file);
+        return NULL;
+    }
+
+    size_t length = strlen(filename);
+    file->filename = (char*)malloc(length + 1);
+    memcpy(file->filename, filename, length + 1);
+    file->refs = 1;
+    file->next = mapped_files;
+    mapped_files = file;
+    return file;
+}
+
+void mapped_file_close(mapped_file* file)
+{
+    if (file == NULL) { return; }
+
+    std::lock_guard<std::mutex> lock(mapped_files_mutex);
+
+    if (--file->refs > 0) { return; }
+
+    for (mapped_file** curr = &mapped_files; *curr != NULL; curr = &(*curr)->next)
+    {
+        if (*curr == file)
+        {
+            *curr = file->next;
+            break;
+        }
+    }
+
+    mapped_file_unmap(file);
+    free(file->filename);
+    free(file);
+}
+
+void mapped_file_prefetch(const void* data, size_t bytes)
+{
+    if (bytes == 0) { return; }
+
+#if MM_WINDOWS
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = (PVOID)data;
+    range.NumberOfBytes = bytes;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // The range must start on a page boundary
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)data & ~(page - 1);
+    madvise((void*)start, (uintptr_t)data + bytes - start, MADV_WILLNEED);
+#endif
+}
+
+bool file_has_bytes(FILE* f, const size_t bytes)
+{
+#if MM_WINDOWS
+    __int64 curr = _ftelli64(f);
+    if (curr < 0 || _fseeki64(f, 0, SEEK_END) != 0) { return true; }
+    __int64 end = _ftelli64(f);
+    _fseeki64(f, curr, SEEK_SET);
+#else
+    off_t curr = ftello(f);
+    if (curr < 0 || fseeko(f, 0, SEEK_END) != 0) { return true; }
+    off_t end = ftello(f);
+    fseeko(f, curr, SEEK_SET);
+#endif
+
+    return end < curr || (unsigned long long)(end - curr) >= bytes;
 }
@@ -2,20 +2,12 @@
 
 #pragma once
 
-#include "CoreMinimal.h"
+#include "MMAlloc.h"
+#include "MMCommon.h"
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
-
-/**
- * 
- */ 
-class LEARNEDMM_API MMArray
-{
-public:
-	MMArray();
-	~MMArray();
-};
+#include <limits.h>
 
 //--------------------------------------
 
@@ -33,6 +25,7 @@ struct slice1d
     int size;
     T* __restrict data;
 
+    slice1d() : size(0), data(NULL) {}
     slice1d(int _size, T* _data) : size(_size), data(_data) {}
 
     void zero() { memset((char*)data, 0, sizeof(T) * size); }
@@ -48,6 +41,7 @@ struct slice2d
     int rows, cols;
     T* __restrict data;
 
+    slice2d() : rows(0), cols(0), data(NULL) {}
     slice2d(int _rows, int _cols, T* _data) : rows(_rows), cols(_cols), data(_data) {}
 
     void zero() { memset((char*)data, 0, sizeof(T) * rows * cols); }
@@ -61,21 +55,39 @@ struct slice2d
 
 // These types are used for the storage of arrays of data.
 // They implicitly cast to slices so can be given directly 
-// as inputs to functions requiring them.
-template<typename T>
+// as inputs to functions requiring them. Memory comes from
+// the allocator policy `A` (see MMAlloc.h), by default 64
+// byte aligned heap memory.
+template<typename T, typename A = aligned_allocator>
 struct array1d
 {
     int size;
+    int capacity;
     T* data;
 
-    array1d() : size(0), data(NULL) {}
+    array1d() : size(0), capacity(0), data(NULL) {}
     array1d(int _size) : array1d() { resize(_size); }
-    array1d(const slice1d<T>& rhs) : array1d() { resize(rhs.size); memcpy(data, rhs.data, rhs.size * sizeof(T)); }
-    array1d(const array1d<T>& rhs) : array1d() { resize(rhs.size); memcpy(data, rhs.data, rhs.size * sizeof(T)); }
-    ~array1d() { resize(0); }
-
-    array1d& operator=(const slice1d<T>& rhs) { resize(rhs.size); memcpy(data, rhs.data, rhs.size * sizeof(T)); return *this; };
-    array1d& operator=(const array1d<T>& rhs) { resize(rhs.size); memcpy(data, rhs.data, rhs.size * sizeof(T)); return *this; };
+    array1d(const slice1d<T>& rhs) : array1d() { resize(rhs.size); if (rhs.size > 0) { memcpy(data, rhs.data, rhs.size * sizeof(T)); } }
+    array1d(const array1d<T, A>& rhs) : array1d() { resize(rhs.size); if (rhs.size > 0) { memcpy(data, rhs.data, rhs.size * sizeof(T)); } }
+    array1d(array1d<T, A>&& rhs) : size(rhs.size), capacity(rhs.capacity), data(rhs.data) { rhs.size = 0; rhs.capacity = 0; rhs.data = NULL; }
+    ~array1d() { release(); }
+
+    array1d& operator=(const slice1d<T>& rhs) { resize(rhs.size); if (rhs.size > 0) { memmove(data, rhs.data, rhs.size * sizeof(T)); } return *this; };
+    array1d& operator=(const array1d<T, A>& rhs) { if (this != &rhs) { resize(rhs.size); if (rhs.size > 0) { memcpy(data, rhs.data, rhs.size * sizeof(T)); } } return *this; };
+    array1d& operator=(array1d<T, A>&& rhs)
+    {
+        if (this != &rhs)
+        {
+            release();
+            size = rhs.size;
+            capacity = rhs.capacity;
+            data = rhs.data;
+            rhs.size = 0;
+            rhs.capacity = 0;
+            rhs.data = NULL;
+        }
+        return *this;
+    }
 
     inline T& operator()(int i) const { assert(i >= 0 && i < size); return data[i]; }
     operator slice1d<T>() const { return slice1d<T>(size, data); }
@@ -83,60 +95,109 @@ struct array1d
     void zero() { memset(data, 0, sizeof(T) * size); }
     void set(const T& x) { for (int i = 0; i < size; i++) { data[i] = x; } }
 
-    void resize(int _size)
+    // Makes sure at least `_capacity` elements fit without 
+    // another allocation. Returns false if out of memory.
+    bool reserve(int _capacity)
     {
-        if (_size == 0 && size != 0)
-        {
-            free(data);
-            data = NULL;
-            size = 0;
-        }
-        else if (_size > 0 && size == 0)
+        if (_capacity <= capacity) { return true; }
+
+        T* _data = (T*)(capacity == 0 ?
+            A::allocate(_capacity * sizeof(T)) :
+            A::reallocate(data, capacity * sizeof(T), _capacity * sizeof(T)));
+
+        // Out of memory the array is left as it was
+        if (_data == NULL) { return false; }
+
+        data = _data;
+        capacity = _capacity;
+        return true;
+    }
+
+    // Shrinking keeps the memory around so resizing back up
+    // again is free. Growing past the capacity grows it by at
+    // least half again so repeated resizes are amortized.
+    bool resize(int _size)
+    {
+        if (_size > capacity && !reserve(capacity == 0 ? _size : maxi(_size, capacity + capacity / 2)))
         {
-            data = (T*)malloc(_size * sizeof(T));
-            size = _size;
-            assert(data != NULL);
+            return false;
         }
-        else if (_size > 0 && size > 0 && _size != size)
+
+        size = _size;
+        return true;
+    }
+
+    // Frees the memory, including any spare capacity
+    void release()
+    {
+        if (data != NULL)
         {
-            data = (T*)realloc(data, _size * sizeof(T));
-            size = _size;
-            assert(data != NULL);
+            A::deallocate(data, capacity * sizeof(T));
         }
+
+        size = 0;
+        capacity = 0;
+        data = NULL;
     }
 };
 
-template<typename T>
-void array1d_write(const array1d<T>& arr, FILE* f)
+// Whether at least `bytes` are left to read in `f`, checked before
+// allocating for a size read from a file so that a corrupt size 
+// fails instead of asking for gigabytes. Files which cannot seek
+// are not checked.
+bool file_has_bytes(FILE* f, const size_t bytes);
+
+// Returns false if the write failed, e.g. on a full disk
+template<typename T, typename A>
+bool array1d_write(const array1d<T, A>& arr, FILE* f)
 {
-    fwrite(&arr.size, sizeof(int), 1, f);
-    size_t num = fwrite(arr.data, sizeof(T), arr.size, f);
-    assert((int)num == arr.size);
+    return fwrite(&arr.size, sizeof(int), 1, f) == 1 &&
+        fwrite(arr.data, sizeof(T), arr.size, f) == (size_t)arr.size;
 }
 
-template<typename T>
-void array1d_read(array1d<T>& arr, FILE* f)
+template<typename T, typename A>
+bool array1d_read(array1d<T, A>& arr, FILE* f)
 {
     int size;
-    fread(&size, sizeof(int), 1, f);
-    arr.resize(size);
+    if (fread(&size, sizeof(int), 1, f) != 1 || size < 0) { return false; }
+    if (!file_has_bytes(f, (size_t)size * sizeof(T)) || !arr.resize(size)) { return false; }
     size_t num = fread(arr.data, sizeof(T), size, f);
-    assert((int)num == size);
+    return (int)num == size;
 }
 
 // Similar type but for 2d data
-template<typename T>
+template<typename T, typename A = aligned_allocator>
 struct array2d
 {
     int rows, cols;
+    int capacity;
     T* data;
 
-    array2d() : rows(0), cols(0), data(NULL) {}
+    array2d() : rows(0), cols(0), capacity(0), data(NULL) {}
     array2d(int _rows, int _cols) : array2d() { resize(_rows, _cols); }
-    ~array2d() { resize(0, 0); }
-
-    array2d& operator=(const array2d<T>& rhs) { resize(rhs.rows, rhs.cols); memcpy(data, rhs.data, rhs.rows * rhs.cols * sizeof(T)); return *this; };
-    array2d& operator=(const slice2d<T>& rhs) { resize(rhs.rows, rhs.cols); memcpy(data, rhs.data, rhs.rows * rhs.cols * sizeof(T)); return *this; };
+    array2d(const slice2d<T>& rhs) : array2d() { resize(rhs.rows, rhs.cols); if (rhs.rows * rhs.cols > 0) { memcpy(data, rhs.data, rhs.rows * rhs.cols * sizeof(T)); } }
+    array2d(const array2d<T, A>& rhs) : array2d() { resize(rhs.rows, rhs.cols); if (rhs.rows * rhs.cols > 0) { memcpy(data, rhs.data, rhs.rows * rhs.cols * sizeof(T)); } }
+    array2d(array2d<T, A>&& rhs) : rows(rhs.rows), cols(rhs.cols), capacity(rhs.capacity), data(rhs.data) { rhs.rows = 0; rhs.cols = 0; rhs.capacity = 0; rhs.data = NULL; }
+    ~array2d() { release(); }
+
+    array2d& operator=(const array2d<T, A>& rhs) { if (this != &rhs) { resize(rhs.rows, rhs.cols); if (rhs.rows * rhs.cols > 0) { memcpy(data, rhs.data, rhs.rows * rhs.cols * sizeof(T)); } } return *this; };
+    array2d& operator=(const slice2d<T>& rhs) { resize(rhs.rows, rhs.cols); if (rhs.rows * rhs.cols > 0) { memmove(data, rhs.data, rhs.rows * rhs.cols * sizeof(T)); } return *this; };
+    array2d& operator=(array2d<T, A>&& rhs)
+    {
+        if (this != &rhs)
+        {
+            release();
+            rows = rhs.rows;
+            cols = rhs.cols;
+            capacity = rhs.capacity;
+            data = rhs.data;
+            rhs.rows = 0;
+            rhs.cols = 0;
+            rhs.capacity = 0;
+            rhs.data = NULL;
+        }
+        return *this;
+    }
 
     inline slice1d<T> operator()(int i) const { assert(i >= 0 && i < rows); return slice1d<T>(cols, &data[i * cols]); }
     inline T& operator()(int i, int j) const { assert(i >= 0 && i < rows && j >= 0 && j < cols); return data[i * cols + j]; }
@@ -145,51 +206,135 @@ struct array2d
     void zero() { memset(data, 0, sizeof(T) * rows * cols); }
     void set(const T& x) { for (int i = 0; i < rows * cols; i++) { data[i] = x; } }
 
-    void resize(int _rows, int _cols)
+    bool reserve(int _capacity)
+    {
+        if (_capacity <= capacity) { return true; }
+
+        T* _data = (T*)(capacity == 0 ?
+            A::allocate(_capacity * sizeof(T)) :
+            A::reallocate(data, capacity * sizeof(T), _capacity * sizeof(T)));
+
+        // Out of memory the array is left as it was
+        if (_data == NULL) { return false; }
+
+        data = _data;
+        capacity = _capacity;
+        return true;
+    }
+
+    // Same growth rules as `array1d::resize`. Note that the
+    // data is not re-laid out when the number of columns changes.
+    bool resize(int _rows, int _cols)
     {
         int _size = _rows * _cols;
-        int size = rows * cols;
 
-        if (_size == 0 && size != 0)
-        {
-            free(data);
-            data = NULL;
-            rows = 0;
-            cols = 0;
-        }
-        else if (_size > 0 && size == 0)
+        if (_size > capacity && !reserve(capacity == 0 ? _size : maxi(_size, capacity + capacity / 2)))
         {
-            data = (T*)malloc(_size * sizeof(T));
-            rows = _rows;
-            cols = _cols;
-            assert(data != NULL);
+            return false;
         }
-        else if (_size > 0 && size > 0 && _size != size)
+
+        rows = _size == 0 ? 0 : _rows;
+        cols = _size == 0 ? 0 : _cols;
+        return true;
+    }
+
+    void release()
+    {
+        if (data != NULL)
         {
-            data = (T*)realloc(data, _size * sizeof(T));
-            rows = _rows;
-            cols = _cols;
-            assert(data != NULL);
+            A::deallocate(data, capacity * sizeof(T));
         }
+
+        rows = 0;
+        cols = 0;
+        capacity = 0;
+        data = NULL;
     }
 };
 
+template<typename T, typename A>
+bool array2d_write(const array2d<T, A>& arr, FILE* f)
+{
+    return fwrite(&arr.rows, sizeof(int), 1, f) == 1 &&
+        fwrite(&arr.cols, sizeof(int), 1, f) == 1 &&
+        fwrite(arr.data, sizeof(T), arr.rows * arr.cols, f) == (size_t)(arr.rows * arr.cols);
+}
+
+template<typename T, typename A>
+bool array2d_read(array2d<T, A>& arr, FILE* f)
+{
+    int rows, cols;
+    if (fread(&rows, sizeof(int), 1, f) != 1 || rows < 0) { return false; }
+    if (fread(&cols, sizeof(int), 1, f) != 1 || cols < 0) { return false; }
+    if (cols > 0 && rows > INT_MAX / cols) { return false; }
+    if (!file_has_bytes(f, (size_t)rows * cols * sizeof(T)) || !arr.resize(rows, cols)) { return false; }
+    size_t num = fread(arr.data, sizeof(T), rows * cols, f);
+    return (int)num == rows * cols;
+}
+
+//--------------------------------------
+
+// Read-only view of a file mapped into memory. Mappings
+// are reference counted and shared by filename, so many
+// characters opening the same database all point at the
+// same physical pages and nothing is read from disk until
+// it is first touched.
+struct mapped_file
+{
+    const char* data;
+    size_t size;
+    char* filename;
+    int refs;
+    void* handle;
+    mapped_file* next;
+};
+
+// Returns NULL if the file does not exist or cannot be mapped.
+mapped_file* mapped_file_open(const char* filename);
+void mapped_file_close(mapped_file* file);
+
+// Asks the operating system to start reading part of a mapping
+// in the background. Returns at once.
+void mapped_file_prefetch(const void* data, size_t bytes);
+
+// Map a 1d array stored in the same `[int size][T data]` 
+// layout written by `array1d_write` without copying it. 
+// `offset` is advanced past the array. Returns false if 
+// the file is truncated or the data is not aligned for `T`. 
+// The resulting slice points into read-only memory and 
+// must not be written to or outlive the mapping.
 template<typename T>
-void array2d_write(const array2d<T>& arr, FILE* f)
+bool array1d_map(slice1d<T>& arr, const mapped_file* file, size_t& offset)
 {
-    fwrite(&arr.rows, sizeof(int), 1, f);
-    fwrite(&arr.cols, sizeof(int), 1, f);
-    size_t num = fwrite(arr.data, sizeof(T), arr.rows * arr.cols, f);
-    assert((int)num == arr.rows * arr.cols);
+    int size;
+    if (offset + sizeof(int) > file->size) { return false; }
+    memcpy(&size, file->data + offset, sizeof(int));
+    offset += sizeof(int);
+
+    if (size < 0 || (file->size - offset) / sizeof(T) < (size_t)size) { return false; }
+    if ((uintptr_t)(file->data + offset) % alignof(T) != 0) { return false; }
+
+    arr = slice1d<T>(size, (T*)(file->data + offset));
+    offset += size * sizeof(T);
+    return true;
 }
 
+// Same but for the `[int rows][int cols][T data]` layout 
+// written by `array2d_write`.
 template<typename T>
-void array2d_read(array2d<T>& arr, FILE* f)
+bool array2d_map(slice2d<T>& arr, const mapped_file* file, size_t& offset)
 {
     int rows, cols;
-    fread(&rows, sizeof(int), 1, f);
-    fread(&cols, sizeof(int), 1, f);
-    arr.resize(rows, cols);
-    size_t num = fread(arr.data, sizeof(T), rows * cols, f);
-    assert((int)num == rows * cols);
+    if (offset + 2 * sizeof(int) > file->size) { return false; }
+    memcpy(&rows, file->data + offset, sizeof(int));
+    memcpy(&cols, file->data + offset + sizeof(int), sizeof(int));
+    offset += 2 * sizeof(int);
+
+    if (rows < 0 || cols < 0) { return false; }
+    if ((file->size - offset) / sizeof(T) < (size_t)rows * cols) { return false; }
+    if ((uintptr_t)(file->data + offset) % alignof(T) != 0) { return false; }
+
+    arr = slice2d<T>(rows, cols, (T*)(file->data + offset));
+    offset += (size_t)rows * cols * sizeof(T);
+    return true;
 }
@@ -0,0 +1,1469 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMBench.h"
+#include "MMArray.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+#include "MMSoa.h"
+#include "MMSpring.h"
+#include "MMTrajectory.h"
+#include "MMKinematics.h"
+#include "MMDatabase.h"
+#include "MMSearch.h"
+#include "MMNNet.h"
+#include "MMInference.h"
+#include "MMWorkers.h"
+
+#include <random>
+#include <utility>
+
+//--------------------------------------
+
+void bench_write(FILE* f, const bench_result& result)
+{
+    fprintf(f, "{\"name\": \"%s\", \"iterations\": %d, \"ns_per_op\": %.3f, \"allocs_per_op\": %.3f}\n",
+        result.name, result.iterations, result.ns_per_op, result.allocs_per_op);
+    fflush(f);
+}
+
+void bench_write_value(FILE* f, const char* name, const char* key, const double value)
+{
+    fprintf(f, "{\"name\": \"%s\", \"%s\": %.6f}\n", name, key, value);
+    fflush(f);
+}
+
+static bool bench_match(const char* name, const char* filter)
+{
+    return filter == NULL || filter[0] == '\0' || strstr(name, filter) != NULL;
+}
+
+// Whether any case whose name starts with `prefix` could match, 
+// used to skip building data for groups of cases
+static bool bench_match_prefix(const char* prefix, const char* filter)
+{
+    return bench_match(prefix, filter) || strstr(filter, prefix) != NULL;
+}
+
+//--------------------------------------
+
+// Stand in for a pipeline stage returning scratch data by value
+static array1d<float, frame_allocator> bench_make_query(const slice1d<vec3> trajectory)
+{
+    array1d<float, frame_allocator> query(trajectory.size * 2);
+    for (int i = 0; i < trajectory.size; i++)
+    {
+        query(i * 2 + 0) = trajectory(i).x;
+        query(i * 2 + 1) = trajectory(i).z;
+    }
+    return query;
+}
+
+static void bench_arrays(FILE* f, const char* filter)
+{
+    const int iterations = 100000;
+
+    array1d<vec3> source(64);
+    source.set(vec3(1.0f, 2.0f, 3.0f));
+
+    if (bench_match("array1d_copy", filter))
+    {
+        bench_write(f, bench_run("array1d_copy", iterations, [&]()
+        {
+            array1d<vec3> copy = source;
+            source(0) = copy(1);
+        }));
+    }
+
+    if (bench_match("array1d_move", filter))
+    {
+        array1d<vec3> curr = source, prev = source;
+        bench_write(f, bench_run("array1d_move", iterations, [&]()
+        {
+            array1d<vec3> temp = std::move(prev);
+            prev = std::move(curr);
+            curr = std::move(temp);
+        }));
+    }
+
+    if (bench_match("array1d_resize", filter))
+    {
+        array1d<vec3> arr;
+        int count = 0;
+        bench_write(f, bench_run("array1d_resize", iterations, [&]()
+        {
+            arr.resize(1 + (count++ % 64));
+        }));
+    }
+
+    // Small scratch arrays created, grown and destroyed every call, 
+    // from the heap and from a pool which should never reach it
+    if (bench_match("array1d_churn_heap", filter))
+    {
+        int count = 0;
+        bench_write(f, bench_run("array1d_churn_heap", iterations, [&]()
+        {
+            array1d<float> arr(1 + (count % 32));
+            arr.resize(1 + (count++ % 64));
+            arr(0) = 1.0f;
+        }));
+    }
+
+    if (bench_match("array1d_churn_pool", filter))
+    {
+        int count = 0;
+        bench_write(f, bench_run("array1d_churn_pool", iterations, [&]()
+        {
+            array1d<float, pool_allocator<256, 16>> arr(1 + (count % 32));
+            arr.resize(1 + (count++ % 64));
+            arr(0) = 1.0f;
+        }));
+    }
+
+    // Trajectory arrays are double buffered by moving them between 
+    // frames and the query is built in the frame arena, so a frame
+    // of this should never reach the heap.
+    if (bench_match("array_pipeline", filter))
+    {
+        array1d<vec3> trajectory_curr(4), trajectory_prev(4);
+        trajectory_curr.set(vec3(1.0f, 0.0f, 1.0f));
+        trajectory_prev.set(vec3());
+        float total = 0.0f;
+
+        bench_write(f, bench_run("array_pipeline", iterations, [&]()
+        {
+            frame_arena_scope scratch;
+
+            std::swap(trajectory_curr, trajectory_prev);
+            trajectory_curr.resize(4);
+
+            array1d<float, frame_allocator> query = bench_make_query(trajectory_curr);
+            total += query(0);
+        }));
+    }
+}
+
+// Writing and reading back a feature sized table, the way
+// databases and networks are loaded
+static void bench_array_io(FILE* f, const char* filter)
+{
+    const int iterations = 1000;
+
+    if (!bench_match("array2d_write_read_1000x27", filter)) { return; }
+
+    array2d<float> table(1000, 27), loaded;
+    for (int i = 0; i < table.rows * table.cols; i++) { table.data[i] = (float)i; }
+
+    FILE* tmp = tmpfile();
+    if (tmp == NULL) { return; }
+
+    bench_write(f, bench_run("array2d_write_read_1000x27", iterations, [&]()
+    {
+        rewind(tmp);
+        array2d_write(table, tmp);
+        rewind(tmp);
+        array2d_read(loaded, tmp);
+    }));
+
+    fclose(tmp);
+}
+
+// Opening a table by reading it versus mapping it. Reading grows 
+// with the size of the table while mapping should not. The file 
+// is closed every time so each map is a fresh mapping.
+static void bench_array_map(FILE* f, const char* filter)
+{
+    const char* filename = "mmbench_array_map.bin";
+    const int sizes[] = { 1000, 100000 };
+
+    for (int s = 0; s < 2; s++)
+    {
+        char name_read[64], name_map[64];
+        snprintf(name_read, sizeof(name_read), "array2d_read_%dx27", sizes[s]);
+        snprintf(name_map, sizeof(name_map), "array2d_map_%dx27", sizes[s]);
+
+        if (!bench_match(name_read, filter) && !bench_match(name_map, filter)) { continue; }
+
+        array2d<float> table(sizes[s], 27), loaded;
+        for (int i = 0; i < table.rows * table.cols; i++) { table.data[i] = (float)i; }
+
+        FILE* out = fopen(filename, "wb");
+        if (out == NULL) { return; }
+        array2d_write(table, out);
+        fclose(out);
+
+        int iterations = 100000000 / (sizes[s] * 27);
+        float total = 0.0f;
+
+        if (bench_match(name_read, filter))
+        {
+            bench_write(f, bench_run(name_read, iterations, [&]()
+            {
+                FILE* in = fopen(filename, "rb");
+                if (in == NULL) { return; }
+                array2d_read(loaded, in);
+                fclose(in);
+                total += loaded(0, 0);
+            }));
+        }
+
+        if (bench_match(name_map, filter))
+        {
+            bench_write(f, bench_run(name_map, iterations, [&]()
+            {
+                mapped_file* file = mapped_file_open(filename);
+                if (file == NULL) { return; }
+
+                size_t offset = 0;
+                slice2d<float> mapped;
+                if (array2d_map(mapped, file, offset)) { total += mapped(0, 0); }
+
+                mapped_file_close(file);
+            }));
+        }
+
+        remove(filename);
+    }
+}
+
+//--------------------------------------
+
+// Scalar quaternion operations over 1024 bones
+static void bench_quat(FILE* f, const char* filter)
+{
+    const int iterations = 10000;
+    const int nbones = 1024;
+
+    array1d<quat> q(nbones), p(nbones), r(nbones);
+    array1d<vec3> v(nbones), w(nbones);
+    for (int i = 0; i < nbones; i++)
+    {
+        q(i) = quat_from_angle_axis(0.01f * i, vec3(0.0f, 1.0f, 0.0f));
+        p(i) = quat_from_angle_axis(0.02f * i, normalize(vec3(1.0f, 1.0f, 0.0f)));
+        v(i) = vec3(1.0f, 0.5f * i, 0.0f);
+    }
+
+    if (bench_match("quat_mul_1024", filter))
+    {
+        bench_write(f, bench_run("quat_mul_1024", iterations, [&]()
+        {
+            for (int i = 0; i < nbones; i++) { r(i) = quat_mul(q(i), p(i)); }
+        }));
+    }
+
+    if (bench_match("quat_mul_vec3_1024", filter))
+    {
+        bench_write(f, bench_run("quat_mul_vec3_1024", iterations, [&]()
+        {
+            for (int i = 0; i < nbones; i++) { w(i) = quat_mul_vec3(q(i), v(i)); }
+        }));
+    }
+
+    if (bench_match("quat_scaled_angle_axis_1024", filter))
+    {
+        bench_write(f, bench_run("quat_scaled_angle_axis_1024", iterations, [&]()
+        {
+            for (int i = 0; i < nbones; i++)
+            {
+                r(i) = quat_from_scaled_angle_axis(quat_to_scaled_angle_axis(quat_abs(quat_mul_inv(q(i), p(i)))));
+            }
+        }));
+    }
+}
+
+//--------------------------------------
+
+// Dampers and springs over 128 characters with 64 values each
+static void bench_dampers(FILE* f, const char* filter)
+{
+    const int iterations = 1000;
+    const int count = 128 * 64;
+    const float halflife = 0.2f;
+    const float dt = 1.0f / 60.0f;
+
+    array1d<float> x(count), g(count);
+    array1d<vec3> xv(count), vv(count), gv(count);
+    array1d<quat> xq(count), gq(count);
+    array1d<vec3> vq(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        g(i) = (float)(i % 64);
+        gv(i) = vec3(1.0f, 0.0f, (float)(i % 64));
+        gq(i) = quat_from_angle_axis(0.01f * (i % 64), vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    // Restarting from rest each time keeps the values away from the goal
+    if (bench_match("damper_exact_8192", filter))
+    {
+        bench_write(f, bench_run("damper_exact_8192", iterations, [&]()
+        {
+            x.zero();
+            for (int i = 0; i < count; i++) { x(i) = damper_exact(x(i), g(i), halflife, dt); }
+        }));
+    }
+
+    if (bench_match("simple_spring_damper_exact_vec3_8192", filter))
+    {
+        bench_write(f, bench_run("simple_spring_damper_exact_vec3_8192", iterations, [&]()
+        {
+            xv.set(vec3()); vv.set(vec3());
+            for (int i = 0; i < count; i++) { simple_spring_damper_exact(xv(i), vv(i), gv(i), halflife, dt); }
+        }));
+    }
+
+    if (bench_match("simple_spring_damper_exact_quat_8192", filter))
+    {
+        bench_write(f, bench_run("simple_spring_damper_exact_quat_8192", iterations, [&]()
+        {
+            xq.set(quat()); vq.set(vec3());
+            for (int i = 0; i < count; i++) { simple_spring_damper_exact(xq(i), vq(i), gq(i), halflife, dt); }
+        }));
+    }
+}
+
+//--------------------------------------
+
+// Blending and rotating 1024 bones stored both ways
+static void bench_soa(FILE* f, const char* filter)
+{
+    const int iterations = 10000;
+    const int nbones = 1024;
+
+    array1d<quat> q(nbones), p(nbones);
+    array1d<vec3> v(nbones);
+    for (int i = 0; i < nbones; i++)
+    {
+        q(i) = quat_from_angle_axis(0.01f * i, vec3(0.0f, 1.0f, 0.0f));
+        p(i) = quat_from_angle_axis(0.02f * i, normalize(vec3(1.0f, 1.0f, 0.0f)));
+        v(i) = vec3(1.0f, 0.5f * i, 0.0f);
+    }
+
+    soa_quat_array sq(nbones), sp(nbones), sr(nbones);
+    soa_vec3_array sv(nbones), sw(nbones);
+    soa_from_aos(sq, q);
+    soa_from_aos(sp, p);
+    soa_from_aos(sv, v);
+
+    array1d<quat> r(nbones);
+    array1d<vec3> w(nbones);
+
+    if (bench_match("quat_blend_aos", filter))
+    {
+        bench_write(f, bench_run("quat_blend_aos", iterations, [&]()
+        {
+            for (int i = 0; i < nbones; i++)
+            {
+                r(i) = quat_slerp_shortest_approx(q(i), p(i), 0.25f);
+                w(i) = quat_mul_vec3(quat_mul(q(i), p(i)), v(i));
+            }
+        }));
+    }
+
+    if (bench_match("quat_blend_soa", filter))
+    {
+        bench_write(f, bench_run("quat_blend_soa", iterations, [&]()
+        {
+            quat_slerp_shortest_approx_batch(sr, sq, sp, 0.25f);
+            quat_mul_batch(sr, sq, sp);
+            quat_mul_vec3_batch(sw, sr, sv);
+        }));
+    }
+}
+
+//--------------------------------------
+
+// Inertialization offsets of 128 characters with 64 bones each
+static void bench_springs(FILE* f, const char* filter)
+{
+    const int iterations = 1000;
+    const int nbones = 128 * 64;
+    const float halflife = 0.1f;
+    const float dt = 1.0f / 60.0f;
+
+    array1d<vec3> in_x(nbones), in_v(nbones), out_x(nbones), out_v(nbones), off_x(nbones), off_v(nbones);
+    array1d<quat> in_r(nbones), out_r(nbones), off_r(nbones);
+    array1d<vec3> in_a(nbones), out_a(nbones), off_a(nbones);
+
+    in_x.set(vec3(0.0f, 1.0f, 0.0f));
+    in_v.set(vec3(0.5f, 0.0f, 0.0f));
+    in_r.set(quat_from_angle_axis(0.5f, vec3(0.0f, 1.0f, 0.0f)));
+    in_a.set(vec3(0.0f, 1.0f, 0.0f));
+
+    // Restarting the offsets each frame keeps the values away from zero
+    vec3 x0 = vec3(0.1f, 0.0f, 0.2f), v0 = vec3(1.0f, 0.0f, 0.0f);
+    quat r0 = quat_from_angle_axis(0.2f, vec3(1.0f, 0.0f, 0.0f));
+
+    if (bench_match("inertialize_update_scalar", filter))
+    {
+        bench_write(f, bench_run("inertialize_update_scalar", iterations, [&]()
+        {
+            off_x.set(x0); off_v.set(v0); off_r.set(r0); off_a.set(v0);
+
+            for (int i = 0; i < nbones; i++)
+            {
+                inertialize_update(out_x(i), out_v(i), off_x(i), off_v(i), in_x(i), in_v(i), halflife, dt);
+                inertialize_update(out_r(i), out_a(i), off_r(i), off_a(i), in_r(i), in_a(i), halflife, dt);
+            }
+        }));
+    }
+
+    if (bench_match("inertialize_update_batch", filter))
+    {
+        bench_write(f, bench_run("inertialize_update_batch", iterations, [&]()
+        {
+            off_x.set(x0); off_v.set(v0); off_r.set(r0); off_a.set(v0);
+
+            inertialize_update_batch(out_x, out_v, off_x, off_v, in_x, in_v, halflife, dt);
+            inertialize_update_batch(out_r, out_a, off_r, off_a, in_r, in_a, halflife, dt);
+        }));
+    }
+
+    if (bench_match("inertialize_update_positions_batch", filter))
+    {
+        bench_write(f, bench_run("inertialize_update_positions_batch", iterations, [&]()
+        {
+            off_x.set(x0); off_v.set(v0);
+            inertialize_update_batch(out_x, out_v, off_x, off_v, in_x, in_v, halflife, dt);
+        }));
+    }
+}
+
+//--------------------------------------
+
+// Future trajectory of one character the way the character
+// computes it, one sample and one spring at a time
+static void bench_trajectory_predict_scalar(
+    slice1d<vec3> positions,
+    slice1d<quat> rotations,
+    const vec3 position,
+    const vec3 velocity,
+    const vec3 acceleration,
+    const quat rotation,
+    const vec3 angular_velocity,
+    const slice1d<vec3> desired_velocities,
+    const slice1d<quat> desired_rotations,
+    const float halflife,
+    const float dt)
+{
+    float y = halflife_to_damping(halflife) / 2.0f;
+    float eydt = fast_negexpf(y * dt);
+
+    vec3 x = position, v = velocity, a = acceleration;
+    positions(0) = x;
+    rotations(0) = rotation;
+
+    for (int i = 1; i < positions.size; i++)
+    {
+        vec3 j0 = v - desired_velocities(i);
+        vec3 j1 = a + j0 * y;
+
+        x = eydt * (((-j1) / (y * y)) + ((-j0 - j1 * dt) / y)) +
+            (j1 / (y * y)) + j0 / y + desired_velocities(i) * dt + x;
+        v = eydt * (j0 + j1 * dt) + desired_velocities(i);
+        a = eydt * (a - j1 * y * dt);
+        positions(i) = x;
+
+        vec3 w = angular_velocity;
+        rotations(i) = rotation;
+        simple_spring_damper_exact(rotations(i), w, desired_rotations(i), halflife, i * dt);
+    }
+}
+
+// Predicting the trajectories and query features of 256
+// characters with 4 samples each
+static void bench_trajectory(FILE* f, const char* filter)
+{
+    const int iterations = 1000;
+    const int ncharacters = 256;
+    const int nsamples = 4;
+    const int nfeatures = 4 * (nsamples - 1);
+    const float halflife = 0.3f;
+    const float dt = 20.0f / 60.0f;
+
+    if (!bench_match_prefix("trajectory_predict", filter)) { return; }
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+    // Sample major, like the batch functions want them
+    array1d<vec3> position(ncharacters), velocity(ncharacters), acceleration(ncharacters);
+    array1d<float> yaw(ncharacters), yaw_velocity(ncharacters);
+    array1d<vec3> desired_velocities(nsamples * ncharacters);
+    array1d<float> desired_yaws(nsamples * ncharacters);
+
+    for (int c = 0; c < ncharacters; c++)
+    {
+        position(c) = vec3(100.0f * uniform(gen), 0.0f, 100.0f * uniform(gen));
+        velocity(c) = vec3(3.0f * uniform(gen), 0.0f, 3.0f * uniform(gen));
+        acceleration(c) = vec3(uniform(gen), 0.0f, uniform(gen));
+        yaw(c) = PIf * uniform(gen);
+        yaw_velocity(c) = uniform(gen);
+    }
+
+    for (int i = 0; i < nsamples * ncharacters; i++)
+    {
+        desired_velocities(i) = vec3(3.0f * uniform(gen), 0.0f, 3.0f * uniform(gen));
+        desired_yaws(i) = PIf * uniform(gen);
+    }
+
+    // Scalar reference, one character at a time
+    array1d<vec3> scalar_desired_velocities(nsamples);
+    array1d<quat> scalar_desired_rotations(nsamples);
+    array1d<vec3> scalar_positions(nsamples);
+    array1d<quat> scalar_rotations(nsamples);
+    array2d<float> scalar_queries(ncharacters, nfeatures);
+
+    auto run_scalar = [&]()
+    {
+        for (int c = 0; c < ncharacters; c++)
+        {
+            for (int s = 0; s < nsamples; s++)
+            {
+                scalar_desired_velocities(s) = desired_velocities(s * ncharacters + c);
+                scalar_desired_rotations(s) = quat_from_angle_axis(desired_yaws(s * ncharacters + c), vec3(0.0f, 1.0f, 0.0f));
+            }
+
+            quat rotation = quat_from_angle_axis(yaw(c), vec3(0.0f, 1.0f, 0.0f));
+
+            bench_trajectory_predict_scalar(
+                scalar_positions,
+                scalar_rotations,
+                position(c),
+                velocity(c),
+                acceleration(c),
+                rotation,
+                vec3(0.0f, yaw_velocity(c), 0.0f),
+                scalar_desired_velocities,
+                scalar_desired_rotations,
+                halflife,
+                dt);
+
+            for (int s = 1; s < nsamples; s++)
+            {
+                vec3 traj_position = quat_inv_mul_vec3(rotation, scalar_positions(s) - position(c));
+                vec3 traj_direction = quat_inv_mul_vec3(rotation, quat_mul_vec3(scalar_rotations(s), vec3(0.0f, 0.0f, 1.0f)));
+                scalar_queries(c, 2 * (s - 1) + 0) = traj_position.x;
+                scalar_queries(c, 2 * (s - 1) + 1) = traj_position.z;
+                scalar_queries(c, 2 * (nsamples - 1) + 2 * (s - 1) + 0) = traj_direction.x;
+                scalar_queries(c, 2 * (nsamples - 1) + 2 * (s - 1) + 1) = traj_direction.z;
+            }
+        }
+    };
+
+    // Batched, everything stored as structures of arrays
+    soa_vec3_array batch_position(ncharacters), batch_velocity(ncharacters), batch_acceleration(ncharacters);
+    soa_vec3_array batch_desired_velocities(nsamples * ncharacters);
+    soa_vec3_array positions(nsamples * ncharacters), velocities(nsamples * ncharacters), accelerations(nsamples * ncharacters);
+    array1d<float> yaws(nsamples * ncharacters), yaw_velocities(nsamples * ncharacters);
+    array1d<float> directions_x(nsamples * ncharacters), directions_z(nsamples * ncharacters);
+    array2d<float> batch_queries(ncharacters, nfeatures);
+
+    soa_from_aos(batch_position, position);
+    soa_from_aos(batch_velocity, velocity);
+    soa_from_aos(batch_acceleration, acceleration);
+    soa_from_aos(batch_desired_velocities, desired_velocities);
+
+    auto run_batch = [&]()
+    {
+        trajectory_positions_predict_batch(
+            positions, velocities, accelerations,
+            batch_position, batch_velocity, batch_acceleration,
+            batch_desired_velocities, halflife, dt);
+
+        trajectory_yaws_predict_batch(yaws, yaw_velocities, yaw, yaw_velocity, desired_yaws, halflife, dt);
+        trajectory_directions_batch(directions_x, directions_z, yaws);
+        trajectory_query_features_batch(batch_queries, 0, positions, directions_x, directions_z);
+    };
+
+    bench_result scalar_result = bench_run("trajectory_predict_scalar_256", iterations, run_scalar);
+    bench_result batch_result = bench_run("trajectory_predict_batch_256", iterations, run_batch);
+
+    if (bench_match("trajectory_predict_scalar_256", filter)) { bench_write(f, scalar_result); }
+    if (bench_match("trajectory_predict_batch_256", filter)) { bench_write(f, batch_result); }
+
+    if (bench_match("trajectory_predict_speedup_256", filter))
+    {
+        bench_write_value(f, "trajectory_predict_speedup_256", "speedup", scalar_result.ns_per_op / batch_result.ns_per_op);
+    }
+
+    if (bench_match("trajectory_predict_max_error_256", filter))
+    {
+        float error = 0.0f;
+        for (int c = 0; c < ncharacters; c++)
+        {
+            for (int j = 0; j < nfeatures; j++)
+            {
+                error = maxf(error, fabsf(scalar_queries(c, j) - batch_queries(c, j)));
+            }
+        }
+        bench_write_value(f, "trajectory_predict_max_error_256", "max_error", error);
+    }
+}
+
+//--------------------------------------
+
+// Parents of the bones of the database's skeleton
+static const int bench_bone_parents[] = {
+    -1, 0, 1, 2, 3, 4, 1, 6, 7, 8, 1, 10, 11, 12, 13, 12, 15, 16, 17, 12, 19, 20, 21 };
+
+static const int bench_nbones = sizeof(bench_bone_parents) / sizeof(bench_bone_parents[0]);
+
+// Global transform of one bone walking up the chain of parents,
+// the way it is usually written
+static void bench_forward_kinematics_chain(
+    vec3& bone_position,
+    quat& bone_rotation,
+    const slice1d<vec3> local_positions,
+    const slice1d<quat> local_rotations,
+    const int bone)
+{
+    int parent = bench_bone_parents[bone];
+
+    if (parent == -1)
+    {
+        bone_position = local_positions(bone);
+        bone_rotation = local_rotations(bone);
+        return;
+    }
+
+    vec3 parent_position;
+    quat parent_rotation;
+    bench_forward_kinematics_chain(parent_position, parent_rotation, local_positions, local_rotations, parent);
+
+    bone_position = quat_mul_vec3(parent_rotation, local_positions(bone)) + parent_position;
+    bone_rotation = quat_mul(parent_rotation, local_rotations(bone));
+}
+
+// Global transforms of 256 characters, walking the chains, in
+// depth order one character at a time, and batched over all of
+// them. The partial pass only computes the feet and hips.
+static void bench_kinematics(FILE* f, const char* filter)
+{
+    const int iterations = 1000;
+    const int ncharacters = 256;
+    const int nbones = bench_nbones;
+    const int size = nbones * ncharacters;
+
+    if (!bench_match_prefix("forward_kinematics", filter)) { return; }
+
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+    // Character major for the scalar versions
+    array1d<vec3> local_positions(size), global_positions(size);
+    array1d<quat> local_rotations(size), global_rotations(size);
+
+    for (int i = 0; i < size; i++)
+    {
+        local_positions(i) = vec3(uniform(gen), uniform(gen), uniform(gen));
+        local_rotations(i) = quat_from_scaled_angle_axis(vec3(uniform(gen), uniform(gen), uniform(gen)));
+    }
+
+    kinematics_order k, k_partial;
+    kinematics_order_build(k, slice1d<int>(nbones, (int*)bench_bone_parents));
+
+    const int feet[] = { 1, 4, 5, 8, 9 };
+    kinematics_order_build_partial(k_partial, slice1d<int>(nbones, (int*)bench_bone_parents), slice1d<int>(5, (int*)feet));
+
+    // Bone major for the batched ones
+    soa_vec3_array batch_local_positions(size), batch_global_positions(size);
+    soa_quat_array batch_local_rotations(size), batch_global_rotations(size);
+
+    for (int c = 0; c < ncharacters; c++)
+    {
+        for (int b = 0; b < nbones; b++)
+        {
+            ((soa_vec3_slice)batch_local_positions).set(b * ncharacters + c, local_positions(c * nbones + b));
+            ((soa_quat_slice)batch_local_rotations).set(b * ncharacters + c, local_rotations(c * nbones + b));
+        }
+    }
+
+    auto character_positions = [&](array1d<vec3>& a, const int c) { return slice1d<vec3>(nbones, a.data + c * nbones); };
+    auto character_rotations = [&](array1d<quat>& a, const int c) { return slice1d<quat>(nbones, a.data + c * nbones); };
+
+    if (bench_match("forward_kinematics_chain_256", filter))
+    {
+        bench_write(f, bench_run("forward_kinematics_chain_256", iterations, [&]()
+        {
+            for (int c = 0; c < ncharacters; c++)
+            {
+                for (int b = 0; b < nbones; b++)
+                {
+                    bench_forward_kinematics_chain(
+                        global_positions(c * nbones + b),
+                        global_rotations(c * nbones + b),
+                        character_positions(local_positions, c),
+                        character_rotations(local_rotations, c),
+                        b);
+                }
+            }
+        }));
+    }
+
+    bench_result scalar_result = bench_run("forward_kinematics_scalar_256", iterations, [&]()
+    {
+        for (int c = 0; c < ncharacters; c++)
+        {
+            forward_kinematics(
+                character_positions(global_positions, c),
+                character_rotations(global_rotations, c),
+                character_positions(local_positions, c),
+                character_rotations(local_rotations, c),
+                k);
+        }
+    });
+
+    bench_result batch_result = bench_run("forward_kinematics_batch_256", iterations, [&]()
+    {
+        forward_kinematics_batch(
+            batch_global_positions,
+            batch_global_rotations,
+            batch_local_positions,
+            batch_local_rotations,
+            k, ncharacters);
+    });
+
+    if (bench_match("forward_kinematics_scalar_256", filter)) { bench_write(f, scalar_result); }
+    if (bench_match("forward_kinematics_batch_256", filter)) { bench_write(f, batch_result); }
+
+    if (bench_match("forward_kinematics_speedup_256", filter))
+    {
+        bench_write_value(f, "forward_kinematics_speedup_256", "speedup", scalar_result.ns_per_op / batch_result.ns_per_op);
+    }
+
+    if (bench_match("forward_kinematics_max_error_256", filter))
+    {
+        float error = 0.0f;
+        for (int c = 0; c < ncharacters; c++)
+        {
+            for (int b = 0; b < nbones; b++)
+            {
+                vec3 position = ((soa_vec3_slice)batch_global_positions)(b * ncharacters + c);
+                error = maxf(error, length(position - global_positions(c * nbones + b)));
+            }
+        }
+        bench_write_value(f, "forward_kinematics_max_error_256", "max_error", error);
+    }
+
+    if (bench_match("forward_kinematics_partial_batch_256", filter))
+    {
+        bench_write(f, bench_run("forward_kinematics_partial_batch_256", iterations, [&]()
+        {
+            forward_kinematics_batch(
+                batch_global_positions,
+                batch_global_rotations,
+                batch_local_positions,
+                batch_local_rotations,
+                k_partial, ncharacters);
+        }));
+    }
+}
+
+//--------------------------------------
+
+// Synthetic database where each feature is a random walk, so
+// neighbouring frames are similar like in real animation data.
+// Ranges are 1000 frames long. The database only points at 
+// tables, so they are kept alongside it.
+struct bench_database
+{
+    database db;
+    array2d<float> features;
+    array1d<float> features_offset;
+    array1d<float> features_scale;
+    array1d<int> range_starts;
+    array1d<int> range_stops;
+};
+
+static void bench_make_database(bench_database& b, const int nframes, const int nfeatures, const unsigned int seed)
+{
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    b.features.resize(nframes, nfeatures);
+    b.features_offset.resize(nfeatures);
+    b.features_scale.resize(nfeatures);
+    b.features_offset.zero();
+    b.features_scale.set(1.0f);
+
+    int nranges = (nframes + 999) / 1000;
+    b.range_starts.resize(nranges);
+    b.range_stops.resize(nranges);
+    for (int r = 0; r < nranges; r++)
+    {
+        b.range_starts(r) = r * 1000;
+        b.range_stops(r) = mini((r + 1) * 1000, nframes);
+    }
+
+    for (int j = 0; j < nfeatures; j++)
+    {
+        float x = 0.0f;
+        for (int i = 0; i < nframes; i++)
+        {
+            x = (i % 1000 == 0) ? normal(gen) : x + 0.05f * normal(gen);
+            b.features(i, j) = x;
+        }
+    }
+
+    b.db.features = b.features;
+    b.db.features_offset = b.features_offset;
+    b.db.features_scale = b.features_scale;
+    b.db.range_starts = b.range_starts;
+    b.db.range_stops = b.range_stops;
+
+    database_build_bounds(b.db);
+}
+
+// Queries are frames of the database with some noise added
+static void bench_make_queries(array2d<float>& queries, const database& db, const unsigned int seed)
+{
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    for (int q = 0; q < queries.rows; q++)
+    {
+        int i = (int)(gen() % db.nframes());
+        for (int j = 0; j < queries.cols; j++)
+        {
+            queries(q, j) = db.features(i, j) + 0.25f * normal(gen);
+        }
+    }
+}
+
+static void bench_search(FILE* f, const char* filter)
+{
+    const int nfeatures = 27;
+    const int sizes[] = { 10000, 100000, 1000000 };
+
+    if (!bench_match_prefix("database_search", filter)) { return; }
+
+    for (int s = 0; s < 3; s++)
+    {
+        bench_database bench_db;
+        bench_make_database(bench_db, sizes[s], nfeatures, 1234);
+        database& db = bench_db.db;
+
+        array2d<float> queries(64, nfeatures);
+        bench_make_queries(queries, db, 5678);
+
+        char name_brute[64], name_bounds[64], name_single[64], name_batch[64];
+        snprintf(name_brute, sizeof(name_brute), "database_search_brute_force_%d", sizes[s]);
+        snprintf(name_bounds, sizeof(name_bounds), "database_search_bounds_%d", sizes[s]);
+        snprintf(name_single, sizeof(name_single), "database_search_single_x8_%d", sizes[s]);
+        snprintf(name_batch, sizeof(name_batch), "database_search_batch_x8_%d", sizes[s]);
+
+        int iterations = 10000000 / sizes[s];
+        int q = 0;
+
+        if (bench_match(name_brute, filter))
+        {
+            bench_write(f, bench_run(name_brute, iterations, [&]()
+            {
+                int best_index = -1;
+                float best_cost = FLT_MAX;
+                database_search(best_index, best_cost, db, queries(q++ % queries.rows), 0.0f, 20, 20, -1, false);
+            }));
+        }
+
+        if (bench_match(name_bounds, filter))
+        {
+            bench_write(f, bench_run(name_bounds, iterations, [&]()
+            {
+                int best_index = -1;
+                float best_cost = FLT_MAX;
+                database_search(best_index, best_cost, db, queries(q++ % queries.rows));
+            }));
+        }
+
+        // Eight characters searching one after another versus together
+        if (bench_match(name_single, filter))
+        {
+            bench_write(f, bench_run(name_single, iterations / 8, [&]()
+            {
+                for (int k = 0; k < 8; k++)
+                {
+                    int best_index = -1;
+                    float best_cost = FLT_MAX;
+                    database_search(best_index, best_cost, db, queries((q + k) % queries.rows));
+                }
+                q += 8;
+            }));
+        }
+
+        if (bench_match(name_batch, filter))
+        {
+            bench_write(f, bench_run(name_batch, iterations / 8, [&]()
+            {
+                int best_indices[8];
+                float best_costs[8];
+                for (int k = 0; k < 8; k++) { best_indices[k] = -1; best_costs[k] = FLT_MAX; }
+                database_search_batch(
+                    slice1d<int>(8, best_indices), 
+                    slice1d<float>(8, best_costs), 
+                    db, 
+                    slice2d<float>(8, queries.cols, &queries.data[((q / 8) % (queries.rows / 8)) * 8 * queries.cols]));
+                q += 8;
+            }));
+        }
+    }
+}
+
+// Search skipping frames with the quantized features against 
+// the exact brute force search, timed and with how often both 
+// find the same frame. Compare with `database_search_bounds`.
+static void bench_quantized(FILE* f, const char* filter)
+{
+    const int nfeatures = 27;
+    const int sizes[] = { 100000, 1000000 };
+    const int formats[] = { QUANTIZED_INT8, QUANTIZED_FP16 };
+    const char* format_names[] = { "int8", "fp16" };
+
+    if (!bench_match_prefix("database_search_quantized", filter)) { return; }
+
+    for (int s = 0; s < 2; s++)
+    {
+        bench_database bench_db;
+        bench_make_database(bench_db, sizes[s], nfeatures, 1234);
+        database& db = bench_db.db;
+
+        array2d<float> queries(256, nfeatures);
+        bench_make_queries(queries, db, 5678);
+
+        array1d<int> exact(queries.rows);
+        for (int q = 0; q < queries.rows; q++)
+        {
+            float best_cost = FLT_MAX;
+            exact(q) = -1;
+            database_search(exact(q), best_cost, db, queries(q), 0.0f, 20, 20, -1, false);
+        }
+
+        for (int m = 0; m < 2; m++)
+        {
+            database_build_quantized(db, formats[m]);
+
+            char name[64], name_agreement[64];
+            snprintf(name, sizeof(name), "database_search_quantized_%s_%d", format_names[m], sizes[s]);
+            snprintf(name_agreement, sizeof(name_agreement), "database_search_quantized_%s_agreement_%d", format_names[m], sizes[s]);
+
+            int q = 0;
+
+            if (bench_match(name, filter))
+            {
+                bench_write(f, bench_run(name, 10000000 / sizes[s], [&]()
+                {
+                    int best_index = -1;
+                    float best_cost = FLT_MAX;
+                    database_search_quantized(best_index, best_cost, db, queries(q++ % queries.rows));
+                }));
+            }
+
+            if (bench_match(name_agreement, filter))
+            {
+                int agree = 0;
+                for (int k = 0; k < queries.rows; k++)
+                {
+                    int best_index = -1;
+                    float best_cost = FLT_MAX;
+                    database_search_quantized(best_index, best_cost, db, queries(k));
+                    agree += best_index == exact(k);
+                }
+
+                bench_write_value(f, name_agreement, "agreement", (double)agree / queries.rows);
+            }
+        }
+    }
+}
+
+// Kd-tree search with increasing numbers of leaves visited, 
+// timed and with how often it finds the exact best frame
+static void bench_kdtree(FILE* f, const char* filter)
+{
+    const int nfeatures = 27;
+    const int sizes[] = { 100000, 1000000 };
+    const int max_leaves[] = { 4, 16, 64, 256, 0 };
+
+    if (!bench_match_prefix("database_search_kdtree", filter)) { return; }
+
+    for (int s = 0; s < 2; s++)
+    {
+        bench_database bench_db;
+        bench_make_database(bench_db, sizes[s], nfeatures, 1234);
+        database& db = bench_db.db;
+        database_build_kdtree(db);
+
+        array2d<float> queries(256, nfeatures);
+        bench_make_queries(queries, db, 5678);
+
+        array1d<int> exact(queries.rows);
+        for (int q = 0; q < queries.rows; q++)
+        {
+            float best_cost = FLT_MAX;
+            exact(q) = -1;
+            database_search(exact(q), best_cost, db, queries(q));
+        }
+
+        for (int l = 0; l < 5; l++)
+        {
+            char name[64], name_agreement[64];
+            snprintf(name, sizeof(name), "database_search_kdtree_%d_%d", max_leaves[l], sizes[s]);
+            snprintf(name_agreement, sizeof(name_agreement), "database_search_kdtree_%d_agreement_%d", max_leaves[l], sizes[s]);
+
+            int q = 0;
+
+            if (bench_match(name, filter))
+            {
+                bench_write(f, bench_run(name, 1000, [&]()
+                {
+                    int best_index = -1;
+                    float best_cost = FLT_MAX;
+                    database_search_kdtree(best_index, best_cost, db, queries(q++ % queries.rows), max_leaves[l]);
+                }));
+            }
+
+            if (bench_match(name_agreement, filter))
+            {
+                int agree = 0;
+                for (int k = 0; k < queries.rows; k++)
+                {
+                    int best_index = -1;
+                    float best_cost = FLT_MAX;
+                    database_search_kdtree(best_index, best_cost, db, queries(k), max_leaves[l]);
+                    agree += best_index == exact(k);
+                }
+
+                bench_write_value(f, name_agreement, "agreement", (double)agree / queries.rows);
+            }
+        }
+    }
+}
+
+// A crowd of 256 characters searching the same database in one
+// frame, on the calling thread only and with all cores
+static void bench_scheduler(FILE* f, const char* filter)
+{
+    const int nfeatures = 27;
+    const int ncharacters = 256;
+
+    if (!bench_match_prefix("search_scheduler", filter)) { return; }
+
+    bench_database bench_db;
+    bench_make_database(bench_db, 100000, nfeatures, 1234);
+    database& db = bench_db.db;
+
+    array2d<float> queries(ncharacters, nfeatures);
+    bench_make_queries(queries, db, 5678);
+
+    int nthreads[] = { 0, mini(maxi((int)std::thread::hardware_concurrency() - 1, 1), WORKERS_MAX - 1) };
+
+    for (int t = 0; t < 2; t++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "search_scheduler_%dx100000_threads_%d", ncharacters, nthreads[t] + 1);
+
+        if (!bench_match(name, filter)) { continue; }
+
+        worker_pool workers;
+        worker_pool_start(workers, nthreads[t]);
+
+        search_scheduler s;
+        s.workers = &workers;
+
+        bench_write(f, bench_run(name, 10, [&]()
+        {
+            for (int q = 0; q < ncharacters; q++)
+            {
+                search_submit(s, &db, queries(q), -1);
+            }
+            search_run(s);
+        }));
+    }
+}
+
+static double bench_ms_since(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Opening a database saved to a container. Acquiring returns once
+// the file is mapped and the database streams in on a worker, and
+// a character searches it meanwhile, only finding frames of the
+// ranges already in. Opening it all at once is given to compare.
+static void bench_stream(FILE* f, const char* filter)
+{
+    const char* filename = "mmbench_database_stream.bin";
+    const int nframes = 1000000;
+    const int nfeatures = 27;
+
+    if (!bench_match_prefix("database_stream", filter)) { return; }
+
+    bench_database bench_db;
+    bench_make_database(bench_db, nframes, nfeatures, 1234);
+
+    array2d<vec3> bone_vectors(nframes, 1);
+    array2d<quat> bone_rotations(nframes, 1);
+    array2d<bool> contact_states(nframes, 2);
+    array1d<int> bone_parents(1);
+    bone_vectors.set(vec3());
+    bone_rotations.set(quat());
+    contact_states.zero();
+    bone_parents(0) = -1;
+
+    database& saved = bench_db.db;
+    saved.bone_positions = bone_vectors;
+    saved.bone_velocities = bone_vectors;
+    saved.bone_rotations = bone_rotations;
+    saved.bone_angular_velocities = bone_vectors;
+    saved.bone_parents = bone_parents;
+    saved.contact_states = contact_states;
+
+    if (!database_save(saved, filename)) { return; }
+
+    array2d<float> queries(64, nfeatures);
+    bench_make_queries(queries, saved, 5678);
+
+    if (bench_match("database_stream_map_build_1000000", filter))
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        database db;
+        if (database_map(db, filename))
+        {
+            database_build_search(db);
+            bench_write_value(f, "database_stream_map_build_1000000", "ms", bench_ms_since(start));
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const database* db = database_acquire(filename);
+    double acquire_ms = bench_ms_since(start);
+
+    if (db != NULL)
+    {
+        // Search on the calling thread until the stream is done, 
+        // checking every result lies in a range which was ready
+        int nsearches = 0, nunready = 0;
+
+        while (database_search_padded(*db) == false && stream_get_state(*db->stream) == STREAM_LOADING)
+        {
+            int nready = database_nranges_ready(*db);
+            int best_index = -1;
+            float best_cost = FLT_MAX;
+            database_search(best_index, best_cost, *db, queries(nsearches % queries.rows));
+
+            nunready += nready > 0 && best_index >= db->range_stops(nready - 1);
+            nsearches++;
+        }
+
+        bool done = stream_wait(*db->stream);
+        double ready_ms = bench_ms_since(start);
+
+        if (bench_match("database_stream_acquire_1000000", filter)) { bench_write_value(f, "database_stream_acquire_1000000", "ms", acquire_ms); }
+        if (bench_match("database_stream_ready_1000000", filter)) { bench_write_value(f, "database_stream_ready_1000000", "ms", done ? ready_ms : -1.0); }
+        if (bench_match("database_stream_searches_while_loading_1000000", filter)) { bench_write_value(f, "database_stream_searches_while_loading_1000000", "searches", nsearches); }
+        if (bench_match("database_stream_unready_results_1000000", filter)) { bench_write_value(f, "database_stream_unready_results_1000000", "results", nunready); }
+
+        database_release(db);
+    }
+
+    remove(filename);
+}
+
+// Random network with the given layer sizes, left unpadded
+static void bench_make_nnet(nnet& nn, const int* sizes, const int nlayers, const unsigned int seed)
+{
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    nn.nlayers = nlayers;
+    nn.input_mean.resize(sizes[0]);
+    nn.input_std.resize(sizes[0]);
+    nn.output_mean.resize(sizes[nlayers]);
+    nn.output_std.resize(sizes[nlayers]);
+    nn.input_mean.zero();
+    nn.input_std.set(1.0f);
+    nn.output_mean.zero();
+    nn.output_std.set(1.0f);
+
+    for (int l = 0; l < nlayers; l++)
+    {
+        float scale = sqrtf(2.0f / sizes[l]);
+
+        nn.weights[l].resize(sizes[l], sizes[l + 1]);
+        nn.biases[l].resize(sizes[l + 1]);
+
+        for (int i = 0; i < nn.weights[l].rows * nn.weights[l].cols; i++)
+        {
+            nn.weights[l].data[i] = scale * normal(gen);
+        }
+
+        for (int j = 0; j < nn.biases[l].size; j++)
+        {
+            nn.biases[l](j) = 0.1f * normal(gen);
+        }
+    }
+}
+
+// One output at a time over every input, as a first port of the
+// training code would be written
+static void bench_nnet_evaluate_naive(
+    slice1d<float> output,
+    array1d<float>* layers,
+    const nnet& nn,
+    const slice1d<float> input)
+{
+    for (int i = 0; i < nn.ninputs(); i++)
+    {
+        layers[0](i) = (input(i) - nn.input_mean(i)) / nn.input_std(i);
+    }
+
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        for (int j = 0; j < nn.weights[l].cols; j++)
+        {
+            float sum = nn.biases[l](j);
+            for (int i = 0; i < nn.weights[l].rows; i++)
+            {
+                sum += layers[l](i) * nn.weights[l](i, j);
+            }
+            layers[l + 1](j) = l != nn.nlayers - 1 ? maxf(sum, 0.0f) : sum;
+        }
+    }
+
+    for (int j = 0; j < nn.noutputs(); j++)
+    {
+        output(j) = layers[nn.nlayers](j) * nn.output_std(j) + nn.output_mean(j);
+    }
+}
+
+// A decompressor sized network: 27 features and 32 latent values
+// in, the pose of 23 bones out, through two hidden layers
+static void bench_nnet(FILE* f, const char* filter)
+{
+    const int hidden_sizes[] = { 256, 512 };
+
+    if (!bench_match_prefix("nnet_decompressor", filter)) { return; }
+
+    for (int h = 0; h < 2; h++)
+    {
+        const int sizes[] = { 59, hidden_sizes[h], hidden_sizes[h], 336 };
+
+        nnet naive;
+        bench_make_nnet(naive, sizes, 3, 1234);
+
+        nnet nn;
+        bench_make_nnet(nn, sizes, 3, 1234);
+        nnet_pad(nn);
+
+        array1d<float> naive_layers[4];
+        for (int l = 0; l < 4; l++) { naive_layers[l].resize(sizes[l]); }
+
+        nnet_evaluation evaluation;
+        nnet_evaluation_resize(evaluation, nn);
+
+        std::mt19937 gen(5678);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        array1d<float> input(sizes[0]);
+        for (int i = 0; i < input.size; i++) { input(i) = normal(gen); }
+
+        array1d<float> output_naive(sizes[3]);
+
+        char name_naive[64], name_dense[64], name_speedup[64], name_error[64];
+        snprintf(name_naive, sizeof(name_naive), "nnet_decompressor_%d_naive", hidden_sizes[h]);
+        snprintf(name_dense, sizeof(name_dense), "nnet_decompressor_%d_dense", hidden_sizes[h]);
+        snprintf(name_speedup, sizeof(name_speedup), "nnet_decompressor_%d_speedup", hidden_sizes[h]);
+        snprintf(name_error, sizeof(name_error), "nnet_decompressor_%d_max_error", hidden_sizes[h]);
+
+        bench_result naive_result = bench_run(name_naive, 1000, [&]()
+        {
+            bench_nnet_evaluate_naive(output_naive, naive_layers, naive, input);
+        });
+
+        bench_result dense_result = bench_run(name_dense, 1000, [&]()
+        {
+            memcpy(evaluation.layers[0].data, input.data, input.size * sizeof(float));
+            nnet_evaluate(evaluation, nn);
+        });
+
+        if (bench_match(name_naive, filter)) { bench_write(f, naive_result); }
+        if (bench_match(name_dense, filter)) { bench_write(f, dense_result); }
+
+        if (bench_match(name_speedup, filter))
+        {
+            bench_write_value(f, name_speedup, "speedup", naive_result.ns_per_op / dense_result.ns_per_op);
+        }
+
+        if (bench_match(name_error, filter))
+        {
+            float error = 0.0f;
+            for (int j = 0; j < output_naive.size; j++)
+            {
+                error = maxf(error, fabsf(output_naive(j) - evaluation.output()(j)));
+            }
+            bench_write_value(f, name_error, "max_error", error);
+        }
+    }
+}
+
+// Decompressor sized network with float, int8 and half float
+// weights, and how far the quantized outputs are from the float ones
+static void bench_nnet_quantized(FILE* f, const char* filter)
+{
+    const int sizes[] = { 59, 512, 512, 336 };
+    const int formats[] = { QUANTIZED_NONE, QUANTIZED_INT8, QUANTIZED_FP16 };
+    const char* format_names[] = { "float", "int8", "fp16" };
+
+    if (!bench_match_prefix("nnet_quantized", filter)) { return; }
+
+    nnet reference;
+    bench_make_nnet(reference, sizes, 3, 1234);
+    nnet_pad(reference);
+
+    std::mt19937 gen(5678);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    array1d<float> input(sizes[0]);
+    for (int i = 0; i < input.size; i++) { input(i) = normal(gen); }
+
+    for (int q = 0; q < 3; q++)
+    {
+        nnet nn = reference;
+        nnet_quantize(nn, formats[q]);
+
+        nnet_evaluation evaluation;
+        nnet_evaluation_resize(evaluation, nn);
+
+        char name[64], name_error[64];
+        snprintf(name, sizeof(name), "nnet_quantized_%s", format_names[q]);
+        snprintf(name_error, sizeof(name_error), "nnet_quantized_%s_max_error", format_names[q]);
+
+        if (bench_match(name, filter))
+        {
+            bench_write(f, bench_run(name, 1000, [&]()
+            {
+                memcpy(evaluation.layers[0].data, input.data, input.size * sizeof(float));
+                nnet_evaluate(evaluation, nn);
+            }));
+        }
+
+        if (bench_match(name_error, filter))
+        {
+            bench_write_value(f, name_error, "max_error", nnet_max_error(reference, nn));
+        }
+    }
+}
+
+// A crowd of characters evaluating the same decompressor sized
+// network one at a time, and batched on one thread and all cores
+static void bench_inference(FILE* f, const char* filter)
+{
+    const int ncharacters = 256;
+    const int sizes[] = { 59, 512, 512, 336 };
+
+    if (!bench_match_prefix("nnet_inference", filter)) { return; }
+
+    nnet nn;
+    bench_make_nnet(nn, sizes, 3, 1234);
+    nnet_pad(nn);
+
+    std::mt19937 gen(5678);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    array2d<float> inputs(ncharacters, sizes[0]);
+    for (int i = 0; i < inputs.rows * inputs.cols; i++) { inputs.data[i] = normal(gen); }
+
+    char name[64];
+    snprintf(name, sizeof(name), "nnet_inference_%d_single", ncharacters);
+
+    if (bench_match(name, filter))
+    {
+        nnet_evaluation evaluation;
+        nnet_evaluation_resize(evaluation, nn);
+
+        bench_write(f, bench_run(name, 10, [&]()
+        {
+            for (int c = 0; c < ncharacters; c++)
+            {
+                memcpy(evaluation.layers[0].data, inputs(c).data, inputs.cols * sizeof(float));
+                nnet_evaluate(evaluation, nn);
+            }
+        }));
+    }
+
+    int nthreads[] = { 0, mini(maxi((int)std::thread::hardware_concurrency() - 1, 1), WORKERS_MAX - 1) };
+
+    for (int t = 0; t < 2; t++)
+    {
+        snprintf(name, sizeof(name), "nnet_inference_%d_batch_threads_%d", ncharacters, nthreads[t] + 1);
+
+        if (!bench_match(name, filter)) { continue; }
+
+        worker_pool workers;
+        worker_pool_start(workers, nthreads[t]);
+
+        inference_scheduler s;
+        s.workers = &workers;
+
+        bench_write(f, bench_run(name, 10, [&]()
+        {
+            for (int c = 0; c < ncharacters; c++)
+            {
+                inference_submit(s, &nn, inputs(c));
+            }
+            inference_run(s);
+        }));
+    }
+
+    // Weights are read once per character alone, or once per task
+    snprintf(name, sizeof(name), "nnet_inference_weight_bytes_per_character");
+
+    if (bench_match(name, filter))
+    {
+        size_t bytes = 0;
+        for (int l = 0; l < nn.nlayers; l++)
+        {
+            bytes += (size_t)nn.weights[l].rows * nn.weights[l].cols * sizeof(float);
+        }
+
+        bench_write_value(f, name, "single", (double)bytes);
+        bench_write_value(f, name, "batch", (double)bytes / mini(INFERENCE_TASK_ROWS, ncharacters));
+    }
+}
+
+//--------------------------------------
+
+void bench_run_all(FILE* f, const char* filter)
+{
+    bench_arrays(f, filter);
+    bench_array_io(f, filter);
+    bench_array_map(f, filter);
+    bench_quat(f, filter);
+    bench_dampers(f, filter);
+    bench_soa(f, filter);
+    bench_springs(f, filter);
+    bench_trajectory(f, filter);
+    bench_kinematics(f, filter);
+    bench_search(f, filter);
+    bench_quantized(f, filter);
+    bench_kdtree(f, filter);
+    bench_scheduler(f, filter);
+    bench_stream(f, filter);
+    bench_nnet(f, filter);
+    bench_nnet_quantized(f, filter);
+    bench_inference(f, filter);
+}
+
+//--------------------------------------
+
+// The core does not depend on the engine, so the benchmarks can
+// also be built on their own with `MM_BENCH_MAIN` defined. The
+// CMakeLists.txt at the root of the project does so at -O3 for
+// the instruction sets of the machine, which the batched loops
+// need to show their gain:
+//
+//   cmake -S . -B build && cmake --build build -j
+//   ./build/mmbench [filter] > results.json
+#if MM_BENCH_MAIN
+int main(int argc, char** argv)
+{
+    bench_run_all(stdout, argc > 1 ? argv[1] : NULL);
+    return 0;
+}
+#endif
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMAlloc.h"
+
+#include <stdio.h>
+#include <chrono>
+
+//--------------------------------------
+
+// Minimal micro-benchmark harness. Each case is timed over a
+// fixed number of iterations after one untimed warm up call,
+// and heap allocations are counted through `heap_allocations`.
+// Results are written one JSON object per line.
+
+struct bench_result
+{
+    const char* name;
+    int iterations;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+template<typename F>
+bench_result bench_run(const char* name, const int iterations, F func)
+{
+    func();
+
+    uint64_t allocs = heap_allocations.load(std::memory_order_relaxed);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+    {
+        func();
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    allocs = heap_allocations.load(std::memory_order_relaxed) - allocs;
+
+    bench_result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    result.allocs_per_op = (double)allocs / iterations;
+    return result;
+}
+
+void bench_write(FILE* f, const bench_result& result);
+
+// For cases measuring something other than time, such as how
+// often an approximation gives the exact answer
+void bench_write_value(FILE* f, const char* name, const char* key, const double value);
+
+// Runs every case whose name contains `filter`, or all of 
+// them if `filter` is NULL or empty.
+void bench_run_all(FILE* f, const char* filter = NULL);
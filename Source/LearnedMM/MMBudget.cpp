@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMBudget.h"
+
+#include <algorithm>
+
+//--------------------------------------
+
+bool budget_admit(budget_scheduler& s, const int kind, const float priority)
+{
+    const float cost = s.costs[kind];
+
+    s.priorities.resize(s.priorities.size + 1);
+    s.request_costs.resize(s.request_costs.size + 1);
+    s.priorities(s.priorities.size - 1) = priority;
+    s.request_costs(s.request_costs.size - 1) = cost;
+
+    bool admit = s.budget <= 0.0f ||
+        (priority <= s.cutoff && (s.admitted == 0 || s.spent + cost <= s.budget));
+
+    if (admit)
+    {
+        s.spent += cost;
+        s.admitted++;
+    }
+    else
+    {
+        s.deferred++;
+        s.total_deferred++;
+    }
+
+    return admit;
+}
+
+void budget_frame(budget_scheduler& s, const float budget)
+{
+    s.budget = budget;
+    s.cutoff = FLT_MAX;
+
+    // Had all of this frame's requests come in priority order, the
+    // last one to fit sets how far down the order to go next frame
+    if (budget > 0.0f && s.priorities.size > 0)
+    {
+        array1d<int>& order = s.order;
+        order.resize(s.priorities.size);
+        for (int i = 0; i < order.size; i++) { order(i) = i; }
+
+        std::sort(order.data, order.data + order.size, [&s](const int a, const int b)
+        {
+            return s.priorities(a) < s.priorities(b);
+        });
+
+        float total = 0.0f;
+        for (int o = 0; o < order.size; o++)
+        {
+            total += s.request_costs(order(o));
+            if (o > 0 && total > budget)
+            {
+                s.cutoff = s.priorities(order(o - 1));
+                break;
+            }
+        }
+    }
+
+    s.last_admitted = s.admitted;
+    s.last_deferred = s.deferred;
+    s.admitted = 0;
+    s.deferred = 0;
+    s.spent = 0.0f;
+    s.priorities.resize(0);
+    s.request_costs.resize(0);
+}
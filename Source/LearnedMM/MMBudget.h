@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+
+#include <float.h>
+
+//--------------------------------------
+
+// Caps the time spent on motion matching work each frame. Work
+// which can wait, such as a search, asks to be admitted with a
+// priority and an estimate of its cost. Work is admitted while
+// the frame's budget lasts, but only above a cutoff priority found
+// from the requests of the previous frame. Characters tick in no
+// particular order, so the cutoff is what lets the most important
+// work through first. Deferred work asks again on later frames
+// and moves up the order the longer it waits.
+
+enum budget_work
+{
+    BUDGET_SEARCH,
+    BUDGET_PROJECTOR,
+    BUDGET_POSE,
+    BUDGET_WORK_COUNT,
+};
+
+enum
+{
+    // Priorities of each class of character are kept apart by more 
+    // than any distance
+    BUDGET_CLASS_SPAN = 1000000,
+};
+
+// Lower comes first: player controlled characters, then those on
+// screen, then the rest, each closest first
+static inline float budget_priority(
+    const float distance,
+    const bool on_screen,
+    const bool player_controlled,
+    const int frames_waited)
+{
+    float priority =
+        player_controlled ? 0.0f :
+        (on_screen ? 1.0f : 2.0f) * BUDGET_CLASS_SPAN + minf(distance, BUDGET_CLASS_SPAN - 1.0f);
+
+    return priority / (1 + frames_waited);
+}
+
+struct budget_scheduler
+{
+    // Seconds per frame, zero or less for no limit
+    float budget;
+    float spent;
+    float cutoff;
+
+    // Running estimate of the cost of each kind of work
+    float costs[BUDGET_WORK_COUNT];
+
+    // This frame's requests
+    array1d<float> priorities;
+    array1d<float> request_costs;
+    array1d<int> order;
+    int admitted;
+    int deferred;
+
+    // Counts for the last finished frame, and deferrals overall
+    int last_admitted;
+    int last_deferred;
+    int total_deferred;
+
+    budget_scheduler() : 
+        budget(0.0f), spent(0.0f), cutoff(FLT_MAX), 
+        admitted(0), deferred(0), 
+        last_admitted(0), last_deferred(0), total_deferred(0)
+    {
+        for (int i = 0; i < BUDGET_WORK_COUNT; i++) { costs[i] = 0.0f; }
+    }
+};
+
+// Folds a measured cost of `kind` work into its estimate
+static inline void budget_cost_record(budget_scheduler& s, const int kind, const float seconds)
+{
+    s.costs[kind] = s.costs[kind] == 0.0f ? seconds : lerpf(s.costs[kind], seconds, 0.1f);
+}
+
+// Returns true if work of `kind` can run this frame. Otherwise it
+// is counted as deferred and should ask again next frame. The first
+// work above the cutoff is always admitted so nothing waits forever
+// on a budget smaller than one piece of work.
+bool budget_admit(budget_scheduler& s, const int kind, const float priority);
+
+// Ends the frame, finding the cutoff for the next one from this
+// frame's requests so the least important work waits first
+void budget_frame(budget_scheduler& s, const float budget);
@@ -1,12 +0,0 @@
-// Fill out your copyright notice in the Description page of Project Settings.
-
-
-#include "MMCommon.h"
-
-MMCommon::MMCommon()
-{
-}
-
-MMCommon::~MMCommon()
-{
-}
@@ -2,21 +2,10 @@
 
 #pragma once
 
-#include "CoreMinimal.h"
-
 #include <math.h>
 
 #define PIf 3.14159265358979323846f
 #define LN2f 0.69314718056f
-/**
- * 
- */
-class LEARNEDMM_API MMCommon
-{
-public:
-	MMCommon();
-	~MMCommon();
-};
 
 static inline float clampf(float x, float min, float max)
 {
@@ -66,7 +55,39 @@ static inline float fast_atanf(float x)
     return copysign(z > 1.0f ? PIf / 2.0f - y : y, x);
 }
 
+// Angle in the range -pi to pi
+static inline float wrap_anglef(float x)
+{
+    return x - 2.0f * PIf * floorf(x / (2.0f * PIf) + 0.5f);
+}
+
+// Accurate to about 1e-5 and with no branches, so loops of 
+// them can be vectorized
+static inline float fast_sinf(float x)
+{
+    x = wrap_anglef(x);
+    x = x > PIf / 2.0f ? PIf - x : x < -PIf / 2.0f ? -PIf - x : x;
+
+    float x2 = x * x;
+    return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f + x2 * (1.0f / 362880.0f)))));
+}
+
+static inline float fast_cosf(float x)
+{
+    return fast_sinf(x + PIf / 2.0f);
+}
+
 static inline int clamp(int x, int min, int max)
 {
     return x < min ? min : x > max ? max : x;
 }
+
+static inline int mini(int x, int y)
+{
+    return x < y ? x : y;
+}
+
+static inline int maxi(int x, int y)
+{
+    return x > y ? x : y;
+}
@@ -0,0 +1,222 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMContainer.h"
+
+//--------------------------------------
+
+static inline uint64_t container_align(uint64_t offset)
+{
+    return (offset + CONTAINER_ALIGNMENT - 1) & ~(uint64_t)(CONTAINER_ALIGNMENT - 1);
+}
+
+container::~container()
+{
+    container_close(*this);
+}
+
+// FNV-1a over 64-bit words with the tail folded in bytewise
+uint64_t container_checksum(const void* data, size_t bytes)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    const unsigned char* ptr = (const unsigned char*)data;
+    size_t nwords = bytes / sizeof(uint64_t);
+
+    for (size_t i = 0; i < nwords; i++)
+    {
+        uint64_t word;
+        memcpy(&word, ptr + i * sizeof(uint64_t), sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+    }
+
+    for (size_t i = nwords * sizeof(uint64_t); i < bytes; i++)
+    {
+        hash = (hash ^ ptr[i]) * prime;
+    }
+
+    return hash;
+}
+
+void container_close(container& c)
+{
+    if (c.buffer != NULL)
+    {
+        aligned_free(c.buffer);
+        c.buffer = NULL;
+    }
+
+    if (c.file != NULL)
+    {
+        mapped_file_close(c.file);
+        c.file = NULL;
+    }
+
+    c.nsections = 0;
+}
+
+int container_find(const container& c, const char* name)
+{
+    for (int i = 0; i < c.nsections; i++)
+    {
+        if (strncmp(c.sections[i].name, name, CONTAINER_NAME_SIZE) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//--------------------------------------
+
+static bool container_write_padding(FILE* f, uint64_t& offset, uint64_t target)
+{
+    static const char zeros[CONTAINER_ALIGNMENT] = { 0 };
+    size_t bytes = (size_t)(target - offset);
+    offset = target;
+    return bytes == 0 || fwrite(zeros, 1, bytes, f) == bytes;
+}
+
+bool container_write(const container& c, const char* filename)
+{
+    container_section sections[CONTAINER_MAX_SECTIONS];
+    memcpy(sections, c.sections, sizeof(container_section) * c.nsections);
+
+    uint64_t toc_offset = sizeof(container_header);
+    uint64_t offset = toc_offset + sizeof(container_section) * c.nsections;
+
+    for (int i = 0; i < c.nsections; i++)
+    {
+        offset = container_align(offset);
+        sections[i].offset = offset;
+        sections[i].checksum = container_checksum(c.data[i], (size_t)sections[i].bytes);
+        offset += sections[i].bytes;
+    }
+
+    container_header header;
+    memset(&header, 0, sizeof(container_header));
+    header.magic = CONTAINER_MAGIC;
+    header.version = CONTAINER_VERSION;
+    header.endian = CONTAINER_ENDIAN;
+    header.nsections = c.nsections;
+    header.toc_offset = toc_offset;
+    header.file_size = offset;
+    header.toc_checksum = container_checksum(sections, sizeof(container_section) * c.nsections);
+
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) { return false; }
+
+    bool ok = fwrite(&header, sizeof(container_header), 1, f) == 1;
+    ok = ok && fwrite(sections, sizeof(container_section), c.nsections, f) == (size_t)c.nsections;
+
+    offset = toc_offset + sizeof(container_section) * c.nsections;
+    for (int i = 0; ok && i < c.nsections; i++)
+    {
+        ok = container_write_padding(f, offset, sections[i].offset);
+        ok = ok && fwrite(c.data[i], 1, (size_t)sections[i].bytes, f) == sections[i].bytes;
+        offset += sections[i].bytes;
+    }
+
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+//--------------------------------------
+
+// Checks the header and table of contents of `bytes` of file 
+// data and points each section into it.
+static bool container_parse(container& c, const char* base, uint64_t bytes, bool verify)
+{
+    if (bytes < sizeof(container_header)) { return false; }
+
+    container_header header;
+    memcpy(&header, base, sizeof(container_header));
+
+    if (header.magic != CONTAINER_MAGIC ||
+        header.version != CONTAINER_VERSION ||
+        header.endian != CONTAINER_ENDIAN ||
+        header.nsections > CONTAINER_MAX_SECTIONS ||
+        header.file_size != bytes)
+    {
+        return false;
+    }
+
+    uint64_t toc_bytes = sizeof(container_section) * header.nsections;
+    if (header.toc_offset > bytes || toc_bytes > bytes - header.toc_offset) { return false; }
+
+    if (container_checksum(base + header.toc_offset, (size_t)toc_bytes) != header.toc_checksum) { return false; }
+
+    memcpy(c.sections, base + header.toc_offset, (size_t)toc_bytes);
+    c.nsections = header.nsections;
+
+    for (int i = 0; i < c.nsections; i++)
+    {
+        const container_section& s = c.sections[i];
+
+        if (s.name[CONTAINER_NAME_SIZE - 1] != '\0' ||
+            s.rows < 0 || s.cols < 0 ||
+            s.offset % CONTAINER_ALIGNMENT != 0 ||
+            s.bytes != (uint64_t)s.rows * s.cols * s.elem_size ||
+            s.offset > bytes || s.bytes > bytes - s.offset)
+        {
+            c.nsections = 0;
+            return false;
+        }
+
+        if (verify && container_checksum(base + s.offset, (size_t)s.bytes) != s.checksum)
+        {
+            c.nsections = 0;
+            return false;
+        }
+
+        c.data[i] = base + s.offset;
+    }
+
+    return true;
+}
+
+bool container_load(container& c, const char* filename)
+{
+    container_close(c);
+
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) { return false; }
+
+    bool ok = fseek(f, 0, SEEK_END) == 0;
+    long bytes = ok ? ftell(f) : -1;
+    ok = ok && bytes > 0 && fseek(f, 0, SEEK_SET) == 0;
+
+    if (ok)
+    {
+        c.buffer = (char*)aligned_malloc((size_t)bytes, CONTAINER_ALIGNMENT);
+        ok = c.buffer != NULL && fread(c.buffer, 1, (size_t)bytes, f) == (size_t)bytes;
+    }
+
+    fclose(f);
+
+    if (!ok || !container_parse(c, c.buffer, (uint64_t)bytes, true))
+    {
+        container_close(c);
+        return false;
+    }
+
+    return true;
+}
+
+bool container_map(container& c, const char* filename, bool verify)
+{
+    container_close(c);
+
+    c.file = mapped_file_open(filename);
+    if (c.file == NULL) { return false; }
+
+    if (!container_parse(c, c.file->data, c.file->size, verify))
+    {
+        container_close(c);
+        return false;
+    }
+
+    return true;
+}
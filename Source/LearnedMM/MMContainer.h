@@ -0,0 +1,181 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMArray.h"
+
+#include <stdint.h>
+
+//--------------------------------------
+
+// A single file holding many named arrays. The layout is
+//
+//   [header][table of contents][section 0][section 1]...
+//
+// where every section starts on a 64 byte boundary and has
+// its own checksum. The header records the format version,
+// a byte order marker and the total file size, so a file 
+// from another platform, an older exporter or a truncated 
+// copy is rejected when opened rather than producing garbage.
+
+enum
+{
+    CONTAINER_MAGIC = 0x434D4D4C, // "LMMC"
+    CONTAINER_VERSION = 1,
+    CONTAINER_ENDIAN = 0x01020304,
+    CONTAINER_ALIGNMENT = 64,
+    CONTAINER_NAME_SIZE = 24,
+    CONTAINER_MAX_SECTIONS = 64,
+};
+
+struct container_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t endian;
+    uint32_t nsections;
+    uint64_t toc_offset;
+    uint64_t file_size;
+    uint64_t toc_checksum;
+    uint8_t reserved[24];
+};
+
+struct container_section
+{
+    char name[CONTAINER_NAME_SIZE];
+    uint32_t elem_size;
+    int32_t rows;
+    int32_t cols;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+static_assert(sizeof(container_header) == 64, "Container header must be 64 bytes");
+static_assert(sizeof(container_section) == 64, "Container section must be 64 bytes");
+
+// When writing, `data` points at the arrays being saved.
+// When loading or mapping it points inside `buffer` or 
+// `file`, which are owned by the container.
+struct container
+{
+    int nsections;
+    container_section sections[CONTAINER_MAX_SECTIONS];
+    const char* data[CONTAINER_MAX_SECTIONS];
+
+    char* buffer;
+    mapped_file* file;
+
+    container() : nsections(0), buffer(NULL), file(NULL) {}
+    container(const container&) = delete;
+    container& operator=(const container&) = delete;
+    ~container();
+};
+
+uint64_t container_checksum(const void* data, size_t bytes);
+
+// Releases any loaded buffer or mapping and clears all sections
+void container_close(container& c);
+
+// Writes all added sections. Returns false on any IO error.
+bool container_write(const container& c, const char* filename);
+
+// Reads the whole file into a single aligned buffer and
+// verifies every section checksum.
+bool container_load(container& c, const char* filename);
+
+// Maps the file and validates the header and table of contents.
+// Section checksums are only verified if `verify` is set, as
+// doing so touches every page of the file.
+bool container_map(container& c, const char* filename, bool verify = false);
+
+int container_find(const container& c, const char* name);
+
+//--------------------------------------
+
+static inline bool container_add(
+    container& c, 
+    const char* name, 
+    const void* data, 
+    const uint32_t elem_size, 
+    const int rows, 
+    const int cols)
+{
+    if (c.nsections >= CONTAINER_MAX_SECTIONS || strlen(name) >= CONTAINER_NAME_SIZE) { return false; }
+
+    container_section& s = c.sections[c.nsections];
+    memset(&s, 0, sizeof(container_section));
+    strcpy(s.name, name);
+    s.elem_size = elem_size;
+    s.rows = rows;
+    s.cols = cols;
+    s.bytes = (uint64_t)rows * cols * elem_size;
+    c.data[c.nsections] = (const char*)data;
+    c.nsections++;
+    return true;
+}
+
+// 1d arrays are stored as a single row
+template<typename T>
+bool container_add_array1d(container& c, const char* name, const slice1d<T> arr)
+{
+    return container_add(c, name, arr.data, sizeof(T), 1, arr.size);
+}
+
+template<typename T>
+bool container_add_array2d(container& c, const char* name, const slice2d<T> arr)
+{
+    return container_add(c, name, arr.data, sizeof(T), arr.rows, arr.cols);
+}
+
+template<typename T, typename A>
+bool container_add_array1d(container& c, const char* name, const array1d<T, A>& arr)
+{
+    return container_add_array1d(c, name, (slice1d<T>)arr);
+}
+
+template<typename T, typename A>
+bool container_add_array2d(container& c, const char* name, const array2d<T, A>& arr)
+{
+    return container_add_array2d(c, name, (slice2d<T>)arr);
+}
+
+// Finds a section and checks its element size matches `T`. The 
+// slice points into the container and lives as long as it does.
+template<typename T>
+bool container_slice1d(slice1d<T>& arr, const container& c, const char* name)
+{
+    int i = container_find(c, name);
+    if (i == -1 || c.sections[i].elem_size != sizeof(T) || c.sections[i].rows != 1) { return false; }
+    arr = slice1d<T>(c.sections[i].cols, (T*)c.data[i]);
+    return true;
+}
+
+template<typename T>
+bool container_slice2d(slice2d<T>& arr, const container& c, const char* name)
+{
+    int i = container_find(c, name);
+    if (i == -1 || c.sections[i].elem_size != sizeof(T)) { return false; }
+    arr = slice2d<T>(c.sections[i].rows, c.sections[i].cols, (T*)c.data[i]);
+    return true;
+}
+
+// Same as above but copies the section into an owned array
+template<typename T, typename A>
+bool container_read_array1d(array1d<T, A>& arr, const container& c, const char* name)
+{
+    slice1d<T> s(0, NULL);
+    if (!container_slice1d(s, c, name)) { return false; }
+    arr = s;
+    return true;
+}
+
+template<typename T, typename A>
+bool container_read_array2d(array2d<T, A>& arr, const container& c, const char* name)
+{
+    slice2d<T> s(0, 0, NULL);
+    if (!container_slice2d(s, c, name)) { return false; }
+    arr = s;
+    return true;
+}
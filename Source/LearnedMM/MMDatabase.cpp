@@ -0,0 +1,375 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMDatabase.h"
+
+#include <mutex>
+
+//--------------------------------------
+
+database::~database()
+{
+    database_close(*this);
+}
+
+// Every per-frame table must have a row for every frame, and 
+// every range must lie within them
+static bool database_check(const database& db)
+{
+    if (db.bone_positions.rows != db.nframes() ||
+        db.bone_velocities.rows != db.nframes() ||
+        db.bone_rotations.rows != db.nframes() ||
+        db.bone_angular_velocities.rows != db.nframes() ||
+        db.contact_states.rows != db.nframes() ||
+        db.range_starts.size != db.range_stops.size ||
+        db.nranges() == 0 ||
+        db.features_offset.size != db.nfeatures() ||
+        db.features_scale.size != db.nfeatures())
+    {
+        return false;
+    }
+
+    for (int r = 0; r < db.nranges(); r++)
+    {
+        if (db.range_starts(r) < 0 || 
+            db.range_starts(r) > db.range_stops(r) || 
+            db.range_stops(r) > db.nframes())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool database_map(database& db, const char* filename, const bool verify)
+{
+    database_close(db);
+
+    bool ok =
+        container_map(db.source, filename, verify) &&
+        container_slice2d(db.bone_positions, db.source, "bone_positions") &&
+        container_slice2d(db.bone_velocities, db.source, "bone_velocities") &&
+        container_slice2d(db.bone_rotations, db.source, "bone_rotations") &&
+        container_slice2d(db.bone_angular_velocities, db.source, "bone_angular_velocities") &&
+        container_slice1d(db.bone_parents, db.source, "bone_parents") &&
+        container_slice1d(db.range_starts, db.source, "range_starts") &&
+        container_slice1d(db.range_stops, db.source, "range_stops") &&
+        container_slice2d(db.contact_states, db.source, "contact_states") &&
+        container_slice2d(db.features, db.source, "features") &&
+        container_slice1d(db.features_offset, db.source, "features_offset") &&
+        container_slice1d(db.features_scale, db.source, "features_scale");
+
+    if (!ok || !database_check(db))
+    {
+        database_close(db);
+        return false;
+    }
+
+    return true;
+}
+
+bool database_map(database& db, const char* filename, const char* features_filename)
+{
+    database_close(db);
+
+    db.files[0] = mapped_file_open(filename);
+    db.files[1] = mapped_file_open(features_filename);
+
+    size_t offset = 0, features_offset = 0;
+
+    bool ok =
+        db.files[0] != NULL &&
+        db.files[1] != NULL &&
+        array2d_map(db.bone_positions, db.files[0], offset) &&
+        array2d_map(db.bone_velocities, db.files[0], offset) &&
+        array2d_map(db.bone_rotations, db.files[0], offset) &&
+        array2d_map(db.bone_angular_velocities, db.files[0], offset) &&
+        array1d_map(db.bone_parents, db.files[0], offset) &&
+        array1d_map(db.range_starts, db.files[0], offset) &&
+        array1d_map(db.range_stops, db.files[0], offset) &&
+        array2d_map(db.contact_states, db.files[0], offset) &&
+        array2d_map(db.features, db.files[1], features_offset) &&
+        array1d_map(db.features_offset, db.files[1], features_offset) &&
+        array1d_map(db.features_scale, db.files[1], features_offset);
+
+    if (!ok || !database_check(db))
+    {
+        database_close(db);
+        return false;
+    }
+
+    return true;
+}
+
+void database_close(database& db)
+{
+    if (db.stream != NULL) { stream_close(*db.stream); }
+
+    db.bone_positions = slice2d<vec3>();
+    db.bone_velocities = slice2d<vec3>();
+    db.bone_rotations = slice2d<quat>();
+    db.bone_angular_velocities = slice2d<vec3>();
+    db.bone_parents = slice1d<int>();
+    db.range_starts = slice1d<int>();
+    db.range_stops = slice1d<int>();
+    db.features = slice2d<float>();
+    db.features_offset = slice1d<float>();
+    db.features_scale = slice1d<float>();
+    db.contact_states = slice2d<bool>();
+
+    db.features_padded.resize(0, 0);
+    db.bound_sm_min.resize(0, 0);
+    db.bound_sm_max.resize(0, 0);
+    db.bound_lr_min.resize(0, 0);
+    db.bound_lr_max.resize(0, 0);
+
+    container_close(db.source);
+    mapped_file_close(db.files[0]);
+    mapped_file_close(db.files[1]);
+    db.files[0] = NULL;
+    db.files[1] = NULL;
+}
+
+bool database_save(const database& db, const char* filename)
+{
+    container c;
+    container_add_array2d(c, "bone_positions", db.bone_positions);
+    container_add_array2d(c, "bone_velocities", db.bone_velocities);
+    container_add_array2d(c, "bone_rotations", db.bone_rotations);
+    container_add_array2d(c, "bone_angular_velocities", db.bone_angular_velocities);
+    container_add_array1d(c, "bone_parents", db.bone_parents);
+    container_add_array1d(c, "range_starts", db.range_starts);
+    container_add_array1d(c, "range_stops", db.range_stops);
+    container_add_array2d(c, "contact_states", db.contact_states);
+    container_add_array2d(c, "features", db.features);
+    container_add_array1d(c, "features_offset", db.features_offset);
+    container_add_array1d(c, "features_scale", db.features_scale);
+    container_add_array2d(c, "bound_sm_min", db.bound_sm_min);
+    container_add_array2d(c, "bound_sm_max", db.bound_sm_max);
+    container_add_array2d(c, "bound_lr_min", db.bound_lr_min);
+    container_add_array2d(c, "bound_lr_max", db.bound_lr_max);
+    return container_write(c, filename);
+}
+
+void database_build_padded(database& db)
+{
+    db.features_padded.resize(db.nframes(), db.nfeatures_padded());
+    db.features_padded.zero();
+
+    for (int i = 0; i < db.nframes(); i++)
+    {
+        memcpy(db.features_padded(i).data, db.features(i).data, db.nfeatures() * sizeof(float));
+    }
+}
+
+void database_build_bounds(database& db)
+{
+    database_build_padded(db);
+
+    int nbound_sm = ((db.nframes() + BOUND_SM_SIZE - 1) / BOUND_SM_SIZE);
+    int nbound_lr = ((db.nframes() + BOUND_LR_SIZE - 1) / BOUND_LR_SIZE);
+
+    db.bound_sm_min.resize(nbound_sm, db.nfeatures_padded());
+    db.bound_sm_max.resize(nbound_sm, db.nfeatures_padded());
+    db.bound_lr_min.resize(nbound_lr, db.nfeatures_padded());
+    db.bound_lr_max.resize(nbound_lr, db.nfeatures_padded());
+
+    db.bound_sm_min.set(FLT_MAX);
+    db.bound_sm_max.set(-FLT_MAX);
+    db.bound_lr_min.set(FLT_MAX);
+    db.bound_lr_max.set(-FLT_MAX);
+
+    for (int i = 0; i < db.nframes(); i++)
+    {
+        int i_sm = i / BOUND_SM_SIZE;
+        int i_lr = i / BOUND_LR_SIZE;
+
+        for (int j = 0; j < db.nfeatures_padded(); j++)
+        {
+            db.bound_sm_min(i_sm, j) = minf(db.bound_sm_min(i_sm, j), db.features_padded(i, j));
+            db.bound_sm_max(i_sm, j) = maxf(db.bound_sm_max(i_sm, j), db.features_padded(i, j));
+            db.bound_lr_min(i_lr, j) = minf(db.bound_lr_min(i_lr, j), db.features_padded(i, j));
+            db.bound_lr_max(i_lr, j) = maxf(db.bound_lr_max(i_lr, j), db.features_padded(i, j));
+        }
+    }
+}
+
+void database_build_search(database& db)
+{
+    // Bounds saved before they were padded get rebuilt
+    if (!container_read_array2d(db.bound_sm_min, db.source, "bound_sm_min") ||
+        !container_read_array2d(db.bound_sm_max, db.source, "bound_sm_max") ||
+        !container_read_array2d(db.bound_lr_min, db.source, "bound_lr_min") ||
+        !container_read_array2d(db.bound_lr_max, db.source, "bound_lr_max") ||
+        db.bound_sm_min.cols != db.nfeatures_padded() ||
+        db.bound_lr_min.cols != db.nfeatures_padded())
+    {
+        database_build_bounds(db);
+    }
+    else
+    {
+        database_build_padded(db);
+    }
+}
+
+void database_build_quantized(database& db, const int format)
+{
+    if (db.features_padded.rows != db.nframes())
+    {
+        database_build_padded(db);
+    }
+
+    quantized_build(db.features_quantized, db.features_padded, format);
+}
+
+void database_build_kdtree(database& db, const int leaf_size, const int ignore_range_end)
+{
+    if (db.features_padded.rows != db.nframes())
+    {
+        database_build_padded(db);
+    }
+
+    kdtree_build(db.features_kdtree, db.features_padded, db.range_starts, db.range_stops, leaf_size, ignore_range_end);
+}
+
+//--------------------------------------
+
+// The stream is declared after the database so it is stopped
+// before the database it points at is destroyed
+struct database_entry
+{
+    database db;
+    database_stream stream;
+    char* filename;
+    char* features_filename;
+    int refs;
+    database_entry* next;
+};
+
+static std::mutex databases_mutex;
+static database_entry* databases = NULL;
+
+// A container holds everything, otherwise features come from 
+// a second file next to the legacy `database.bin`
+static char* database_strdup(const char* str)
+{
+    if (str == NULL) { return NULL; }
+
+    size_t length = strlen(str);
+    char* copy = (char*)malloc(length + 1);
+    if (copy != NULL) { memcpy(copy, str, length + 1); }
+    return copy;
+}
+
+// Two acquires only share a database if they name the same files, 
+// so a container never stands in for a legacy pair or the other way
+static bool database_same_files(const database_entry& entry, const char* filename, const char* features_filename)
+{
+    if (strcmp(entry.filename, filename) != 0) { return false; }
+
+    if (entry.features_filename == NULL || features_filename == NULL)
+    {
+        return entry.features_filename == features_filename;
+    }
+
+    return strcmp(entry.features_filename, features_filename) == 0;
+}
+
+static bool database_map_any(database& db, const char* filename, const char* features_filename)
+{
+    return features_filename == NULL ?
+        database_map(db, filename) :
+        database_map(db, filename, features_filename);
+}
+
+const database* database_acquire(const char* filename, const char* features_filename)
+{
+    std::lock_guard<std::mutex> lock(databases_mutex);
+
+    for (database_entry* entry = databases; entry != NULL; entry = entry->next)
+    {
+        if (database_same_files(*entry, filename, features_filename))
+        {
+            if (database_failed(entry->db)) { return NULL; }
+
+            entry->refs++;
+            return &entry->db;
+        }
+    }
+
+    database_entry* entry = new database_entry();
+
+    if (!database_map_any(entry->db, filename, features_filename))
+    {
+        delete entry;
+        return NULL;
+    }
+
+    if (!stream_start(entry->stream, entry->db))
+    {
+        database_build_search(entry->db);
+    }
+
+    entry->filename = database_strdup(filename);
+    entry->features_filename = database_strdup(features_filename);
+
+    if (entry->filename == NULL || (features_filename != NULL && entry->features_filename == NULL))
+    {
+        free(entry->filename);
+        free(entry->features_filename);
+        delete entry;
+        return NULL;
+    }
+
+    entry->refs = 1;
+    entry->next = databases;
+    databases = entry;
+    return &entry->db;
+}
+
+int database_streaming(float& progress)
+{
+    std::lock_guard<std::mutex> lock(databases_mutex);
+
+    int nstreaming = 0;
+    double bytes_total = 0.0;
+    double bytes_done = 0.0;
+
+    for (database_entry* entry = databases; entry != NULL; entry = entry->next)
+    {
+        if (stream_get_state(entry->stream) == STREAM_LOADING)
+        {
+            nstreaming++;
+            bytes_total += (double)entry->stream.bytes_total;
+            bytes_done += (double)entry->stream.bytes_total * stream_progress(entry->stream);
+        }
+    }
+
+    progress = bytes_total == 0.0 ? 1.0f : (float)(bytes_done / bytes_total);
+    return nstreaming;
+}
+
+void database_release(const database* db)
+{
+    if (db == NULL) { return; }
+
+    std::lock_guard<std::mutex> lock(databases_mutex);
+
+    for (database_entry** curr = &databases; *curr != NULL; curr = &(*curr)->next)
+    {
+        database_entry* entry = *curr;
+
+        if (&entry->db == db)
+        {
+            if (--entry->refs == 0)
+            {
+                *curr = entry->next;
+                free(entry->filename);
+                free(entry->features_filename);
+                delete entry;
+            }
+            return;
+        }
+    }
+}
@@ -0,0 +1,1013 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+#include "MMArray.h"
+#include "MMSimd.h"
+#include "MMQuantize.h"
+#include "MMKdTree.h"
+#include "MMContainer.h"
+#include "MMStream.h"
+
+#include <float.h>
+
+//--------------------------------------
+
+// Frames are grouped into small and large axis aligned boxes 
+// in feature space. A search can skip a whole box when the 
+// distance from the query to the box is already worse than 
+// the best cost found so far.
+enum
+{
+    BOUND_SM_SIZE = 16,
+    BOUND_LR_SIZE = 64,
+};
+
+// The search compares features eight at a time, so they are 
+// also kept in rows padded with zeros to a multiple of this.
+enum
+{
+    FEATURE_PADDING = 8,
+};
+
+static inline int feature_padded_size(const int nfeatures)
+{
+    return ((nfeatures + FEATURE_PADDING - 1) / FEATURE_PADDING) * FEATURE_PADDING;
+}
+
+// The animation data and matching features. Frames are stored 
+// in ranges (one per animation clip) given by `range_starts` 
+// and `range_stops`, and features are stored normalized, so a 
+// query must be normalized with `features_offset` and 
+// `features_scale` before being compared.
+//
+// The tables read from file are not copied but point into the 
+// mapped file, which the database keeps open, so every character 
+// using the same file shares the same physical pages and opening
+// a database does not read it all. They must not be written to.
+// Only the padded features, bounds and optional search structures 
+// are built in memory, either at once with `database_build_search` 
+// or in the background by a `database_stream`.
+struct database
+{
+    slice2d<vec3> bone_positions;
+    slice2d<vec3> bone_velocities;
+    slice2d<quat> bone_rotations;
+    slice2d<vec3> bone_angular_velocities;
+    slice1d<int> bone_parents;
+
+    slice1d<int> range_starts;
+    slice1d<int> range_stops;
+
+    slice2d<float> features;
+    slice1d<float> features_offset;
+    slice1d<float> features_scale;
+
+    // Copy of `features` padded for the search. Bounds have 
+    // the same padded number of columns.
+    array2d<float> features_padded;
+
+    // Optional compact copy of `features_padded` for skipping
+    // frames with less memory traffic. Not built by default.
+    quantized_features features_quantized;
+
+    // Optional approximate nearest neighbour index over 
+    // `features_padded`. Not built by default.
+    kdtree features_kdtree;
+
+    slice2d<bool> contact_states;
+
+    array2d<float> bound_sm_min;
+    array2d<float> bound_sm_max;
+    array2d<float> bound_lr_min;
+    array2d<float> bound_lr_max;
+
+    // Files the tables point into. Either a container, or the
+    // legacy `database.bin` and `features.bin`.
+    container source;
+    mapped_file* files[2];
+
+    // Set while a stream is attached, see MMStream.h
+    database_stream* stream;
+
+    database() : files{ NULL, NULL }, stream(NULL) {}
+    database(const database&) = delete;
+    database& operator=(const database&) = delete;
+    ~database();
+
+    int nframes() const { return features.rows; }
+    int nbones() const { return bone_positions.cols; }
+    int nranges() const { return range_starts.size; }
+    int nfeatures() const { return features.cols; }
+    int nfeatures_padded() const { return feature_padded_size(features.cols); }
+};
+
+// Maps a container with one section per table of `database`. 
+// Section checksums are only verified if `verify` is set, which 
+// reads the whole file. The padded features and bounds are not 
+// built yet, see `database_build_search`.
+bool database_map(database& db, const char* filename, const bool verify = false);
+
+// Same for the legacy layout, with the animation data in 
+// `database.bin` and the features in `features.bin`
+bool database_map(database& db, const char* filename, const char* features_filename);
+
+// Stops any stream, unmaps the files and clears all tables
+void database_close(database& db);
+
+bool database_save(const database& db, const char* filename);
+
+void database_build_padded(database& db);
+
+// Also builds the padded features
+void database_build_bounds(database& db);
+
+// Builds the padded features and takes the bounds saved in the 
+// container, or builds them if there are none
+void database_build_search(database& db);
+
+void database_build_kdtree(database& db, const int leaf_size = 32, const int ignore_range_end = 20);
+
+// Builds `features_quantized` from the padded features in the
+// given `quantized_format`, or frees it for `QUANTIZED_NONE`
+void database_build_quantized(database& db, const int format);
+
+// Databases are read only once loaded, so all characters using 
+// the same files share one copy. Returns NULL if the file cannot 
+// be mapped, or if it is shared and already failed to stream in. 
+// Otherwise this returns at once and the database streams in on 
+// a worker thread, see MMStream.h, and can be searched meanwhile.
+const database* database_acquire(const char* filename, const char* features_filename = NULL);
+void database_release(const database* db);
+
+// Number of shared databases still streaming in, along with how
+// far they are in together, from 0 to 1
+int database_streaming(float& progress);
+
+// A database whose checksums failed while it streamed in has no
+// ranges ready, so searches find nothing. It should be released.
+static inline bool database_failed(const database& db)
+{
+    return db.stream != NULL && stream_get_state(*db.stream) == STREAM_FAILED;
+}
+
+//--------------------------------------
+
+// Squared distance between a query and a row of features which 
+// stops early once `best_cost` is reached. Features are compared 
+// eight (or four) at a time with the early out checked after each 
+// group. With padded rows there is no scalar remainder.
+static inline float feature_distance(
+    const float* __restrict query,
+    const float* __restrict row,
+    const int nfeatures,
+    const float initial_cost,
+    const float best_cost)
+{
+    float cost = initial_cost;
+    int j = 0;
+
+#if MM_SIMD_AVX2
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + j), _mm256_loadu_ps(row + j));
+        cost += hsum_avx(_mm256_mul_ps(d, d));
+        if (cost >= best_cost) { return cost; }
+    }
+#elif MM_SIMD_SSE
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(query + j + 0), _mm_loadu_ps(row + j + 0));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(query + j + 4), _mm_loadu_ps(row + j + 4));
+        cost += hsum_sse(_mm_add_ps(_mm_mul_ps(d0, d0), _mm_mul_ps(d1, d1)));
+        if (cost >= best_cost) { return cost; }
+    }
+#endif
+
+    for (; j < nfeatures; j++)
+    {
+        cost += squaref(query[j] - row[j]);
+        if (cost >= best_cost) { break; }
+    }
+    return cost;
+}
+
+// Squared distance between a query and a box
+static inline float bound_distance(
+    const float* __restrict query,
+    const float* __restrict bound_min,
+    const float* __restrict bound_max,
+    const int nfeatures,
+    const float initial_cost,
+    const float best_cost)
+{
+    float cost = initial_cost;
+    int j = 0;
+
+#if MM_SIMD_AVX2
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m256 q = _mm256_loadu_ps(query + j);
+        __m256 c = _mm256_min_ps(_mm256_max_ps(q, _mm256_loadu_ps(bound_min + j)), _mm256_loadu_ps(bound_max + j));
+        __m256 d = _mm256_sub_ps(q, c);
+        cost += hsum_avx(_mm256_mul_ps(d, d));
+        if (cost >= best_cost) { return cost; }
+    }
+#elif MM_SIMD_SSE
+    for (; j + 4 <= nfeatures; j += 4)
+    {
+        __m128 q = _mm_loadu_ps(query + j);
+        __m128 c = _mm_min_ps(_mm_max_ps(q, _mm_loadu_ps(bound_min + j)), _mm_loadu_ps(bound_max + j));
+        __m128 d = _mm_sub_ps(q, c);
+        cost += hsum_sse(_mm_mul_ps(d, d));
+        if (cost >= best_cost) { return cost; }
+    }
+#endif
+
+    for (; j < nfeatures; j++)
+    {
+        cost += squaref(query[j] - clampf(query[j], bound_min[j], bound_max[j]));
+        if (cost >= best_cost) { break; }
+    }
+    return cost;
+}
+
+// Computes the cost of the current frame (if there is one) and
+// then checks every frame of every range, skipping the last 
+// `ignore_range_end` frames of each range and any frames within 
+// `ignore_surrounding` of the current frame.
+static inline void motion_matching_search_brute_force(
+    int& __restrict best_index,
+    float& __restrict best_cost,
+    const slice1d<int> range_starts,
+    const slice1d<int> range_stops,
+    const slice2d<float> features,
+    const slice1d<float> query_normalized,
+    const float transition_cost,
+    const int ignore_range_end,
+    const int ignore_surrounding)
+{
+    int nfeatures = query_normalized.size;
+    int nranges = range_starts.size;
+    int curr_index = best_index;
+
+    if (best_index != -1)
+    {
+        best_cost = feature_distance(query_normalized.data, features(best_index).data, nfeatures, 0.0f, FLT_MAX);
+    }
+
+    for (int r = 0; r < nranges; r++)
+    {
+        int range_end = range_stops(r) - ignore_range_end;
+
+        for (int i = range_starts(r); i < range_end; i++)
+        {
+            if (curr_index != -1 && abs(i - curr_index) < ignore_surrounding) { continue; }
+
+            float curr_cost = feature_distance(query_normalized.data, &features.data[i * nfeatures], nfeatures, transition_cost, best_cost);
+
+            if (curr_cost < best_cost)
+            {
+                best_index = i;
+                best_cost = curr_cost;
+            }
+        }
+    }
+}
+
+// Same as above, but first checks the distance to each large 
+// box and then each small box, and skips those which are 
+// already further away than the best frame found so far.
+static inline void motion_matching_search(
+    int& __restrict best_index,
+    float& __restrict best_cost,
+    const slice1d<int> range_starts,
+    const slice1d<int> range_stops,
+    const slice2d<float> features,
+    const slice2d<float> bound_sm_min,
+    const slice2d<float> bound_sm_max,
+    const slice2d<float> bound_lr_min,
+    const slice2d<float> bound_lr_max,
+    const slice1d<float> query_normalized,
+    const float transition_cost,
+    const int ignore_range_end,
+    const int ignore_surrounding)
+{
+    int nfeatures = query_normalized.size;
+    int nranges = range_starts.size;
+    int curr_index = best_index;
+
+    // Find cost for current frame
+    if (best_index != -1)
+    {
+        best_cost = feature_distance(query_normalized.data, features(best_index).data, nfeatures, 0.0f, FLT_MAX);
+    }
+
+    // Search rest of database
+    for (int r = 0; r < nranges; r++)
+    {
+        // Exclude end of ranges from search    
+        int i = range_starts(r);
+        int range_end = range_stops(r) - ignore_range_end;
+
+        while (i < range_end)
+        {
+            // Find index of current and next large box
+            int i_lr = i / BOUND_LR_SIZE;
+            int i_lr_next = (i_lr + 1) * BOUND_LR_SIZE;
+
+            // If distance is greater than current best jump to next box
+            float curr_cost = bound_distance(query_normalized.data, bound_lr_min(i_lr).data, bound_lr_max(i_lr).data, nfeatures, transition_cost, best_cost);
+
+            if (curr_cost >= best_cost)
+            {
+                i = i_lr_next;
+                continue;
+            }
+
+            // Check against small box
+            while (i < i_lr_next && i < range_end)
+            {
+                // Find index of current and next small box
+                int i_sm = i / BOUND_SM_SIZE;
+                int i_sm_next = (i_sm + 1) * BOUND_SM_SIZE;
+
+                // Find distance to box
+                curr_cost = bound_distance(query_normalized.data, bound_sm_min(i_sm).data, bound_sm_max(i_sm).data, nfeatures, transition_cost, best_cost);
+
+                // If distance is greater than current best jump to next box
+                if (curr_cost >= best_cost)
+                {
+                    i = i_sm_next;
+                    continue;
+                }
+
+                // Search inside small box
+                while (i < i_sm_next && i < range_end)
+                {
+                    // Skip surrounding frames
+                    if (curr_index != -1 && abs(i - curr_index) < ignore_surrounding)
+                    {
+                        i++;
+                        continue;
+                    }
+
+                    // Check against each frame inside small box
+                    curr_cost = feature_distance(query_normalized.data, &features.data[i * nfeatures], nfeatures, transition_cost, best_cost);
+
+                    // If cost is lower than current best then update best
+                    if (curr_cost < best_cost)
+                    {
+                        best_index = i;
+                        best_cost = curr_cost;
+                    }
+
+                    i++;
+                }
+            }
+        }
+    }
+}
+
+// Searches for several queries at once, such as one for each 
+// character. Each box of frames is visited once and only the 
+// queries whose bound cost is below their own best cost are 
+// compared against it, so the rows are loaded into cache once 
+// and then reused by every query. The results are the same as 
+// calling `motion_matching_search` for each query. If the bounds
+// are empty every frame is compared.
+static inline void motion_matching_search_batch(
+    slice1d<int> best_indices,
+    slice1d<float> best_costs,
+    const slice1d<int> range_starts,
+    const slice1d<int> range_stops,
+    const slice2d<float> features,
+    const slice2d<float> bound_sm_min,
+    const slice2d<float> bound_sm_max,
+    const slice2d<float> bound_lr_min,
+    const slice2d<float> bound_lr_max,
+    const slice2d<float> queries_normalized,
+    const float transition_cost,
+    const int ignore_range_end,
+    const int ignore_surrounding)
+{
+    frame_arena_scope scratch;
+
+    int nqueries = queries_normalized.rows;
+    int nfeatures = queries_normalized.cols;
+    int nranges = range_starts.size;
+    bool use_bounds = bound_lr_min.rows > 0;
+
+    array1d<int, frame_allocator> curr_indices(nqueries);
+    array1d<int, frame_allocator> active_lr(nqueries);
+    array1d<int, frame_allocator> active_sm(nqueries);
+
+    // Find cost for current frames
+    for (int q = 0; q < nqueries; q++)
+    {
+        curr_indices(q) = best_indices(q);
+
+        if (best_indices(q) != -1)
+        {
+            best_costs(q) = feature_distance(queries_normalized(q).data, features(best_indices(q)).data, nfeatures, 0.0f, FLT_MAX);
+        }
+    }
+
+    for (int r = 0; r < nranges; r++)
+    {
+        int i = range_starts(r);
+        int range_end = range_stops(r) - ignore_range_end;
+
+        while (i < range_end)
+        {
+            // Find queries which might have a better frame in the large box
+            int i_lr = i / BOUND_LR_SIZE;
+            int i_lr_next = mini((i_lr + 1) * BOUND_LR_SIZE, range_end);
+
+            int nactive_lr = 0;
+            for (int q = 0; q < nqueries; q++)
+            {
+                if (!use_bounds || bound_distance(queries_normalized(q).data, bound_lr_min(i_lr).data, bound_lr_max(i_lr).data, nfeatures, transition_cost, best_costs(q)) < best_costs(q))
+                {
+                    active_lr(nactive_lr++) = q;
+                }
+            }
+
+            if (nactive_lr == 0)
+            {
+                i = i_lr_next;
+                continue;
+            }
+
+            while (i < i_lr_next)
+            {
+                // Of those, find queries which might have a better frame in the small box
+                int i_sm = i / BOUND_SM_SIZE;
+                int i_sm_next = mini((i_sm + 1) * BOUND_SM_SIZE, i_lr_next);
+
+                int nactive_sm = 0;
+                for (int k = 0; k < nactive_lr; k++)
+                {
+                    int q = active_lr(k);
+                    if (!use_bounds || bound_distance(queries_normalized(q).data, bound_sm_min(i_sm).data, bound_sm_max(i_sm).data, nfeatures, transition_cost, best_costs(q)) < best_costs(q))
+                    {
+                        active_sm(nactive_sm++) = q;
+                    }
+                }
+
+                // Compare each frame against every remaining query
+                for (; nactive_sm > 0 && i < i_sm_next; i++)
+                {
+                    const float* row = &features.data[i * nfeatures];
+
+                    for (int k = 0; k < nactive_sm; k++)
+                    {
+                        int q = active_sm(k);
+
+                        if (curr_indices(q) != -1 && abs(i - curr_indices(q)) < ignore_surrounding) { continue; }
+
+                        float curr_cost = feature_distance(queries_normalized(q).data, row, nfeatures, transition_cost, best_costs(q));
+
+                        if (curr_cost < best_costs(q))
+                        {
+                            best_indices(q) = i;
+                            best_costs(q) = curr_cost;
+                        }
+                    }
+                }
+
+                i = i_sm_next;
+            }
+        }
+    }
+}
+
+// Same as `motion_matching_search` but each frame left after the 
+// boxes is first compared using its quantized features, which 
+// are 2-4x smaller. The quantized distance is off from the exact 
+// one by at most `quantized.error`, so a frame whose quantized 
+// distance shows it cannot beat the best cost is skipped, and 
+// only the rest are compared exactly. The result is the same as 
+// the exact search.
+static inline void motion_matching_search_quantized(
+    int& __restrict best_index,
+    float& __restrict best_cost,
+    const slice1d<int> range_starts,
+    const slice1d<int> range_stops,
+    const slice2d<float> features,
+    const quantized_features& quantized,
+    const slice2d<float> bound_sm_min,
+    const slice2d<float> bound_sm_max,
+    const slice2d<float> bound_lr_min,
+    const slice2d<float> bound_lr_max,
+    const slice1d<float> query_normalized,
+    const float transition_cost,
+    const int ignore_range_end,
+    const int ignore_surrounding)
+{
+    frame_arena_scope scratch;
+
+    int nfeatures = query_normalized.size;
+    int nranges = range_starts.size;
+    int curr_index = best_index;
+
+    assert(quantized.nfeatures == nfeatures);
+
+    array1d<float, frame_allocator> query_quantized(nfeatures);
+    array1d<float, frame_allocator> weights(nfeatures);
+    quantized_query(query_quantized, weights, quantized, query_normalized);
+
+    // Quantized distance at which a frame can no longer beat 
+    // `best_cost`, updated whenever the best cost changes
+    float quantized_cutoff = FLT_MAX;
+
+    if (best_index != -1)
+    {
+        best_cost = feature_distance(query_normalized.data, features(best_index).data, nfeatures, 0.0f, FLT_MAX);
+        quantized_cutoff = squaref(sqrtf(maxf(best_cost - transition_cost, 0.0f)) + quantized.error);
+    }
+
+    for (int r = 0; r < nranges; r++)
+    {
+        int i = range_starts(r);
+        int range_end = range_stops(r) - ignore_range_end;
+
+        while (i < range_end)
+        {
+            int i_lr = i / BOUND_LR_SIZE;
+            int i_lr_next = (i_lr + 1) * BOUND_LR_SIZE;
+
+            float curr_cost = bound_distance(query_normalized.data, bound_lr_min(i_lr).data, bound_lr_max(i_lr).data, nfeatures, transition_cost, best_cost);
+
+            if (curr_cost >= best_cost)
+            {
+                i = i_lr_next;
+                continue;
+            }
+
+            while (i < i_lr_next && i < range_end)
+            {
+                int i_sm = i / BOUND_SM_SIZE;
+                int i_sm_next = (i_sm + 1) * BOUND_SM_SIZE;
+
+                curr_cost = bound_distance(query_normalized.data, bound_sm_min(i_sm).data, bound_sm_max(i_sm).data, nfeatures, transition_cost, best_cost);
+
+                if (curr_cost >= best_cost)
+                {
+                    i = i_sm_next;
+                    continue;
+                }
+
+                while (i < i_sm_next && i < range_end)
+                {
+                    if (curr_index != -1 && abs(i - curr_index) < ignore_surrounding)
+                    {
+                        i++;
+                        continue;
+                    }
+
+                    // Skip without touching the exact features
+                    if (quantized_distance(quantized, query_quantized.data, weights.data, i, quantized_cutoff) >= quantized_cutoff)
+                    {
+                        i++;
+                        continue;
+                    }
+
+                    curr_cost = feature_distance(query_normalized.data, &features.data[i * nfeatures], nfeatures, transition_cost, best_cost);
+
+                    if (curr_cost < best_cost)
+                    {
+                        best_index = i;
+                        best_cost = curr_cost;
+                        quantized_cutoff = squaref(sqrtf(maxf(best_cost - transition_cost, 0.0f)) + quantized.error);
+                    }
+
+                    i++;
+                }
+            }
+        }
+    }
+}
+
+// Searches a kd-tree depth first, nearest child first, skipping 
+// any node whose box is already further than the best frame and 
+// stopping after `max_leaves` leaves (or never, if zero). Frames 
+// near the end of ranges are not in the tree. When two frames have 
+// exactly the same cost the one found first wins, which may not 
+// be the lowest frame as in the other searches.
+static inline void motion_matching_search_kdtree(
+    int& __restrict best_index,
+    float& __restrict best_cost,
+    const slice2d<float> features,
+    const kdtree& tree,
+    const slice1d<float> query_normalized,
+    const int max_leaves,
+    const float transition_cost,
+    const int ignore_surrounding)
+{
+    frame_arena_scope scratch;
+
+    int nfeatures = query_normalized.size;
+    int curr_index = best_index;
+
+    assert(tree.nfeatures() == nfeatures);
+
+    if (best_index != -1)
+    {
+        best_cost = feature_distance(query_normalized.data, features(best_index).data, nfeatures, 0.0f, FLT_MAX);
+    }
+
+    if (tree.nslots() == 0) { return; }
+
+    // Nodes still to visit with their span of slots and the 
+    // distance to their box, nearest on top
+    array1d<int, frame_allocator> stack_nodes(tree.depth + 2);
+    array1d<int, frame_allocator> stack_starts(tree.depth + 2);
+    array1d<int, frame_allocator> stack_stops(tree.depth + 2);
+    array1d<float, frame_allocator> stack_costs(tree.depth + 2);
+
+    stack_nodes(0) = 0;
+    stack_starts(0) = 0;
+    stack_stops(0) = tree.nslots();
+    stack_costs(0) = transition_cost;
+    int nstack = 1;
+    int nleaves = 0;
+
+    while (nstack > 0)
+    {
+        nstack--;
+        int node = stack_nodes(nstack);
+        int start = stack_starts(nstack);
+        int stop = stack_stops(nstack);
+
+        // The best cost may have improved since this was pushed
+        if (stack_costs(nstack) >= best_cost) { continue; }
+
+        int left = 2 * node + 1;
+        int right = 2 * node + 2;
+
+        if (left >= tree.nnodes())
+        {
+            for (int s = start; s < stop; s++)
+            {
+                int i = tree.indices(s);
+
+                if (curr_index != -1 && abs(i - curr_index) < ignore_surrounding) { continue; }
+
+                float curr_cost = feature_distance(query_normalized.data, tree.features(s).data, nfeatures, transition_cost, best_cost);
+
+                if (curr_cost < best_cost)
+                {
+                    best_index = i;
+                    best_cost = curr_cost;
+                }
+            }
+
+            nleaves++;
+            if (max_leaves > 0 && nleaves >= max_leaves) { break; }
+            continue;
+        }
+
+        int mid = (start + stop) / 2;
+        float left_cost = bound_distance(query_normalized.data, tree.node_min(left).data, tree.node_max(left).data, nfeatures, transition_cost, best_cost);
+        float right_cost = bound_distance(query_normalized.data, tree.node_min(right).data, tree.node_max(right).data, nfeatures, transition_cost, best_cost);
+
+        // Push the further child first so the nearer is visited first
+        bool left_first = left_cost <= right_cost;
+
+        for (int c = 0; c < 2; c++)
+        {
+            bool push_left = (c == 0) != left_first;
+            float child_cost = push_left ? left_cost : right_cost;
+
+            if (child_cost < best_cost)
+            {
+                stack_nodes(nstack) = push_left ? left : right;
+                stack_starts(nstack) = push_left ? start : mid;
+                stack_stops(nstack) = push_left ? mid : stop;
+                stack_costs(nstack) = child_cost;
+                nstack++;
+            }
+        }
+    }
+}
+
+// Clamps `frame + offset` to the range containing `frame`
+static inline int database_trajectory_index_clamp(const database& db, int frame, int offset)
+{
+    for (int i = 0; i < db.nranges(); i++)
+    {
+        if (frame >= db.range_starts(i) && frame < db.range_stops(i))
+        {
+            return clamp(frame + offset, db.range_starts(i), db.range_stops(i) - 1);
+        }
+    }
+
+    assert(false);
+    return -1;
+}
+
+// Normalizes into the first `nfeatures` entries of `query_normalized`
+// and zeros the rest, which may be padding
+static inline void database_normalize_query(
+    slice1d<float> query_normalized,
+    const database& db,
+    const slice1d<float> query)
+{
+    assert(query_normalized.size >= db.nfeatures() && query.size == db.nfeatures());
+
+    for (int i = 0; i < db.nfeatures(); i++)
+    {
+        query_normalized(i) = (query(i) - db.features_offset(i)) / db.features_scale(i);
+    }
+
+    for (int i = db.nfeatures(); i < query_normalized.size; i++)
+    {
+        query_normalized(i) = 0.0f;
+    }
+}
+
+// The padded features and the bounds only exist once the whole 
+// database is in memory, otherwise the unpadded features are 
+// searched without bounds.
+static inline bool database_search_padded(const database& db)
+{
+    if (db.stream != NULL && stream_get_state(*db.stream) != STREAM_DONE) { return false; }
+
+    return db.nframes() > 0 && db.features_padded.rows == db.nframes();
+}
+
+// Number of ranges which can be searched, which is fewer than 
+// all of them while the database is streaming in. At most
+// `nranges` if it is not -1.
+static inline int database_nranges_ready(const database& db, const int nranges = -1)
+{
+    int nready = db.stream != NULL ? stream_ranges_ready(*db.stream) : db.nranges();
+    return nranges == -1 ? nready : mini(nranges, nready);
+}
+
+// Searches the database for the frame closest to `query`. On 
+// input `best_index` is the current frame, or -1 to search 
+// without one. Only the first `nranges` ranges are searched, 
+// and never those still streaming in. Set `use_bounds` to false 
+// to compare every frame.
+static inline void database_search(
+    int& best_index,
+    float& best_cost,
+    const database& db,
+    const slice1d<float> query,
+    const float transition_cost = 0.0f,
+    const int ignore_range_end = 20,
+    const int ignore_surrounding = 20,
+    const int nranges = -1,
+    const bool use_bounds = true)
+{
+    frame_arena_scope scratch;
+
+    bool padded = database_search_padded(db);
+
+    // Normalize Query
+    array1d<float, frame_allocator> query_normalized(padded ? db.nfeatures_padded() : db.nfeatures());
+    database_normalize_query(query_normalized, db, query);
+
+    int nready = database_nranges_ready(db, nranges);
+    slice1d<int> range_starts(nready, db.range_starts.data);
+    slice1d<int> range_stops(nready, db.range_stops.data);
+
+    if (use_bounds && padded && db.bound_sm_min.rows > 0)
+    {
+        motion_matching_search(
+            best_index,
+            best_cost,
+            range_starts,
+            range_stops,
+            db.features_padded,
+            db.bound_sm_min,
+            db.bound_sm_max,
+            db.bound_lr_min,
+            db.bound_lr_max,
+            query_normalized,
+            transition_cost,
+            ignore_range_end,
+            ignore_surrounding);
+    }
+    else
+    {
+        motion_matching_search_brute_force(
+            best_index,
+            best_cost,
+            range_starts,
+            range_stops,
+            padded ? (slice2d<float>)db.features_padded : db.features,
+            query_normalized,
+            transition_cost,
+            ignore_range_end,
+            ignore_surrounding);
+    }
+}
+
+// Squared distance between two queries in normalized feature 
+// space, used to tell how much the query has changed since the 
+// last search
+static inline float database_query_drift(
+    const database& db,
+    const slice1d<float> query,
+    const slice1d<float> query_prev)
+{
+    assert(query.size == db.nfeatures() && query_prev.size == db.nfeatures());
+
+    float drift = 0.0f;
+    for (int i = 0; i < db.nfeatures(); i++)
+    {
+        drift += squaref((query(i) - query_prev(i)) / db.features_scale(i));
+    }
+    return drift;
+}
+
+// Cheap search of only the frames within `radius` of the current 
+// frame `best_index` in the same range, still skipping those within 
+// `ignore_surrounding`. Meant for when the query has barely changed 
+// since the last full search.
+static inline void database_search_local(
+    int& best_index,
+    float& best_cost,
+    const database& db,
+    const slice1d<float> query,
+    const int radius = 60,
+    const float transition_cost = 0.0f,
+    const int ignore_range_end = 20,
+    const int ignore_surrounding = 20)
+{
+    assert(best_index != -1);
+
+    frame_arena_scope scratch;
+
+    bool padded = database_search_padded(db);
+
+    array1d<float, frame_allocator> query_normalized(padded ? db.nfeatures_padded() : db.nfeatures());
+    database_normalize_query(query_normalized, db, query);
+
+    for (int r = 0; r < database_nranges_ready(db); r++)
+    {
+        if (best_index >= db.range_starts(r) && best_index < db.range_stops(r))
+        {
+            int start = maxi(db.range_starts(r), best_index - radius);
+            int stop = mini(db.range_stops(r) - ignore_range_end, best_index + radius + 1);
+
+            motion_matching_search_brute_force(
+                best_index,
+                best_cost,
+                slice1d<int>(1, &start),
+                slice1d<int>(1, &stop),
+                padded ? (slice2d<float>)db.features_padded : db.features,
+                query_normalized,
+                transition_cost,
+                0,
+                ignore_surrounding);
+
+            return;
+        }
+    }
+}
+
+// Same as `database_search` but skipping frames using the 
+// quantized features before comparing them exactly. Falls back 
+// to `database_search` if the quantized features have not been 
+// built.
+//
+// This only pays off when the exact features no longer fit in 
+// cache. The boxes already skip most frames, so the quantized 
+// features only save memory traffic on the few frames left, and 
+// for databases which fit in cache checking them first can cost 
+// more than it saves.
+static inline void database_search_quantized(
+    int& best_index,
+    float& best_cost,
+    const database& db,
+    const slice1d<float> query,
+    const float transition_cost = 0.0f,
+    const int ignore_range_end = 20,
+    const int ignore_surrounding = 20,
+    const int nranges = -1)
+{
+    if (!database_search_padded(db) ||
+        db.bound_sm_min.rows == 0 ||
+        db.features_quantized.format == QUANTIZED_NONE ||
+        db.features_quantized.rows() != db.nframes())
+    {
+        database_search(best_index, best_cost, db, query, transition_cost, ignore_range_end, ignore_surrounding, nranges);
+        return;
+    }
+
+    frame_arena_scope scratch;
+
+    array1d<float, frame_allocator> query_normalized(db.nfeatures_padded());
+    database_normalize_query(query_normalized, db, query);
+
+    int nready = database_nranges_ready(db, nranges);
+
+    motion_matching_search_quantized(
+        best_index,
+        best_cost,
+        slice1d<int>(nready, db.range_starts.data),
+        slice1d<int>(nready, db.range_stops.data),
+        db.features_padded,
+        db.features_quantized,
+        db.bound_sm_min,
+        db.bound_sm_max,
+        db.bound_lr_min,
+        db.bound_lr_max,
+        query_normalized,
+        transition_cost,
+        ignore_range_end,
+        ignore_surrounding);
+}
+
+// Same as `database_search` but using the kd-tree, visiting at 
+// most `max_leaves` leaves. Falls back to `database_search` if 
+// the kd-tree has not been built. The kd-tree always searches all 
+// ranges and ignores the ends of ranges given when it was built.
+static inline void database_search_kdtree(
+    int& best_index,
+    float& best_cost,
+    const database& db,
+    const slice1d<float> query,
+    const int max_leaves = 32,
+    const float transition_cost = 0.0f,
+    const int ignore_surrounding = 20)
+{
+    if (!database_search_padded(db) ||
+        db.features_kdtree.nfeatures() != db.nfeatures_padded() ||
+        db.features_kdtree.nslots() == 0)
+    {
+        database_search(best_index, best_cost, db, query, transition_cost, 20, ignore_surrounding);
+        return;
+    }
+
+    frame_arena_scope scratch;
+
+    array1d<float, frame_allocator> query_normalized(db.nfeatures_padded());
+    database_normalize_query(query_normalized, db, query);
+
+    motion_matching_search_kdtree(
+        best_index,
+        best_cost,
+        db.features_padded,
+        db.features_kdtree,
+        query_normalized,
+        max_leaves,
+        transition_cost,
+        ignore_surrounding);
+}
+
+// Same as `database_search` but for one query per row of 
+// `queries`, with the current frames and results given by
+// `best_indices` and `best_costs`.
+static inline void database_search_batch(
+    slice1d<int> best_indices,
+    slice1d<float> best_costs,
+    const database& db,
+    const slice2d<float> queries,
+    const float transition_cost = 0.0f,
+    const int ignore_range_end = 20,
+    const int ignore_surrounding = 20,
+    const int nranges = -1,
+    const bool use_bounds = true)
+{
+    assert(best_indices.size == queries.rows && best_costs.size == queries.rows);
+
+    frame_arena_scope scratch;
+
+    bool padded = database_search_padded(db);
+
+    array2d<float, frame_allocator> queries_normalized(queries.rows, padded ? db.nfeatures_padded() : db.nfeatures());
+    for (int q = 0; q < queries.rows; q++)
+    {
+        database_normalize_query(queries_normalized(q), db, queries(q));
+    }
+
+    int nready = database_nranges_ready(db, nranges);
+    slice1d<int> range_starts(nready, db.range_starts.data);
+    slice1d<int> range_stops(nready, db.range_stops.data);
+
+    bool bounds = use_bounds && padded && db.bound_sm_min.rows > 0;
+    slice2d<float> empty(0, 0, NULL);
+
+    motion_matching_search_batch(
+        best_indices,
+        best_costs,
+        range_starts,
+        range_stops,
+        padded ? (slice2d<float>)db.features_padded : db.features,
+        bounds ? (slice2d<float>)db.bound_sm_min : empty,
+        bounds ? (slice2d<float>)db.bound_sm_max : empty,
+        bounds ? (slice2d<float>)db.bound_lr_min : empty,
+        bounds ? (slice2d<float>)db.bound_lr_max : empty,
+        queries_normalized,
+        transition_cost,
+        ignore_range_end,
+        ignore_surrounding);
+}
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMInference.h"
+
+#include <string.h>
+
+//--------------------------------------
+
+static void inference_task_run(void* data, const int t)
+{
+    inference_scheduler& s = *(inference_scheduler*)data;
+    const inference_task& task = s.tasks(t);
+
+    nnet_evaluate_batch(s.evaluations[task.group], *s.groups[task.group].nn, task.start, task.stop);
+}
+
+int inference_submit(inference_scheduler& s, const nnet* nn, const slice1d<float> input)
+{
+    assert(nn != NULL && input.size == nn->ninputs());
+
+    int ticket = s.requests.size;
+    int input_offset = s.request_inputs.size;
+
+    s.request_inputs.resize(input_offset + input.size);
+    memcpy(&s.request_inputs.data[input_offset], input.data, input.size * sizeof(float));
+
+    s.requests.resize(ticket + 1);
+    s.requests(ticket).nn = nn;
+    s.requests(ticket).input_offset = input_offset;
+    s.requests(ticket).group = -1;
+    s.requests(ticket).row = -1;
+
+    return ticket;
+}
+
+int inference_pending(const inference_scheduler& s)
+{
+    return s.requests.size;
+}
+
+static void inference_build_groups(inference_scheduler& s)
+{
+    s.ngroups = 0;
+
+    for (int r = 0; r < s.requests.size; r++)
+    {
+        inference_request& request = s.requests(r);
+
+        for (int g = 0; g < s.ngroups; g++)
+        {
+            if (s.groups[g].nn == request.nn)
+            {
+                request.group = g;
+                break;
+            }
+        }
+
+        if (request.group == -1)
+        {
+            assert(s.ngroups < INFERENCE_MAX_GROUPS);
+            request.group = s.ngroups++;
+            s.groups[request.group].nn = request.nn;
+            s.groups[request.group].nrows = 0;
+        }
+
+        request.row = s.groups[request.group].nrows++;
+    }
+
+    // Stack the inputs of each network and cut the rows into tasks
+    s.tasks.resize(0);
+
+    for (int g = 0; g < s.ngroups; g++)
+    {
+        nnet_batch_evaluation_resize(s.evaluations[g], *s.groups[g].nn, s.groups[g].nrows);
+
+        for (int start = 0; start < s.groups[g].nrows; start += INFERENCE_TASK_ROWS)
+        {
+            s.tasks.resize(s.tasks.size + 1);
+            s.tasks(s.tasks.size - 1).group = g;
+            s.tasks(s.tasks.size - 1).start = start;
+            s.tasks(s.tasks.size - 1).stop = mini(start + INFERENCE_TASK_ROWS, s.groups[g].nrows);
+        }
+    }
+
+    for (int r = 0; r < s.requests.size; r++)
+    {
+        const inference_request& request = s.requests(r);
+
+        memcpy(
+            s.evaluations[request.group].layers[0](request.row).data,
+            &s.request_inputs.data[request.input_offset],
+            request.nn->ninputs() * sizeof(float));
+    }
+}
+
+void inference_run(inference_scheduler& s)
+{
+    if (s.requests.size == 0)
+    {
+        s.results.resize(0);
+        return;
+    }
+
+    inference_build_groups(s);
+
+    worker_pool_run(s.workers, s.tasks.size, inference_task_run, &s);
+
+    s.results = s.requests;
+    s.requests.resize(0);
+    s.request_inputs.resize(0);
+}
+
+slice1d<float> inference_result(const inference_scheduler& s, const int ticket)
+{
+    assert(ticket >= 0 && ticket < s.results.size);
+
+    const inference_request& request = s.results(ticket);
+
+    return slice1d<float>(request.nn->noutputs(), s.evaluations[request.group].layers[request.nn->nlayers](request.row).data);
+}
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMArray.h"
+#include "MMNNet.h"
+#include "MMWorkers.h"
+
+//--------------------------------------
+
+// Gathers the network inputs of every character for a frame and
+// evaluates them together. Inputs for the same network are stacked
+// into the rows of one batch evaluation, which is cut into tasks
+// of `INFERENCE_TASK_ROWS` rows. Each task runs every layer of the
+// network as a small matrix-matrix product, so the weights are read
+// from memory once per task instead of once per character. Tasks
+// are spread over the workers of a `worker_pool`, which can be the
+// same pool the searches run on.
+
+enum
+{
+    INFERENCE_MAX_GROUPS = 16,
+    INFERENCE_TASK_ROWS = 16,
+};
+
+struct inference_request
+{
+    const nnet* nn;
+    int input_offset;
+    int group;
+    int row;
+};
+
+struct inference_group
+{
+    const nnet* nn;
+    int nrows;
+};
+
+struct inference_task
+{
+    int group;
+    int start;
+    int stop;
+};
+
+struct inference_scheduler
+{
+    // Submitted since the last run
+    array1d<inference_request> requests;
+    array1d<float> request_inputs;
+
+    // Requests of the last run, indexed by ticket, and the batch
+    // of each network holding their outputs
+    array1d<inference_request> results;
+    inference_group groups[INFERENCE_MAX_GROUPS];
+    nnet_batch_evaluation evaluations[INFERENCE_MAX_GROUPS];
+    int ngroups;
+
+    array1d<inference_task> tasks;
+
+    // Workers the tasks run on, or NULL for the calling thread only
+    worker_pool* workers;
+
+    inference_scheduler() : ngroups(0), workers(NULL) {}
+    inference_scheduler(const inference_scheduler&) = delete;
+    inference_scheduler& operator=(const inference_scheduler&) = delete;
+};
+
+// Queues the evaluation of a network on `input` and returns a
+// ticket for reading the output after the next `inference_run`.
+// At most `INFERENCE_MAX_GROUPS` different networks can be
+// queued per run. The network must stay loaded until the run.
+int inference_submit(inference_scheduler& s, const nnet* nn, const slice1d<float> input);
+
+int inference_pending(const inference_scheduler& s);
+
+// Evaluates every queued input, blocking until they are all done.
+// Outputs stay valid until the next run.
+void inference_run(inference_scheduler& s);
+
+// Output of the network for a ticket, `noutputs()` values long
+slice1d<float> inference_result(const inference_scheduler& s, const int ticket);
@@ -0,0 +1,181 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMKdTree.h"
+
+#include <algorithm>
+
+//--------------------------------------
+
+// Splits the slots of `node` at the median of its widest feature
+// and recurses, then fills in the node's bounding box
+static void kdtree_build_node(
+    kdtree& tree,
+    const slice2d<float> features,
+    const int node,
+    const int level,
+    const int start,
+    const int stop)
+{
+    int nfeatures = features.cols;
+    float* node_min = tree.node_min(node).data;
+    float* node_max = tree.node_max(node).data;
+
+    for (int j = 0; j < nfeatures; j++)
+    {
+        node_min[j] = FLT_MAX;
+        node_max[j] = -FLT_MAX;
+    }
+
+    for (int s = start; s < stop; s++)
+    {
+        const float* row = features(tree.indices(s)).data;
+        for (int j = 0; j < nfeatures; j++)
+        {
+            node_min[j] = minf(node_min[j], row[j]);
+            node_max[j] = maxf(node_max[j], row[j]);
+        }
+    }
+
+    if (level == tree.depth) { return; }
+
+    int split = 0;
+    for (int j = 1; j < nfeatures; j++)
+    {
+        if (node_max[j] - node_min[j] > node_max[split] - node_min[split])
+        {
+            split = j;
+        }
+    }
+
+    int mid = (start + stop) / 2;
+    std::nth_element(
+        tree.indices.data + start,
+        tree.indices.data + mid,
+        tree.indices.data + stop,
+        [&](int a, int b) { return features(a, split) < features(b, split); });
+
+    kdtree_build_node(tree, features, 2 * node + 1, level + 1, start, mid);
+    kdtree_build_node(tree, features, 2 * node + 2, level + 1, mid, stop);
+}
+
+void kdtree_build(
+    kdtree& tree,
+    const slice2d<float> features,
+    const slice1d<int> range_starts,
+    const slice1d<int> range_stops,
+    const int leaf_size,
+    const int ignore_range_end)
+{
+    assert(leaf_size > 0);
+
+    tree.leaf_size = leaf_size;
+    tree.ignore_range_end = ignore_range_end;
+
+    int nslots = 0;
+    for (int r = 0; r < range_starts.size; r++)
+    {
+        nslots += maxi(range_stops(r) - ignore_range_end - range_starts(r), 0);
+    }
+
+    tree.indices.resize(nslots);
+
+    nslots = 0;
+    for (int r = 0; r < range_starts.size; r++)
+    {
+        for (int i = range_starts(r); i < range_stops(r) - ignore_range_end; i++)
+        {
+            tree.indices(nslots++) = i;
+        }
+    }
+
+    // Deep enough that every leaf holds at most `leaf_size` slots
+    tree.depth = 0;
+    while ((nslots + (1 << tree.depth) - 1) >> tree.depth > leaf_size)
+    {
+        tree.depth++;
+    }
+
+    int nnodes = (2 << tree.depth) - 1;
+    tree.node_min.resize(nnodes, features.cols);
+    tree.node_max.resize(nnodes, features.cols);
+
+    kdtree_build_node(tree, features, 0, 0, 0, nslots);
+
+    // Copy the features into leaf order so leaves are contiguous
+    tree.features.resize(nslots, features.cols);
+    for (int s = 0; s < nslots; s++)
+    {
+        memcpy(tree.features(s).data, features(tree.indices(s)).data, features.cols * sizeof(float));
+    }
+}
+
+void kdtree_release(kdtree& tree)
+{
+    tree.leaf_size = 0;
+    tree.depth = 0;
+    tree.ignore_range_end = 0;
+    tree.node_min.release();
+    tree.node_max.release();
+    tree.indices.release();
+    tree.features.release();
+}
+
+void kdtree_write(const kdtree& tree, FILE* f)
+{
+    array1d<int> params(3);
+    params(0) = tree.leaf_size;
+    params(1) = tree.depth;
+    params(2) = tree.ignore_range_end;
+
+    array1d_write(params, f);
+    array2d_write(tree.node_min, f);
+    array2d_write(tree.node_max, f);
+    array1d_write(tree.indices, f);
+    array2d_write(tree.features, f);
+}
+
+bool kdtree_read(kdtree& tree, FILE* f)
+{
+    array1d<int> params;
+
+    bool ok =
+        array1d_read(params, f) && params.size == 3 &&
+        array2d_read(tree.node_min, f) &&
+        array2d_read(tree.node_max, f) &&
+        array1d_read(tree.indices, f) &&
+        array2d_read(tree.features, f);
+
+    if (!ok) { return false; }
+
+    tree.leaf_size = params(0);
+    tree.depth = params(1);
+    tree.ignore_range_end = params(2);
+
+    return
+        tree.depth >= 0 && tree.depth < 30 &&
+        tree.node_min.rows == (2 << tree.depth) - 1 &&
+        tree.node_max.rows == tree.node_min.rows &&
+        tree.node_min.cols == tree.features.cols &&
+        tree.node_max.cols == tree.features.cols &&
+        tree.features.rows == tree.indices.size;
+}
+
+bool kdtree_save(const kdtree& tree, const char* filename)
+{
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) { return false; }
+
+    kdtree_write(tree, f);
+    return fclose(f) == 0;
+}
+
+bool kdtree_load(kdtree& tree, const char* filename)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) { return false; }
+
+    bool ok = kdtree_read(tree, f);
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+
+#include <float.h>
+#include <stdio.h>
+
+//--------------------------------------
+
+// Approximate nearest neighbour index for databases too large for
+// the AABB search. Frames are recursively split in half at the
+// median of the feature with the largest spread, giving a complete
+// binary tree whose leaves hold at most `leaf_size` frames. The
+// frames are stored in leaf order with a bounding box for every
+// node, so the implicit node `k` has children `2k+1` and `2k+2`
+// and covers a contiguous span of slots.
+//
+// A search descends to the nearest leaf first and then backtracks
+// into any node whose box is closer than the best frame so far,
+// visiting at most `max_leaves` leaves. With `max_leaves` set to
+// zero the search is exact.
+
+struct kdtree
+{
+    int leaf_size;
+    int depth;
+    int ignore_range_end;
+
+    // Per node, padded like the database features
+    array2d<float> node_min;
+    array2d<float> node_max;
+
+    // Per slot, the database frame and its features
+    array1d<int> indices;
+    array2d<float> features;
+
+    kdtree() : leaf_size(0), depth(0), ignore_range_end(0) {}
+
+    int nslots() const { return indices.size; }
+    int nnodes() const { return node_min.rows; }
+    int nfeatures() const { return features.cols; }
+};
+
+// Frames in the last `ignore_range_end` frames of each range
+// are left out of the tree, so searches skip them for free.
+void kdtree_build(
+    kdtree& tree,
+    const slice2d<float> features,
+    const slice1d<int> range_starts,
+    const slice1d<int> range_stops,
+    const int leaf_size = 32,
+    const int ignore_range_end = 20);
+
+void kdtree_release(kdtree& tree);
+
+// Saved with `array1d_write` and `array2d_write`, after a small
+// array holding `leaf_size`, `depth` and `ignore_range_end`.
+void kdtree_write(const kdtree& tree, FILE* f);
+bool kdtree_read(kdtree& tree, FILE* f);
+
+bool kdtree_save(const kdtree& tree, const char* filename);
+bool kdtree_load(kdtree& tree, const char* filename);
@@ -0,0 +1,213 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMKinematics.h"
+
+//--------------------------------------
+
+bool kinematics_order_build(kinematics_order& k, const slice1d<int> bone_parents)
+{
+    array1d<int> required(bone_parents.size);
+    for (int i = 0; i < required.size; i++) { required(i) = i; }
+
+    return kinematics_order_build_partial(k, bone_parents, required);
+}
+
+bool kinematics_order_build_partial(
+    kinematics_order& k,
+    const slice1d<int> bone_parents,
+    const slice1d<int> required)
+{
+    const int nbones = bone_parents.size;
+
+    k.bones.resize(0);
+    k.level_starts.resize(1);
+    k.level_starts(0) = 0;
+    k.parents = bone_parents;
+
+    // Depth of every bone, found by walking up to the root. A walk
+    // longer than the number of bones has gone round a cycle.
+    array1d<int> depths(nbones);
+
+    for (int b = 0; b < nbones; b++)
+    {
+        int depth = 0;
+
+        for (int p = bone_parents(b); p != -1; p = bone_parents(p))
+        {
+            if (p < 0 || p >= nbones || depth >= nbones) { return false; }
+            depth++;
+        }
+
+        depths(b) = depth;
+    }
+
+    // Mark the required bones and everything above them
+    array1d<bool> used(nbones);
+    used.zero();
+
+    int max_depth = -1;
+
+    for (int i = 0; i < required.size; i++)
+    {
+        if (required(i) < 0 || required(i) >= nbones) { return false; }
+
+        for (int b = required(i); b != -1 && !used(b); b = bone_parents(b))
+        {
+            used(b) = true;
+            max_depth = maxi(max_depth, depths(b));
+        }
+    }
+
+    // Counting sort by depth, keeping bones of the same depth in order
+    k.level_starts.resize(max_depth + 2);
+    k.level_starts.zero();
+
+    for (int b = 0; b < nbones; b++)
+    {
+        if (used(b)) { k.level_starts(depths(b) + 1)++; }
+    }
+
+    for (int l = 0; l < max_depth + 1; l++)
+    {
+        k.level_starts(l + 1) += k.level_starts(l);
+    }
+
+    k.bones.resize(k.level_starts(max_depth + 1));
+
+    array1d<int> cursors(max_depth + 1);
+    for (int l = 0; l < cursors.size; l++) { cursors(l) = k.level_starts(l); }
+
+    for (int b = 0; b < nbones; b++)
+    {
+        if (used(b)) { k.bones(cursors(depths(b))++) = b; }
+    }
+
+    return true;
+}
+
+void forward_kinematics(
+    slice1d<vec3> global_positions,
+    slice1d<quat> global_rotations,
+    const slice1d<vec3> local_positions,
+    const slice1d<quat> local_rotations,
+    const kinematics_order& k)
+{
+    assert(local_positions.size == k.parents.size && local_rotations.size == k.parents.size);
+    assert(global_positions.size == k.parents.size && global_rotations.size == k.parents.size);
+
+    for (int i = 0; i < k.bones.size; i++)
+    {
+        int b = k.bones(i);
+        int p = k.parents(b);
+
+        if (p == -1)
+        {
+            global_positions(b) = local_positions(b);
+            global_rotations(b) = local_rotations(b);
+        }
+        else
+        {
+            global_positions(b) = quat_mul_vec3(global_rotations(p), local_positions(b)) + global_positions(p);
+            global_rotations(b) = quat_mul(global_rotations(p), local_rotations(b));
+        }
+    }
+}
+
+// Global transform of bone `b` of every character from its parent `p`
+static void forward_kinematics_bone_batch(
+    soa_vec3_slice global_positions,
+    soa_quat_slice global_rotations,
+    const soa_vec3_slice local_positions,
+    const soa_quat_slice local_rotations,
+    const int b,
+    const int p,
+    const int n)
+{
+    float* __restrict out_px = global_positions.x.data + b * n;
+    float* __restrict out_py = global_positions.y.data + b * n;
+    float* __restrict out_pz = global_positions.z.data + b * n;
+    float* __restrict out_rw = global_rotations.w.data + b * n;
+    float* __restrict out_rx = global_rotations.x.data + b * n;
+    float* __restrict out_ry = global_rotations.y.data + b * n;
+    float* __restrict out_rz = global_rotations.z.data + b * n;
+
+    const float* __restrict parent_px = global_positions.x.data + p * n;
+    const float* __restrict parent_py = global_positions.y.data + p * n;
+    const float* __restrict parent_pz = global_positions.z.data + p * n;
+    const float* __restrict parent_rw = global_rotations.w.data + p * n;
+    const float* __restrict parent_rx = global_rotations.x.data + p * n;
+    const float* __restrict parent_ry = global_rotations.y.data + p * n;
+    const float* __restrict parent_rz = global_rotations.z.data + p * n;
+
+    const float* __restrict local_px = local_positions.x.data + b * n;
+    const float* __restrict local_py = local_positions.y.data + b * n;
+    const float* __restrict local_pz = local_positions.z.data + b * n;
+    const float* __restrict local_rw = local_rotations.w.data + b * n;
+    const float* __restrict local_rx = local_rotations.x.data + b * n;
+    const float* __restrict local_ry = local_rotations.y.data + b * n;
+    const float* __restrict local_rz = local_rotations.z.data + b * n;
+
+    for (int c = 0; c < n; c++)
+    {
+        float qw = parent_rw[c], qx = parent_rx[c], qy = parent_ry[c], qz = parent_rz[c];
+        float vx = local_px[c], vy = local_py[c], vz = local_pz[c];
+
+        // Same as `quat_mul_vec3`
+        float tx = 2.0f * (qy * vz - qz * vy);
+        float ty = 2.0f * (qz * vx - qx * vz);
+        float tz = 2.0f * (qx * vy - qy * vx);
+
+        out_px[c] = vx + qw * tx + (qy * tz - qz * ty) + parent_px[c];
+        out_py[c] = vy + qw * ty + (qz * tx - qx * tz) + parent_py[c];
+        out_pz[c] = vz + qw * tz + (qx * ty - qy * tx) + parent_pz[c];
+
+        // Same as `quat_mul`
+        float pw = local_rw[c], px = local_rx[c], py = local_ry[c], pz = local_rz[c];
+
+        out_rw[c] = pw * qw - px * qx - py * qy - pz * qz;
+        out_rx[c] = pw * qx + px * qw - py * qz + pz * qy;
+        out_ry[c] = pw * qy + px * qz + py * qw - pz * qx;
+        out_rz[c] = pw * qz - px * qy + py * qx + pz * qw;
+    }
+}
+
+void forward_kinematics_batch(
+    soa_vec3_slice global_positions,
+    soa_quat_slice global_rotations,
+    const soa_vec3_slice local_positions,
+    const soa_quat_slice local_rotations,
+    const kinematics_order& k,
+    const int ncharacters)
+{
+    const int n = ncharacters;
+
+    assert(local_positions.size() == k.parents.size * n && local_rotations.size() == k.parents.size * n);
+    assert(global_positions.size() == k.parents.size * n && global_rotations.size() == k.parents.size * n);
+
+    for (int i = 0; i < k.bones.size; i++)
+    {
+        int b = k.bones(i);
+        int p = k.parents(b);
+
+        if (p == -1)
+        {
+            soa_vec3_slice out_p = global_positions.range(b * n, n);
+            soa_quat_slice out_r = global_rotations.range(b * n, n);
+            const soa_vec3_slice in_p = local_positions.range(b * n, n);
+            const soa_quat_slice in_r = local_rotations.range(b * n, n);
+
+            for (int c = 0; c < n; c++) { out_p.set(c, in_p(c)); }
+            for (int c = 0; c < n; c++) { out_r.set(c, in_r(c)); }
+        }
+        else
+        {
+            forward_kinematics_bone_batch(
+                global_positions,
+                global_rotations,
+                local_positions,
+                local_rotations,
+                b, p, n);
+        }
+    }
+}
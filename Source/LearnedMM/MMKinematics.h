@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+#include "MMSoa.h"
+
+//--------------------------------------
+
+// Forward kinematics, computing global bone transforms from local
+// ones. Rather than walking up the chain of parents for each bone,
+// the bones are sorted once by their depth in the hierarchy, so a
+// single pass in that order always finds the parent's global
+// transform already computed. Bones at the same depth never depend
+// on each other.
+//
+// The batched version poses many characters at once. Its arrays
+// are stored bone major, so bone `b` of character `c` is at
+// `b * ncharacters + c`, and each bone is one branchless loop over
+// the characters which the compiler vectorizes.
+//
+// An order can also be built for only some of the bones, along
+// with their ancestors, when only those are needed, such as the
+// feet and hips used as features. The other bones are not written.
+
+struct kinematics_order
+{
+    // Bones to compute, by depth then by index
+    array1d<int> bones;
+
+    // Where each depth starts in `bones`, plus the end
+    array1d<int> level_starts;
+
+    // Parent of every bone of the skeleton, -1 for roots
+    array1d<int> parents;
+
+    inline int nlevels() const { return level_starts.size - 1; }
+};
+
+// Order for every bone. Returns false if a parent is out of range
+// or the parents form a cycle.
+bool kinematics_order_build(kinematics_order& k, const slice1d<int> bone_parents);
+
+// Order for `required` bones and the bones they hang from
+bool kinematics_order_build_partial(
+    kinematics_order& k,
+    const slice1d<int> bone_parents,
+    const slice1d<int> required);
+
+// Writes the global transforms of the bones in `k`
+void forward_kinematics(
+    slice1d<vec3> global_positions,
+    slice1d<quat> global_rotations,
+    const slice1d<vec3> local_positions,
+    const slice1d<quat> local_rotations,
+    const kinematics_order& k);
+
+// Same for `ncharacters` characters sharing a skeleton, stored
+// bone major. Outputs must not be the same arrays as inputs.
+void forward_kinematics_batch(
+    soa_vec3_slice global_positions,
+    soa_quat_slice global_rotations,
+    const soa_vec3_slice local_positions,
+    const soa_quat_slice local_rotations,
+    const kinematics_order& k,
+    const int ncharacters);
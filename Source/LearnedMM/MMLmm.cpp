@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMLmm.h"
+
+#include <mutex>
+#include <string.h>
+
+//--------------------------------------
+
+bool lmm_load(
+    lmm& l,
+    const char* decompressor_filename,
+    const char* stepper_filename,
+    const char* projector_filename,
+    const char* features_filename,
+    const int activation)
+{
+    if (!nnet_load(l.decompressor, decompressor_filename, activation) ||
+        !nnet_load(l.stepper, stepper_filename, activation) ||
+        !nnet_load(l.projector, projector_filename, activation))
+    {
+        return false;
+    }
+
+    // Only the normalization and the first frame are kept
+    array2d<float> features;
+
+    FILE* f = fopen(features_filename, "rb");
+    if (f == NULL) { return false; }
+
+    bool ok =
+        array2d_read(features, f) &&
+        array1d_read(l.features_offset, f) &&
+        array1d_read(l.features_scale, f);
+
+    fclose(f);
+
+    int nfeatures = features.cols;
+    int nlatent = l.projector.noutputs() - nfeatures;
+
+    if (!ok ||
+        features.rows == 0 ||
+        l.features_offset.size != nfeatures ||
+        l.features_scale.size != nfeatures ||
+        l.projector.ninputs() != nfeatures ||
+        nlatent <= 0 ||
+        l.stepper.ninputs() != nfeatures + nlatent ||
+        l.stepper.noutputs() != nfeatures + nlatent ||
+        l.decompressor.ninputs() != nfeatures + nlatent ||
+        (l.decompressor.noutputs() - 6) % 15 != 0)
+    {
+        return false;
+    }
+
+    array1d<float> query(nfeatures);
+    for (int i = 0; i < nfeatures; i++)
+    {
+        query(i) = features(0, i) * l.features_scale(i) + l.features_offset(i);
+    }
+
+    l.initial_features.resize(nfeatures);
+    l.initial_latent.resize(nlatent);
+
+    nnet_evaluation evaluation;
+    nnet_evaluation_resize(evaluation, l.projector);
+    projector_evaluate(l.initial_features, l.initial_latent, evaluation, l.projector, query);
+
+    return true;
+}
+
+//--------------------------------------
+
+struct lmm_entry
+{
+    lmm l;
+    char* filenames;
+    int refs;
+    lmm_entry* next;
+};
+
+static std::mutex lmms_mutex;
+static lmm_entry* lmms = NULL;
+
+// Entries are keyed on all their filenames joined by newlines
+static char* lmm_filenames_join(
+    const char* decompressor_filename,
+    const char* stepper_filename,
+    const char* projector_filename,
+    const char* features_filename)
+{
+    const char* parts[4] = { decompressor_filename, stepper_filename, projector_filename, features_filename };
+
+    size_t length = 0;
+    for (int i = 0; i < 4; i++) { length += strlen(parts[i]) + 1; }
+
+    char* filenames = (char*)malloc(length);
+    char* curr = filenames;
+    for (int i = 0; i < 4; i++)
+    {
+        size_t part_length = strlen(parts[i]);
+        memcpy(curr, parts[i], part_length);
+        curr[part_length] = i == 3 ? '\0' : '\n';
+        curr += part_length + 1;
+    }
+
+    return filenames;
+}
+
+const lmm* lmm_acquire(
+    const char* decompressor_filename,
+    const char* stepper_filename,
+    const char* projector_filename,
+    const char* features_filename)
+{
+    char* filenames = lmm_filenames_join(decompressor_filename, stepper_filename, projector_filename, features_filename);
+
+    std::lock_guard<std::mutex> lock(lmms_mutex);
+
+    for (lmm_entry* entry = lmms; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->filenames, filenames) == 0)
+        {
+            free(filenames);
+            entry->refs++;
+            return &entry->l;
+        }
+    }
+
+    lmm_entry* entry = new lmm_entry();
+
+    if (!lmm_load(entry->l, decompressor_filename, stepper_filename, projector_filename, features_filename))
+    {
+        free(filenames);
+        delete entry;
+        return NULL;
+    }
+
+    entry->filenames = filenames;
+    entry->refs = 1;
+    entry->next = lmms;
+    lmms = entry;
+    return &entry->l;
+}
+
+void lmm_release(const lmm* l)
+{
+    if (l == NULL) { return; }
+
+    std::lock_guard<std::mutex> lock(lmms_mutex);
+
+    for (lmm_entry** curr = &lmms; *curr != NULL; curr = &(*curr)->next)
+    {
+        lmm_entry* entry = *curr;
+
+        if (&entry->l == l)
+        {
+            if (--entry->refs == 0)
+            {
+                *curr = entry->next;
+                free(entry->filenames);
+                delete entry;
+            }
+            return;
+        }
+    }
+}
@@ -0,0 +1,343 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+#include "MMNNet.h"
+
+//--------------------------------------
+
+// Learned Motion Matching replaces the animation database with
+// three networks. The projector finds the features and latent
+// values of the best match for a query, the stepper advances
+// them by one frame and the decompressor turns them back into a
+// pose. Only the networks and the feature normalization are kept
+// in memory.
+
+struct lmm
+{
+    nnet decompressor;
+    nnet stepper;
+    nnet projector;
+
+    // Used to denormalize the pose part of the query
+    array1d<float> features_offset;
+    array1d<float> features_scale;
+
+    // Projection of the first frame of the database, to start from
+    array1d<float> initial_features;
+    array1d<float> initial_latent;
+
+    int nfeatures() const { return features_offset.size; }
+    int nlatent() const { return initial_latent.size; }
+
+    // The decompressor outputs a position, rotation, velocity and
+    // angular velocity for every bone but the root, then the root
+    // velocity and angular velocity
+    int nbones() const { return (decompressor.noutputs() - 6) / 15 + 1; }
+};
+
+// Loads the networks and the feature normalization from
+// `features.bin`. Returns false if a file is missing or the
+// networks do not fit together.
+bool lmm_load(
+    lmm& l,
+    const char* decompressor_filename,
+    const char* stepper_filename,
+    const char* projector_filename,
+    const char* features_filename,
+    const int activation = NNET_RELU);
+
+// Like databases the networks are read only, so characters
+// using the same files share them. Returns NULL if loading fails.
+const lmm* lmm_acquire(
+    const char* decompressor_filename,
+    const char* stepper_filename,
+    const char* projector_filename,
+    const char* features_filename);
+
+void lmm_release(const lmm* l);
+
+// Squared distance between two queries in normalized feature 
+// space, the same as `database_query_drift`. Used to project again 
+// early when the trajectory has moved on since the last projection.
+static inline float lmm_query_drift(
+    const lmm& l,
+    const slice1d<float> query,
+    const slice1d<float> query_prev)
+{
+    assert(query.size == l.nfeatures() && query_prev.size == l.nfeatures());
+
+    float drift = 0.0f;
+    for (int i = 0; i < l.nfeatures(); i++)
+    {
+        drift += squaref((query(i) - query_prev(i)) / l.features_scale(i));
+    }
+    return drift;
+}
+
+//--------------------------------------
+
+// Time spent in each network. The stepper and decompressor run 
+// every update while the projector only runs when searching, so 
+// their costs are kept apart.
+
+enum lmm_stage
+{
+    LMM_STEPPER,
+    LMM_PROJECTOR,
+    LMM_DECOMPRESSOR,
+    LMM_STAGE_COUNT,
+};
+
+struct lmm_stats
+{
+    int evaluations[LMM_STAGE_COUNT];
+    double seconds[LMM_STAGE_COUNT];
+    int frames;
+    float elapsed;
+
+    // Averages over the last whole second
+    float ms_per_frame[LMM_STAGE_COUNT];
+    float evaluations_per_second[LMM_STAGE_COUNT];
+
+    lmm_stats() : frames(0), elapsed(0.0f)
+    {
+        for (int i = 0; i < LMM_STAGE_COUNT; i++)
+        {
+            evaluations[i] = 0;
+            seconds[i] = 0.0;
+            ms_per_frame[i] = 0.0f;
+            evaluations_per_second[i] = 0.0f;
+        }
+    }
+};
+
+static inline void lmm_stats_record(lmm_stats& s, const int stage, const double seconds)
+{
+    s.evaluations[stage]++;
+    s.seconds[stage] += seconds;
+}
+
+// Called once a frame. Returns true when new averages are available.
+static inline bool lmm_stats_update(lmm_stats& s, const float dt)
+{
+    s.frames++;
+    s.elapsed += dt;
+    if (s.elapsed < 1.0f) { return false; }
+
+    for (int i = 0; i < LMM_STAGE_COUNT; i++)
+    {
+        s.ms_per_frame[i] = (float)(1000.0 * s.seconds[i] / s.frames);
+        s.evaluations_per_second[i] = s.evaluations[i] / s.elapsed;
+        s.evaluations[i] = 0;
+        s.seconds[i] = 0.0;
+    }
+
+    s.frames = 0;
+    s.elapsed = 0.0f;
+    return true;
+}
+
+//--------------------------------------
+
+// Each network is evaluated either alone, by the `_evaluate`
+// functions, or batched with other characters' by an inference
+// scheduler, in which case the input is filled and the output
+// applied separately.
+
+// Input of the decompressor and stepper, features then latent values
+static inline void lmm_network_input(
+    slice1d<float> input,
+    const slice1d<float> features,
+    const slice1d<float> latent)
+{
+    assert(input.size == features.size + latent.size);
+
+    for (int i = 0; i < features.size; i++)
+    {
+        input(i) = features(i);
+    }
+
+    for (int i = 0; i < latent.size; i++)
+    {
+        input(features.size + i) = latent(i);
+    }
+}
+
+// Turns the decompressor's output into a pose, moving the root
+// from `root_position` and `root_rotation` by the velocities the
+// network predicts over `dt`
+static inline void decompressor_apply(
+    slice1d<vec3> bone_positions,
+    slice1d<vec3> bone_velocities,
+    slice1d<quat> bone_rotations,
+    slice1d<vec3> bone_angular_velocities,
+    vec3& root_velocity,
+    vec3& root_angular_velocity,
+    const slice1d<float> output_layer,
+    const vec3 root_position,
+    const quat root_rotation,
+    const float dt)
+{
+    int offset = 0;
+
+    for (int i = 0; i < bone_positions.size - 1; i++)
+    {
+        bone_positions(i + 1) = vec3(
+            output_layer(offset + i * 3 + 0),
+            output_layer(offset + i * 3 + 1),
+            output_layer(offset + i * 3 + 2));
+    }
+    offset += (bone_positions.size - 1) * 3;
+
+    // Rotations are given by the first two columns of their matrix
+    for (int i = 0; i < bone_rotations.size - 1; i++)
+    {
+        bone_rotations(i + 1) = quat_from_xform_xy(
+            vec3(output_layer(offset + i * 6 + 0), output_layer(offset + i * 6 + 2), output_layer(offset + i * 6 + 4)),
+            vec3(output_layer(offset + i * 6 + 1), output_layer(offset + i * 6 + 3), output_layer(offset + i * 6 + 5)));
+    }
+    offset += (bone_rotations.size - 1) * 6;
+
+    for (int i = 0; i < bone_velocities.size - 1; i++)
+    {
+        bone_velocities(i + 1) = vec3(
+            output_layer(offset + i * 3 + 0),
+            output_layer(offset + i * 3 + 1),
+            output_layer(offset + i * 3 + 2));
+    }
+    offset += (bone_velocities.size - 1) * 3;
+
+    for (int i = 0; i < bone_angular_velocities.size - 1; i++)
+    {
+        bone_angular_velocities(i + 1) = vec3(
+            output_layer(offset + i * 3 + 0),
+            output_layer(offset + i * 3 + 1),
+            output_layer(offset + i * 3 + 2));
+    }
+    offset += (bone_angular_velocities.size - 1) * 3;
+
+    // Root velocities are local to the root
+    root_velocity = quat_mul_vec3(root_rotation, vec3(output_layer(offset + 0), output_layer(offset + 1), output_layer(offset + 2)));
+    root_angular_velocity = quat_mul_vec3(root_rotation, vec3(output_layer(offset + 3), output_layer(offset + 4), output_layer(offset + 5)));
+    offset += 6;
+
+    assert(offset == output_layer.size);
+
+    bone_positions(0) = dt * root_velocity + root_position;
+    bone_rotations(0) = quat_mul(quat_from_scaled_angle_axis(root_angular_velocity * dt), root_rotation);
+    bone_velocities(0) = root_velocity;
+    bone_angular_velocities(0) = root_angular_velocity;
+}
+
+// Decompresses features and latent values into a pose
+static inline void decompressor_evaluate(
+    slice1d<vec3> bone_positions,
+    slice1d<vec3> bone_velocities,
+    slice1d<quat> bone_rotations,
+    slice1d<vec3> bone_angular_velocities,
+    vec3& root_velocity,
+    vec3& root_angular_velocity,
+    nnet_evaluation& evaluation,
+    const nnet& decompressor,
+    const slice1d<float> features,
+    const slice1d<float> latent,
+    const vec3 root_position,
+    const quat root_rotation,
+    const float dt)
+{
+    lmm_network_input(evaluation.input(), features, latent);
+
+    nnet_evaluate(evaluation, decompressor);
+
+    decompressor_apply(
+        bone_positions,
+        bone_velocities,
+        bone_rotations,
+        bone_angular_velocities,
+        root_velocity,
+        root_angular_velocity,
+        evaluation.output(),
+        root_position,
+        root_rotation,
+        dt);
+}
+
+// The stepper predicts velocities, which advance the features and
+// latent values by `dt`
+static inline void stepper_apply(
+    slice1d<float> features,
+    slice1d<float> latent,
+    const slice1d<float> output_layer,
+    const float dt)
+{
+    assert(output_layer.size == features.size + latent.size);
+
+    for (int i = 0; i < features.size; i++)
+    {
+        features(i) += dt * output_layer(i);
+    }
+
+    for (int i = 0; i < latent.size; i++)
+    {
+        latent(i) += dt * output_layer(features.size + i);
+    }
+}
+
+static inline void stepper_evaluate(
+    slice1d<float> features,
+    slice1d<float> latent,
+    nnet_evaluation& evaluation,
+    const nnet& stepper,
+    const float dt)
+{
+    lmm_network_input(evaluation.input(), features, latent);
+
+    nnet_evaluate(evaluation, stepper);
+
+    stepper_apply(features, latent, evaluation.output(), dt);
+}
+
+// The projector's input is a query given in the same 
+// (denormalized) form as for a search. Its output is the features 
+// and latent values of the best match.
+static inline void projector_apply(
+    slice1d<float> features,
+    slice1d<float> latent,
+    const slice1d<float> output_layer)
+{
+    assert(output_layer.size == features.size + latent.size);
+
+    for (int i = 0; i < features.size; i++)
+    {
+        features(i) = output_layer(i);
+    }
+
+    for (int i = 0; i < latent.size; i++)
+    {
+        latent(i) = output_layer(features.size + i);
+    }
+}
+
+static inline void projector_evaluate(
+    slice1d<float> features,
+    slice1d<float> latent,
+    nnet_evaluation& evaluation,
+    const nnet& projector,
+    const slice1d<float> query)
+{
+    slice1d<float> input_layer = evaluation.input();
+
+    for (int i = 0; i < query.size; i++)
+    {
+        input_layer(i) = query(i);
+    }
+
+    nnet_evaluate(evaluation, projector);
+
+    projector_apply(features, latent, evaluation.output());
+}
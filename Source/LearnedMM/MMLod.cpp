@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMLod.h"
+
+#include <algorithm>
+
+//--------------------------------------
+
+int lod_add(lod_scheduler& s)
+{
+    int handle;
+
+    if (s.free_handles.size > 0)
+    {
+        handle = s.free_handles(s.free_handles.size - 1);
+        s.free_handles.resize(s.free_handles.size - 1);
+    }
+    else
+    {
+        handle = s.requested.size;
+        s.distances.resize(handle + 1);
+        s.requested.resize(handle + 1);
+        s.tiers.resize(handle + 1);
+    }
+
+    s.distances(handle) = 0.0f;
+    s.requested(handle) = LOD_FULL;
+    s.tiers(handle) = LOD_FULL;
+    return handle;
+}
+
+void lod_remove(lod_scheduler& s, const int handle)
+{
+    assert(s.requested(handle) != -1);
+
+    s.requested(handle) = -1;
+    s.free_handles.resize(s.free_handles.size + 1);
+    s.free_handles(s.free_handles.size - 1) = handle;
+}
+
+void lod_assign(lod_scheduler& s, const int max_full, const int max_reduced)
+{
+    s.order.resize(0);
+
+    for (int i = 0; i < s.requested.size; i++)
+    {
+        if (s.requested(i) == -1) { continue; }
+
+        s.order.resize(s.order.size + 1);
+        s.order(s.order.size - 1) = i;
+    }
+
+    std::sort(s.order.data, s.order.data + s.order.size, [&s](const int a, const int b)
+    {
+        return s.distances(a) < s.distances(b);
+    });
+
+    for (int t = 0; t < LOD_TIER_COUNT; t++) { s.counts[t] = 0; }
+
+    for (int o = 0; o < s.order.size; o++)
+    {
+        int handle = s.order(o);
+        int tier = s.requested(handle);
+
+        if (tier == LOD_FULL && max_full >= 0 && s.counts[LOD_FULL] >= max_full) { tier = LOD_REDUCED; }
+        if (tier == LOD_REDUCED && max_reduced >= 0 && s.counts[LOD_REDUCED] >= max_reduced) { tier = LOD_TRAJECTORY; }
+
+        s.tiers(handle) = tier;
+        s.counts[tier]++;
+    }
+}
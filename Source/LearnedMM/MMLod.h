@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+
+//--------------------------------------
+
+// Characters far from the camera do not need their pose updated
+// every frame, or at all. Each character asks for a tier from its
+// distance, then the tiers are capped by a budget so that only the
+// closest characters get the expensive ones however many there are.
+//
+// - `LOD_FULL` runs the whole update every step.
+// - `LOD_REDUCED` still updates the springs and the pose every
+//   step but only searches every few steps.
+// - `LOD_TRAJECTORY` only moves the root with the simulation 
+//   springs, with no search and no pose update.
+
+enum lod_tier
+{
+    LOD_FULL,
+    LOD_REDUCED,
+    LOD_TRAJECTORY,
+    LOD_TIER_COUNT,
+};
+
+static inline int lod_tier_from_distance(
+    const float distance,
+    const float reduced_distance,
+    const float trajectory_distance)
+{
+    return
+        distance >= trajectory_distance ? LOD_TRAJECTORY :
+        distance >= reduced_distance ? LOD_REDUCED : LOD_FULL;
+}
+
+struct lod_scheduler
+{
+    // Per handle. A requested tier of -1 marks a free handle.
+    array1d<float> distances;
+    array1d<int> requested;
+    array1d<int> tiers;
+
+    array1d<int> free_handles;
+    array1d<int> order;
+
+    // Characters in each tier after the last `lod_assign`
+    int counts[LOD_TIER_COUNT];
+
+    lod_scheduler() { for (int i = 0; i < LOD_TIER_COUNT; i++) { counts[i] = 0; } }
+};
+
+// Returns a handle for a new character, which starts at full rate
+int lod_add(lod_scheduler& s);
+void lod_remove(lod_scheduler& s, const int handle);
+
+// Asks for `tier` at `distance` from the camera for the next assign
+static inline void lod_request(lod_scheduler& s, const int handle, const float distance, const int tier)
+{
+    s.distances(handle) = distance;
+    s.requested(handle) = tier;
+}
+
+// Tier given by the last assign
+static inline int lod_tier(const lod_scheduler& s, const int handle)
+{
+    return s.tiers(handle);
+}
+
+// Gives every character its requested tier, closest first, until
+// `max_full` characters are at full rate and `max_reduced` at 
+// reduced rate. Those further away drop down a tier. A negative
+// maximum means no limit.
+void lod_assign(lod_scheduler& s, const int max_full, const int max_reduced);
@@ -0,0 +1,308 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMNNet.h"
+
+#include <math.h>
+#include <random>
+#include <string.h>
+#include <utility>
+
+//--------------------------------------
+
+// Reads the rest of a file written by `nnet_save_quantized`
+static bool nnet_read_quantized(nnet& nn, FILE* f, const int format)
+{
+    int nlayers = 0;
+
+    bool ok =
+        (format == QUANTIZED_INT8 || format == QUANTIZED_FP16) &&
+        array1d_read(nn.input_mean, f) &&
+        array1d_read(nn.input_std, f) &&
+        array1d_read(nn.output_mean, f) &&
+        array1d_read(nn.output_std, f) &&
+        fread(&nlayers, sizeof(int), 1, f) == 1 &&
+        nlayers > 0 && nlayers <= NNET_MAX_LAYERS;
+
+    for (int l = 0; ok && l < nlayers; l++)
+    {
+        ok = (format == QUANTIZED_INT8 ?
+                array2d_read(nn.weights_int8[l], f) :
+                array2d_read(nn.weights_fp16[l], f)) &&
+            array1d_read(nn.weights_scale[l], f) &&
+            array1d_read(nn.biases[l], f);
+    }
+
+    // Layers are stored padded
+    for (int l = 0; ok && l < nlayers; l++)
+    {
+        int rows = format == QUANTIZED_INT8 ? nn.weights_int8[l].rows : nn.weights_fp16[l].rows;
+        int cols = format == QUANTIZED_INT8 ? nn.weights_int8[l].cols : nn.weights_fp16[l].cols;
+        int ninputs = nnet_padded_size(l == 0 ? nn.input_mean.size : nn.biases[l - 1].size);
+        ok = rows == ninputs && cols == nn.biases[l].size && cols == nn.weights_scale[l].size && cols % NNET_PADDING == 0;
+    }
+
+    ok = ok &&
+        nn.input_std.size == nn.input_mean.size &&
+        nn.output_std.size == nn.output_mean.size &&
+        nn.biases[nlayers - 1].size == nnet_padded_size(nn.output_mean.size);
+
+    nn.format = format;
+    nn.nlayers = nlayers;
+    return ok;
+}
+
+bool nnet_load(nnet& nn, const char* filename, const int activation)
+{
+    nnet_release(nn);
+
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) { return false; }
+
+    int tag = 0;
+    if (fread(&tag, sizeof(int), 1, f) != 1) { fclose(f); return false; }
+
+    if (tag < 0)
+    {
+        bool ok = nnet_read_quantized(nn, f, -tag);
+        fclose(f);
+
+        if (!ok)
+        {
+            nnet_release(nn);
+            return false;
+        }
+
+        nn.activation = activation;
+        return true;
+    }
+
+    // A float network, whose first int is the size of `input_mean`
+    fseek(f, 0, SEEK_SET);
+
+    int nlayers = 0;
+
+    bool ok =
+        array1d_read(nn.input_mean, f) &&
+        array1d_read(nn.input_std, f) &&
+        array1d_read(nn.output_mean, f) &&
+        array1d_read(nn.output_std, f) &&
+        fread(&nlayers, sizeof(int), 1, f) == 1 &&
+        nlayers > 0 && nlayers <= NNET_MAX_LAYERS;
+
+    for (int l = 0; ok && l < nlayers; l++)
+    {
+        ok = array2d_read(nn.weights[l], f) && array1d_read(nn.biases[l], f);
+    }
+
+    fclose(f);
+
+    // Each layer should take the outputs of the previous one
+    for (int l = 0; ok && l < nlayers; l++)
+    {
+        int ninputs = l == 0 ? nn.input_mean.size : nn.weights[l - 1].cols;
+        ok = nn.weights[l].rows == ninputs && nn.biases[l].size == nn.weights[l].cols;
+    }
+
+    ok = ok &&
+        nn.input_std.size == nn.input_mean.size &&
+        nn.output_std.size == nn.output_mean.size &&
+        nn.weights[nlayers - 1].cols == nn.output_mean.size;
+
+    if (!ok)
+    {
+        nnet_release(nn);
+        return false;
+    }
+
+    nn.activation = activation;
+    nn.nlayers = nlayers;
+    nnet_pad(nn);
+    return true;
+}
+
+void nnet_pad(nnet& nn)
+{
+    // Pad with zeros so padded inputs add nothing and padded
+    // outputs stay at zero through the activation
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        array2d<float> weights(nnet_padded_size(nn.weights[l].rows), nnet_padded_size(nn.weights[l].cols));
+        array1d<float> biases(weights.cols);
+        weights.zero();
+        biases.zero();
+
+        for (int i = 0; i < nn.weights[l].rows; i++)
+        {
+            memcpy(weights(i).data, nn.weights[l](i).data, nn.weights[l].cols * sizeof(float));
+        }
+        memcpy(biases.data, nn.biases[l].data, nn.biases[l].size * sizeof(float));
+
+        nn.weights[l] = std::move(weights);
+        nn.biases[l] = std::move(biases);
+    }
+}
+
+void nnet_quantize(nnet& nn, const int format)
+{
+    if (format == QUANTIZED_NONE || nn.format != QUANTIZED_NONE) { return; }
+
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        const array2d<float>& weights = nn.weights[l];
+        nn.weights_scale[l].resize(weights.cols);
+
+        if (format == QUANTIZED_INT8)
+        {
+            // One scale per output maps its largest weight to 127
+            for (int j = 0; j < weights.cols; j++)
+            {
+                float wmax = 0.0f;
+                for (int i = 0; i < weights.rows; i++)
+                {
+                    wmax = maxf(wmax, fabsf(weights(i, j)));
+                }
+                nn.weights_scale[l](j) = wmax > 0.0f ? wmax / 127.0f : 1.0f;
+            }
+
+            nn.weights_int8[l].resize(weights.rows, weights.cols);
+            for (int i = 0; i < weights.rows; i++)
+            {
+                for (int j = 0; j < weights.cols; j++)
+                {
+                    nn.weights_int8[l](i, j) = (int8_t)clampf(roundf(weights(i, j) / nn.weights_scale[l](j)), -127.0f, 127.0f);
+                }
+            }
+        }
+        else
+        {
+            nn.weights_scale[l].set(1.0f);
+
+            nn.weights_fp16[l].resize(weights.rows, weights.cols);
+            for (int i = 0; i < weights.rows; i++)
+            {
+                for (int j = 0; j < weights.cols; j++)
+                {
+                    nn.weights_fp16[l](i, j) = half_from_float(weights(i, j));
+                }
+            }
+        }
+
+        nn.weights[l].release();
+    }
+
+    nn.format = format;
+}
+
+bool nnet_save_quantized(const nnet& nn, const char* filename)
+{
+    if (nn.format == QUANTIZED_NONE) { return false; }
+
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL) { return false; }
+
+    int tag = -nn.format;
+
+    // A partial write leaves a file `nnet_load` would reject, so
+    // every write is checked
+    bool ok =
+        fwrite(&tag, sizeof(int), 1, f) == 1 &&
+        array1d_write(nn.input_mean, f) &&
+        array1d_write(nn.input_std, f) &&
+        array1d_write(nn.output_mean, f) &&
+        array1d_write(nn.output_std, f) &&
+        fwrite(&nn.nlayers, sizeof(int), 1, f) == 1;
+
+    for (int l = 0; ok && l < nn.nlayers; l++)
+    {
+        ok = (nn.format == QUANTIZED_INT8 ?
+                array2d_write(nn.weights_int8[l], f) :
+                array2d_write(nn.weights_fp16[l], f)) &&
+            array1d_write(nn.weights_scale[l], f) &&
+            array1d_write(nn.biases[l], f);
+    }
+
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+float nnet_max_error(const nnet& reference, const nnet& nn, const int nsamples, const unsigned int seed)
+{
+    assert(reference.ninputs() == nn.ninputs() && reference.noutputs() == nn.noutputs());
+
+    std::mt19937 gen(seed);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    nnet_evaluation reference_evaluation, evaluation;
+    nnet_evaluation_resize(reference_evaluation, reference);
+    nnet_evaluation_resize(evaluation, nn);
+
+    float error = 0.0f;
+
+    for (int s = 0; s < nsamples; s++)
+    {
+        for (int i = 0; i < nn.ninputs(); i++)
+        {
+            float x = reference.input_mean(i) + reference.input_std(i) * normal(gen);
+            reference_evaluation.input()(i) = x;
+            evaluation.input()(i) = x;
+        }
+
+        nnet_evaluate(reference_evaluation, reference);
+        nnet_evaluate(evaluation, nn);
+
+        for (int j = 0; j < nn.noutputs(); j++)
+        {
+            error = maxf(error, fabsf(reference_evaluation.output()(j) - evaluation.output()(j)));
+        }
+    }
+
+    return error;
+}
+
+void nnet_release(nnet& nn)
+{
+    nn.nlayers = 0;
+    nn.format = QUANTIZED_NONE;
+    nn.input_mean.release();
+    nn.input_std.release();
+    nn.output_mean.release();
+    nn.output_std.release();
+
+    for (int l = 0; l < NNET_MAX_LAYERS; l++)
+    {
+        nn.weights[l].release();
+        nn.biases[l].release();
+        nn.weights_int8[l].release();
+        nn.weights_fp16[l].release();
+        nn.weights_scale[l].release();
+    }
+}
+
+void nnet_evaluation_resize(nnet_evaluation& evaluation, const nnet& nn)
+{
+    evaluation.nlayers = nn.nlayers;
+
+    // Only the unpadded inputs are ever written
+    evaluation.layers[0].resize(nnet_padded_size(nn.ninputs()));
+    evaluation.layers[0].zero();
+
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        evaluation.layers[l + 1].resize(nn.layer_size(l));
+    }
+}
+
+void nnet_batch_evaluation_resize(nnet_batch_evaluation& evaluation, const nnet& nn, const int rows)
+{
+    evaluation.nlayers = nn.nlayers;
+
+    // Callers only write the unpadded inputs of each row
+    evaluation.layers[0].resize(rows, nnet_padded_size(nn.ninputs()));
+    evaluation.layers[0].zero();
+
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        evaluation.layers[l + 1].resize(rows, nn.layer_size(l));
+    }
+}
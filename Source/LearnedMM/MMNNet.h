@@ -0,0 +1,739 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+#include "MMSimd.h"
+#include "MMQuantize.h"
+
+#include <math.h>
+#include <stdio.h>
+
+//--------------------------------------
+
+// Small fully connected network evaluated on the CPU, as used by
+// the decompressor, stepper and projector of Learned Motion
+// Matching. Inputs are normalized with `input_mean` and
+// `input_std`, go through each linear layer followed by the
+// activation (except for the last layer) and are denormalized
+// with `output_mean` and `output_std`.
+//
+// Once loaded the weights and biases are padded with zeros to a
+// multiple of eight inputs and outputs, and so are the layers of
+// an evaluation, so the layer kernels never need a remainder.
+//
+// Weights can also be stored as int8 with one scale per output,
+// or as half floats, in the `quantized_format`s of the features.
+
+enum
+{
+    NNET_MAX_LAYERS = 8,
+    NNET_PADDING = 8,
+};
+
+enum nnet_activation
+{
+    NNET_RELU,
+    NNET_ELU,
+    NNET_LINEAR,
+};
+
+static inline int nnet_padded_size(const int size)
+{
+    return ((size + NNET_PADDING - 1) / NNET_PADDING) * NNET_PADDING;
+}
+
+struct nnet
+{
+    int activation;
+    int nlayers;
+
+    // A `quantized_format`, `QUANTIZED_NONE` for float weights
+    int format;
+
+    array1d<float> input_mean;
+    array1d<float> input_std;
+    array1d<float> output_mean;
+    array1d<float> output_std;
+
+    // Weights are stored with one row per input and one column
+    // per output of the layer, so a row scales one input into
+    // every output
+    array2d<float> weights[NNET_MAX_LAYERS];
+    array1d<float> biases[NNET_MAX_LAYERS];
+
+    // Quantized weights replacing `weights`, where the float
+    // weight is `q * weights_scale(j)` for output `j`
+    array2d<int8_t> weights_int8[NNET_MAX_LAYERS];
+    array2d<uint16_t> weights_fp16[NNET_MAX_LAYERS];
+    array1d<float> weights_scale[NNET_MAX_LAYERS];
+
+    nnet() : activation(NNET_RELU), nlayers(0), format(QUANTIZED_NONE) {}
+
+    int ninputs() const { return input_mean.size; }
+    int noutputs() const { return output_mean.size; }
+
+    // Padded size of the output of a layer
+    int layer_size(const int l) const { return biases[l].size; }
+};
+
+// Loads a network saved by the training scripts: the input and
+// output means and stds written with `array1d_write`, the number
+// of layers, then the weights and biases of each layer. Returns
+// false if the file is missing or the layer sizes do not chain.
+// Also loads networks written by `nnet_save_quantized`.
+bool nnet_load(nnet& nn, const char* filename, const int activation = NNET_RELU);
+
+// Replaces the float weights of a loaded network with int8 or
+// half float weights
+void nnet_quantize(nnet& nn, const int format);
+
+// Quantized networks start with the negated format, which the
+// size of the first array of a float network can never be, then
+// follow the float layout with the padded quantized weights, the
+// scales and the padded biases of each layer.
+bool nnet_save_quantized(const nnet& nn, const char* filename);
+
+// Largest difference between the outputs of two versions of the
+// same network, over `nsamples` inputs drawn around the inputs'
+// means with their stds
+float nnet_max_error(const nnet& reference, const nnet& nn, const int nsamples = 256, const unsigned int seed = 1234);
+
+void nnet_release(nnet& nn);
+
+// Pads the weights and biases of a network given unpadded, as
+// done by `nnet_load`
+void nnet_pad(nnet& nn);
+
+// Values of every layer of a network, from the inputs to the
+// outputs, padded like the weights. Each user of a network 
+// needs its own.
+struct nnet_evaluation
+{
+    array1d<float> layers[NNET_MAX_LAYERS + 1];
+    int nlayers;
+
+    nnet_evaluation() : nlayers(0) {}
+
+    slice1d<float> input() const { return layers[0]; }
+    slice1d<float> output() const { return layers[nlayers]; }
+};
+
+void nnet_evaluation_resize(nnet_evaluation& evaluation, const nnet& nn);
+
+// Same for a batch of inputs, one per row, so that each weight
+// is loaded once for several rows
+struct nnet_batch_evaluation
+{
+    array2d<float> layers[NNET_MAX_LAYERS + 1];
+    int nlayers;
+
+    nnet_batch_evaluation() : nlayers(0) {}
+
+    slice2d<float> input() const { return layers[0]; }
+    slice2d<float> output() const { return layers[nlayers]; }
+    int rows() const { return layers[0].rows; }
+};
+
+void nnet_batch_evaluation_resize(nnet_batch_evaluation& evaluation, const nnet& nn, const int rows);
+
+//--------------------------------------
+
+// Only the first `mean.size` values are used, the rest are padding
+static inline void nnet_layer_normalize(
+    slice1d<float> layer,
+    const slice1d<float> mean,
+    const slice1d<float> std)
+{
+    for (int i = 0; i < mean.size; i++)
+    {
+        layer(i) = (layer(i) - mean(i)) / std(i);
+    }
+}
+
+static inline void nnet_layer_denormalize(
+    slice1d<float> layer,
+    const slice1d<float> mean,
+    const slice1d<float> std)
+{
+    for (int i = 0; i < mean.size; i++)
+    {
+        layer(i) = layer(i) * std(i) + mean(i);
+    }
+}
+
+// Reference version of `nnet_layer_dense` without the activation
+static inline void nnet_layer_linear(
+    slice1d<float> output,
+    const slice1d<float> input,
+    const slice2d<float> weights,
+    const slice1d<float> biases)
+{
+    assert(input.size == weights.rows && output.size == weights.cols && output.size == biases.size);
+
+    for (int j = 0; j < output.size; j++)
+    {
+        output(j) = biases(j);
+    }
+
+    for (int i = 0; i < input.size; i++)
+    {
+        if (input(i) != 0.0f)
+        {
+            for (int j = 0; j < output.size; j++)
+            {
+                output(j) += input(i) * weights(i, j);
+            }
+        }
+    }
+}
+
+// Activation of `count` values in place
+static inline void nnet_activation(float* values, const int count, const int activation)
+{
+    if (activation == NNET_RELU)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = maxf(values[i], 0.0f);
+        }
+    }
+    else if (activation == NNET_ELU)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = values[i] > 0.0f ? values[i] : expf(values[i]) - 1.0f;
+        }
+    }
+}
+
+// Linear layer followed by its activation. Outputs are computed a
+// block of registers at a time: each block starts from the biases
+// and accumulates one row of weights per input, so the block stays
+// in registers while the weights stream through once. Inputs which
+// are zero, as often after a ReLU, are skipped. The activation is
+// applied before the block is stored, except for the ELU whose
+// exponential is done on the stored values.
+static inline void nnet_layer_dense(
+    slice1d<float> output,
+    const slice1d<float> input,
+    const slice2d<float> weights,
+    const slice1d<float> biases,
+    const int activation)
+{
+    assert(input.size == weights.rows && output.size == weights.cols && output.size == biases.size);
+
+    const int ninputs = weights.rows;
+    const int noutputs = weights.cols;
+    const float* __restrict x = input.data;
+    const float* __restrict w = weights.data;
+    float* __restrict y = output.data;
+    int j = 0;
+
+#if MM_SIMD_AVX2
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; j + 32 <= noutputs; j += 32)
+    {
+        __m256 y0 = _mm256_loadu_ps(biases.data + j + 0);
+        __m256 y1 = _mm256_loadu_ps(biases.data + j + 8);
+        __m256 y2 = _mm256_loadu_ps(biases.data + j + 16);
+        __m256 y3 = _mm256_loadu_ps(biases.data + j + 24);
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+
+            const __m256 xi = _mm256_set1_ps(x[i]);
+            const float* row = w + i * noutputs + j;
+            y0 = fmadd_avx(xi, _mm256_loadu_ps(row + 0), y0);
+            y1 = fmadd_avx(xi, _mm256_loadu_ps(row + 8), y1);
+            y2 = fmadd_avx(xi, _mm256_loadu_ps(row + 16), y2);
+            y3 = fmadd_avx(xi, _mm256_loadu_ps(row + 24), y3);
+        }
+
+        if (activation == NNET_RELU)
+        {
+            y0 = _mm256_max_ps(y0, zero);
+            y1 = _mm256_max_ps(y1, zero);
+            y2 = _mm256_max_ps(y2, zero);
+            y3 = _mm256_max_ps(y3, zero);
+        }
+
+        _mm256_storeu_ps(y + j + 0, y0);
+        _mm256_storeu_ps(y + j + 8, y1);
+        _mm256_storeu_ps(y + j + 16, y2);
+        _mm256_storeu_ps(y + j + 24, y3);
+
+        if (activation == NNET_ELU) { nnet_activation(y + j, 32, activation); }
+    }
+
+    for (; j + 8 <= noutputs; j += 8)
+    {
+        __m256 y0 = _mm256_loadu_ps(biases.data + j);
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+            y0 = fmadd_avx(_mm256_set1_ps(x[i]), _mm256_loadu_ps(w + i * noutputs + j), y0);
+        }
+
+        if (activation == NNET_RELU) { y0 = _mm256_max_ps(y0, zero); }
+        _mm256_storeu_ps(y + j, y0);
+        if (activation == NNET_ELU) { nnet_activation(y + j, 8, activation); }
+    }
+#elif MM_SIMD_SSE
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; j + 16 <= noutputs; j += 16)
+    {
+        __m128 y0 = _mm_loadu_ps(biases.data + j + 0);
+        __m128 y1 = _mm_loadu_ps(biases.data + j + 4);
+        __m128 y2 = _mm_loadu_ps(biases.data + j + 8);
+        __m128 y3 = _mm_loadu_ps(biases.data + j + 12);
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+
+            const __m128 xi = _mm_set1_ps(x[i]);
+            const float* row = w + i * noutputs + j;
+            y0 = _mm_add_ps(_mm_mul_ps(xi, _mm_loadu_ps(row + 0)), y0);
+            y1 = _mm_add_ps(_mm_mul_ps(xi, _mm_loadu_ps(row + 4)), y1);
+            y2 = _mm_add_ps(_mm_mul_ps(xi, _mm_loadu_ps(row + 8)), y2);
+            y3 = _mm_add_ps(_mm_mul_ps(xi, _mm_loadu_ps(row + 12)), y3);
+        }
+
+        if (activation == NNET_RELU)
+        {
+            y0 = _mm_max_ps(y0, zero);
+            y1 = _mm_max_ps(y1, zero);
+            y2 = _mm_max_ps(y2, zero);
+            y3 = _mm_max_ps(y3, zero);
+        }
+
+        _mm_storeu_ps(y + j + 0, y0);
+        _mm_storeu_ps(y + j + 4, y1);
+        _mm_storeu_ps(y + j + 8, y2);
+        _mm_storeu_ps(y + j + 12, y3);
+
+        if (activation == NNET_ELU) { nnet_activation(y + j, 16, activation); }
+    }
+
+    for (; j + 4 <= noutputs; j += 4)
+    {
+        __m128 y0 = _mm_loadu_ps(biases.data + j);
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+            y0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(x[i]), _mm_loadu_ps(w + i * noutputs + j)), y0);
+        }
+
+        if (activation == NNET_RELU) { y0 = _mm_max_ps(y0, zero); }
+        _mm_storeu_ps(y + j, y0);
+        if (activation == NNET_ELU) { nnet_activation(y + j, 4, activation); }
+    }
+#endif
+
+    if (j < noutputs)
+    {
+        int remaining = noutputs - j;
+
+        for (int k = 0; k < remaining; k++)
+        {
+            y[j + k] = biases(j + k);
+        }
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+
+            for (int k = 0; k < remaining; k++)
+            {
+                y[j + k] += x[i] * w[i * noutputs + j + k];
+            }
+        }
+
+        nnet_activation(y + j, remaining, activation);
+    }
+}
+
+// Converts eight quantized weights to floats
+#if MM_SIMD_AVX2
+static inline __m256 nnet_load_weights_avx(const int8_t* w)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)w)));
+}
+
+static inline __m256 nnet_load_weights_avx(const uint16_t* w)
+{
+#if MM_SIMD_F16C
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)w));
+#else
+    __m128 lo, hi;
+    quantized_load_fp16_sse(lo, hi, w);
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+#endif
+}
+#endif
+
+#if MM_SIMD_SSE
+static inline void nnet_load_weights_sse(__m128& lo, __m128& hi, const int8_t* w)
+{
+    quantized_load_int8_sse(lo, hi, w);
+}
+
+static inline void nnet_load_weights_sse(__m128& lo, __m128& hi, const uint16_t* w)
+{
+    quantized_load_fp16_sse(lo, hi, w);
+}
+#endif
+
+static inline float nnet_weight_to_float(const int8_t w) { return (float)w; }
+static inline float nnet_weight_to_float(const uint16_t w) { return half_to_float(w); }
+
+// Same as `nnet_layer_dense` with int8 or half float weights. Each
+// block of outputs sums the inputs times the converted weights, then
+// applies the scale of each output, the bias and the activation.
+template<typename W>
+static inline void nnet_layer_dense_quantized(
+    slice1d<float> output,
+    const slice1d<float> input,
+    const slice2d<W> weights,
+    const slice1d<float> scales,
+    const slice1d<float> biases,
+    const int activation)
+{
+    assert(input.size == weights.rows && output.size == weights.cols && output.size == biases.size && output.size == scales.size);
+
+    const int ninputs = weights.rows;
+    const int noutputs = weights.cols;
+    const float* __restrict x = input.data;
+    const W* __restrict w = weights.data;
+    float* __restrict y = output.data;
+    int j = 0;
+
+#if MM_SIMD_AVX2
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; j + 8 <= noutputs; )
+    {
+        // Four registers of outputs when there are enough left
+        int nblock = j + 32 <= noutputs ? 4 : 1;
+
+        __m256 y0 = zero, y1 = zero, y2 = zero, y3 = zero;
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+
+            const __m256 xi = _mm256_set1_ps(x[i]);
+            const W* row = w + i * noutputs + j;
+            y0 = fmadd_avx(xi, nnet_load_weights_avx(row + 0), y0);
+            if (nblock == 4)
+            {
+                y1 = fmadd_avx(xi, nnet_load_weights_avx(row + 8), y1);
+                y2 = fmadd_avx(xi, nnet_load_weights_avx(row + 16), y2);
+                y3 = fmadd_avx(xi, nnet_load_weights_avx(row + 24), y3);
+            }
+        }
+
+        __m256 ys[4] = { y0, y1, y2, y3 };
+        for (int k = 0; k < nblock; k++)
+        {
+            __m256 v = fmadd_avx(ys[k], _mm256_loadu_ps(scales.data + j + 8 * k), _mm256_loadu_ps(biases.data + j + 8 * k));
+            if (activation == NNET_RELU) { v = _mm256_max_ps(v, zero); }
+            _mm256_storeu_ps(y + j + 8 * k, v);
+        }
+
+        if (activation == NNET_ELU) { nnet_activation(y + j, 8 * nblock, activation); }
+        j += 8 * nblock;
+    }
+#elif MM_SIMD_SSE
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; j + 8 <= noutputs; )
+    {
+        int nblock = j + 16 <= noutputs ? 2 : 1;
+
+        __m128 y0 = zero, y1 = zero, y2 = zero, y3 = zero;
+
+        for (int i = 0; i < ninputs; i++)
+        {
+            if (x[i] == 0.0f) { continue; }
+
+            const __m128 xi = _mm_set1_ps(x[i]);
+            const W* row = w + i * noutputs + j;
+            __m128 w0, w1;
+            nnet_load_weights_sse(w0, w1, row);
+            y0 = _mm_add_ps(_mm_mul_ps(xi, w0), y0);
+            y1 = _mm_add_ps(_mm_mul_ps(xi, w1), y1);
+            if (nblock == 2)
+            {
+                nnet_load_weights_sse(w0, w1, row + 8);
+                y2 = _mm_add_ps(_mm_mul_ps(xi, w0), y2);
+                y3 = _mm_add_ps(_mm_mul_ps(xi, w1), y3);
+            }
+        }
+
+        __m128 ys[4] = { y0, y1, y2, y3 };
+        for (int k = 0; k < 2 * nblock; k++)
+        {
+            __m128 v = _mm_add_ps(_mm_mul_ps(ys[k], _mm_loadu_ps(scales.data + j + 4 * k)), _mm_loadu_ps(biases.data + j + 4 * k));
+            if (activation == NNET_RELU) { v = _mm_max_ps(v, zero); }
+            _mm_storeu_ps(y + j + 4 * k, v);
+        }
+
+        if (activation == NNET_ELU) { nnet_activation(y + j, 8 * nblock, activation); }
+        j += 8 * nblock;
+    }
+#endif
+
+    for (; j < noutputs; j++)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < ninputs; i++)
+        {
+            sum += x[i] * nnet_weight_to_float(w[i * noutputs + j]);
+        }
+        y[j] = sum * scales(j) + biases(j);
+        nnet_activation(y + j, 1, activation);
+    }
+}
+
+// Layer `l` of a network in whichever format its weights are in
+static inline void nnet_layer_evaluate(
+    slice1d<float> output,
+    const slice1d<float> input,
+    const nnet& nn,
+    const int l)
+{
+    // No activation after the last layer
+    int activation = l != nn.nlayers - 1 ? nn.activation : NNET_LINEAR;
+
+    if (nn.format == QUANTIZED_INT8)
+    {
+        nnet_layer_dense_quantized<int8_t>(output, input, nn.weights_int8[l], nn.weights_scale[l], nn.biases[l], activation);
+    }
+    else if (nn.format == QUANTIZED_FP16)
+    {
+        nnet_layer_dense_quantized<uint16_t>(output, input, nn.weights_fp16[l], nn.weights_scale[l], nn.biases[l], activation);
+    }
+    else
+    {
+        nnet_layer_dense(output, input, nn.weights[l], nn.biases[l], activation);
+    }
+}
+
+// Evaluates the network on the values in `evaluation.input()`,
+// leaving the result in `evaluation.output()`
+static inline void nnet_evaluate(nnet_evaluation& evaluation, const nnet& nn)
+{
+    assert(evaluation.nlayers == nn.nlayers);
+
+    nnet_layer_normalize(evaluation.layers[0], nn.input_mean, nn.input_std);
+
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        nnet_layer_evaluate(evaluation.layers[l + 1], evaluation.layers[l], nn, l);
+    }
+
+    nnet_layer_denormalize(evaluation.layers[nn.nlayers], nn.output_mean, nn.output_std);
+}
+
+//--------------------------------------
+
+// `nnet_layer_dense` for a batch of rows. Four rows are done at a
+// time against a block of outputs so each weight loaded is used
+// four times. Remaining rows, or layers which are not padded, go
+// through `nnet_layer_dense`.
+static inline void nnet_layer_dense_batch(
+    slice2d<float> output,
+    const slice2d<float> input,
+    const slice2d<float> weights,
+    const slice1d<float> biases,
+    const int activation)
+{
+    assert(input.rows == output.rows && input.cols == weights.rows && output.cols == weights.cols && output.cols == biases.size);
+
+    const int ninputs = weights.rows;
+    const int noutputs = weights.cols;
+    const float* __restrict w = weights.data;
+    int r = 0;
+
+#if MM_SIMD_AVX2
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; r + 4 <= input.rows && noutputs % 8 == 0; r += 4)
+    {
+        const float* x0 = input(r + 0).data;
+        const float* x1 = input(r + 1).data;
+        const float* x2 = input(r + 2).data;
+        const float* x3 = input(r + 3).data;
+
+        int j = 0;
+        for (; j + 16 <= noutputs; j += 16)
+        {
+            __m256 b0 = _mm256_loadu_ps(biases.data + j + 0);
+            __m256 b1 = _mm256_loadu_ps(biases.data + j + 8);
+            __m256 y00 = b0, y01 = b1, y10 = b0, y11 = b1;
+            __m256 y20 = b0, y21 = b1, y30 = b0, y31 = b1;
+
+            for (int i = 0; i < ninputs; i++)
+            {
+                const __m256 w0 = _mm256_loadu_ps(w + i * noutputs + j + 0);
+                const __m256 w1 = _mm256_loadu_ps(w + i * noutputs + j + 8);
+                __m256 xi;
+                xi = _mm256_set1_ps(x0[i]); y00 = fmadd_avx(xi, w0, y00); y01 = fmadd_avx(xi, w1, y01);
+                xi = _mm256_set1_ps(x1[i]); y10 = fmadd_avx(xi, w0, y10); y11 = fmadd_avx(xi, w1, y11);
+                xi = _mm256_set1_ps(x2[i]); y20 = fmadd_avx(xi, w0, y20); y21 = fmadd_avx(xi, w1, y21);
+                xi = _mm256_set1_ps(x3[i]); y30 = fmadd_avx(xi, w0, y30); y31 = fmadd_avx(xi, w1, y31);
+            }
+
+            if (activation == NNET_RELU)
+            {
+                y00 = _mm256_max_ps(y00, zero); y01 = _mm256_max_ps(y01, zero);
+                y10 = _mm256_max_ps(y10, zero); y11 = _mm256_max_ps(y11, zero);
+                y20 = _mm256_max_ps(y20, zero); y21 = _mm256_max_ps(y21, zero);
+                y30 = _mm256_max_ps(y30, zero); y31 = _mm256_max_ps(y31, zero);
+            }
+
+            _mm256_storeu_ps(output(r + 0).data + j, y00); _mm256_storeu_ps(output(r + 0).data + j + 8, y01);
+            _mm256_storeu_ps(output(r + 1).data + j, y10); _mm256_storeu_ps(output(r + 1).data + j + 8, y11);
+            _mm256_storeu_ps(output(r + 2).data + j, y20); _mm256_storeu_ps(output(r + 2).data + j + 8, y21);
+            _mm256_storeu_ps(output(r + 3).data + j, y30); _mm256_storeu_ps(output(r + 3).data + j + 8, y31);
+        }
+
+        for (; j + 8 <= noutputs; j += 8)
+        {
+            __m256 b0 = _mm256_loadu_ps(biases.data + j);
+            __m256 y0 = b0, y1 = b0, y2 = b0, y3 = b0;
+
+            for (int i = 0; i < ninputs; i++)
+            {
+                const __m256 w0 = _mm256_loadu_ps(w + i * noutputs + j);
+                y0 = fmadd_avx(_mm256_set1_ps(x0[i]), w0, y0);
+                y1 = fmadd_avx(_mm256_set1_ps(x1[i]), w0, y1);
+                y2 = fmadd_avx(_mm256_set1_ps(x2[i]), w0, y2);
+                y3 = fmadd_avx(_mm256_set1_ps(x3[i]), w0, y3);
+            }
+
+            if (activation == NNET_RELU)
+            {
+                y0 = _mm256_max_ps(y0, zero); y1 = _mm256_max_ps(y1, zero);
+                y2 = _mm256_max_ps(y2, zero); y3 = _mm256_max_ps(y3, zero);
+            }
+
+            _mm256_storeu_ps(output(r + 0).data + j, y0);
+            _mm256_storeu_ps(output(r + 1).data + j, y1);
+            _mm256_storeu_ps(output(r + 2).data + j, y2);
+            _mm256_storeu_ps(output(r + 3).data + j, y3);
+        }
+
+        if (activation == NNET_ELU)
+        {
+            for (int k = 0; k < 4; k++) { nnet_activation(output(r + k).data, noutputs, activation); }
+        }
+    }
+#elif MM_SIMD_SSE
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; r + 4 <= input.rows && noutputs % 8 == 0; r += 4)
+    {
+        const float* x0 = input(r + 0).data;
+        const float* x1 = input(r + 1).data;
+        const float* x2 = input(r + 2).data;
+        const float* x3 = input(r + 3).data;
+
+        for (int j = 0; j < noutputs; j += 8)
+        {
+            __m128 b0 = _mm_loadu_ps(biases.data + j + 0);
+            __m128 b1 = _mm_loadu_ps(biases.data + j + 4);
+            __m128 y00 = b0, y01 = b1, y10 = b0, y11 = b1;
+            __m128 y20 = b0, y21 = b1, y30 = b0, y31 = b1;
+
+            for (int i = 0; i < ninputs; i++)
+            {
+                const __m128 w0 = _mm_loadu_ps(w + i * noutputs + j + 0);
+                const __m128 w1 = _mm_loadu_ps(w + i * noutputs + j + 4);
+                __m128 xi;
+                xi = _mm_set1_ps(x0[i]); y00 = _mm_add_ps(_mm_mul_ps(xi, w0), y00); y01 = _mm_add_ps(_mm_mul_ps(xi, w1), y01);
+                xi = _mm_set1_ps(x1[i]); y10 = _mm_add_ps(_mm_mul_ps(xi, w0), y10); y11 = _mm_add_ps(_mm_mul_ps(xi, w1), y11);
+                xi = _mm_set1_ps(x2[i]); y20 = _mm_add_ps(_mm_mul_ps(xi, w0), y20); y21 = _mm_add_ps(_mm_mul_ps(xi, w1), y21);
+                xi = _mm_set1_ps(x3[i]); y30 = _mm_add_ps(_mm_mul_ps(xi, w0), y30); y31 = _mm_add_ps(_mm_mul_ps(xi, w1), y31);
+            }
+
+            if (activation == NNET_RELU)
+            {
+                y00 = _mm_max_ps(y00, zero); y01 = _mm_max_ps(y01, zero);
+                y10 = _mm_max_ps(y10, zero); y11 = _mm_max_ps(y11, zero);
+                y20 = _mm_max_ps(y20, zero); y21 = _mm_max_ps(y21, zero);
+                y30 = _mm_max_ps(y30, zero); y31 = _mm_max_ps(y31, zero);
+            }
+
+            _mm_storeu_ps(output(r + 0).data + j, y00); _mm_storeu_ps(output(r + 0).data + j + 4, y01);
+            _mm_storeu_ps(output(r + 1).data + j, y10); _mm_storeu_ps(output(r + 1).data + j + 4, y11);
+            _mm_storeu_ps(output(r + 2).data + j, y20); _mm_storeu_ps(output(r + 2).data + j + 4, y21);
+            _mm_storeu_ps(output(r + 3).data + j, y30); _mm_storeu_ps(output(r + 3).data + j + 4, y31);
+        }
+
+        if (activation == NNET_ELU)
+        {
+            for (int k = 0; k < 4; k++) { nnet_activation(output(r + k).data, noutputs, activation); }
+        }
+    }
+#endif
+
+    for (; r < input.rows; r++)
+    {
+        nnet_layer_dense(output(r), input(r), weights, biases, activation);
+    }
+}
+
+// Evaluates rows `start` to `stop` of a batch. Different row
+// ranges can be evaluated at the same time on different threads.
+// Quantized networks are evaluated one row at a time.
+static inline void nnet_evaluate_batch(
+    nnet_batch_evaluation& evaluation,
+    const nnet& nn,
+    const int start,
+    const int stop)
+{
+    assert(evaluation.nlayers == nn.nlayers && start >= 0 && stop <= evaluation.rows());
+
+    int rows = stop - start;
+
+    for (int r = start; r < stop; r++)
+    {
+        nnet_layer_normalize(evaluation.layers[0](r), nn.input_mean, nn.input_std);
+    }
+
+    for (int l = 0; l < nn.nlayers; l++)
+    {
+        const array2d<float>& input = evaluation.layers[l];
+        const array2d<float>& output = evaluation.layers[l + 1];
+
+        if (nn.format != QUANTIZED_NONE)
+        {
+            for (int r = start; r < stop; r++)
+            {
+                nnet_layer_evaluate(output(r), input(r), nn, l);
+            }
+            continue;
+        }
+
+        nnet_layer_dense_batch(
+            slice2d<float>(rows, output.cols, output.data + start * output.cols),
+            slice2d<float>(rows, input.cols, input.data + start * input.cols),
+            nn.weights[l],
+            nn.biases[l],
+            l != nn.nlayers - 1 ? nn.activation : NNET_LINEAR);
+    }
+
+    for (int r = start; r < stop; r++)
+    {
+        nnet_layer_denormalize(evaluation.layers[nn.nlayers](r), nn.output_mean, nn.output_std);
+    }
+}
@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMQuantize.h"
+
+#include <float.h>
+
+//--------------------------------------
+
+void quantized_build(quantized_features& qf, const slice2d<float> features, const int format)
+{
+    quantized_release(qf);
+
+    qf.format = format;
+    qf.nfeatures = features.cols;
+    qf.scale.resize(features.cols);
+    qf.offset.resize(features.cols);
+
+    if (format == QUANTIZED_INT8)
+    {
+        // Map the range of each feature onto [-127, 127]
+        for (int j = 0; j < features.cols; j++)
+        {
+            float fmin = FLT_MAX, fmax = -FLT_MAX;
+            for (int i = 0; i < features.rows; i++)
+            {
+                fmin = minf(fmin, features(i, j));
+                fmax = maxf(fmax, features(i, j));
+            }
+
+            qf.offset(j) = features.rows > 0 ? (fmin + fmax) / 2.0f : 0.0f;
+            qf.scale(j) = features.rows > 0 && fmax > fmin ? (fmax - fmin) / 254.0f : 1.0f;
+        }
+
+        qf.values_int8.resize(features.rows, features.cols);
+
+        for (int i = 0; i < features.rows; i++)
+        {
+            for (int j = 0; j < features.cols; j++)
+            {
+                qf.values_int8(i, j) = (int8_t)clampf(roundf((features(i, j) - qf.offset(j)) / qf.scale(j)), -127.0f, 127.0f);
+            }
+        }
+    }
+    else if (format == QUANTIZED_FP16)
+    {
+        // Normalized features are already in a good range for halfs
+        qf.offset.zero();
+        qf.scale.set(1.0f);
+
+        qf.values_fp16.resize(features.rows, features.cols);
+
+        for (int i = 0; i < features.rows; i++)
+        {
+            for (int j = 0; j < features.cols; j++)
+            {
+                qf.values_fp16(i, j) = half_from_float(features(i, j));
+            }
+        }
+    }
+    else
+    {
+        quantized_release(qf);
+        return;
+    }
+
+    // Bound the distance of any row from its quantized copy by 
+    // the worst rounding of each feature. A little is added for 
+    // the rounding of the distances themselves.
+    float error_squared = 0.0f;
+    for (int j = 0; j < features.cols; j++)
+    {
+        float feature_error = 0.0f;
+        for (int i = 0; i < features.rows; i++)
+        {
+            float x = format == QUANTIZED_INT8 ?
+                qf.values_int8(i, j) * qf.scale(j) + qf.offset(j) :
+                half_to_float(qf.values_fp16(i, j));
+
+            feature_error = maxf(feature_error, fabsf(features(i, j) - x));
+        }
+        error_squared += squaref(feature_error);
+    }
+
+    qf.error = sqrtf(error_squared) * 1.001f + 1e-6f;
+}
+
+void quantized_release(quantized_features& qf)
+{
+    qf.format = QUANTIZED_NONE;
+    qf.nfeatures = 0;
+    qf.values_int8.release();
+    qf.values_fp16.release();
+    qf.scale.release();
+    qf.offset.release();
+    qf.error = 0.0f;
+}
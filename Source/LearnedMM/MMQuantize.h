@@ -0,0 +1,239 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+#include "MMSimd.h"
+
+#include <stdint.h>
+
+//--------------------------------------
+
+// Compact copy of a feature matrix used to skip frames while
+// touching 2-4x less memory than the float features. Each
+// feature `j` is stored as `x = q * scale(j) + offset(j)` with `q`
+// either an int8 or a half float. The query stays in full
+// precision (an asymmetric distance), so the only error is the
+// rounding of the database features, which is bounded by `error`.
+
+enum quantized_format
+{
+    QUANTIZED_NONE,
+    QUANTIZED_INT8,
+    QUANTIZED_FP16,
+};
+
+struct quantized_features
+{
+    int format;
+    int nfeatures;
+    array2d<int8_t> values_int8;
+    array2d<uint16_t> values_fp16;
+    array1d<float> scale;
+    array1d<float> offset;
+
+    // Largest distance between a row and its quantized copy, so
+    // a row at quantized distance `d` from a query is at least
+    // `d - error` away from it
+    float error;
+
+    quantized_features() : format(QUANTIZED_NONE), nfeatures(0), error(0.0f) {}
+
+    int rows() const { return format == QUANTIZED_INT8 ? values_int8.rows : values_fp16.rows; }
+};
+
+// Quantizes `features`, whose number of columns should already
+// be padded to a multiple of eight.
+void quantized_build(quantized_features& qf, const slice2d<float> features, const int format);
+
+void quantized_release(quantized_features& qf);
+
+//--------------------------------------
+
+// Only handles the range of values features take, without
+// infinities or NaNs.
+static inline uint16_t half_from_float(const float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(float));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0)
+    {
+        // Denormal, or too small and flushed to zero
+        if (exponent < -10) { return (uint16_t)sign; }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1))) { half++; }
+        return (uint16_t)(sign | half);
+    }
+
+    if (exponent >= 31) { return (uint16_t)(sign | 0x7bff); }
+
+    // Round to nearest even, carrying into the exponent if needed
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) { half++; }
+    return (uint16_t)(sign | (half > 0x7bff ? 0x7bff : half));
+}
+
+// Moving the exponent and mantissa into place and multiplying by
+// 2^112 rebiases the exponent and handles denormals for free
+static inline float half_to_float(const uint16_t h)
+{
+    uint32_t bits = ((uint32_t)h & 0x7fff) << 13;
+    float x;
+    memcpy(&x, &bits, sizeof(float));
+    x *= 5.192296858534828e+33f;
+    return (h & 0x8000) ? -x : x;
+}
+
+#if MM_SIMD_SSE
+
+// Converts eight int8 values to two groups of four floats
+static inline void quantized_load_int8_sse(__m128& lo, __m128& hi, const int8_t* values)
+{
+    __m128i b = _mm_loadl_epi64((const __m128i*)values);
+    __m128i s = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);
+    lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+    hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+}
+
+// Same trick as `half_to_float` for eight halfs at a time
+static inline void quantized_load_fp16_sse(__m128& lo, __m128& hi, const uint16_t* values)
+{
+    __m128i h = _mm_loadu_si128((const __m128i*)values);
+    __m128i zero = _mm_setzero_si128();
+    __m128i h_lo = _mm_unpacklo_epi16(h, zero);
+    __m128i h_hi = _mm_unpackhi_epi16(h, zero);
+    __m128i magnitude = _mm_set1_epi32(0x7fff);
+    __m128 scale = _mm_set1_ps(5.192296858534828e+33f);
+
+    lo = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h_lo, magnitude), 13)), scale);
+    hi = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h_hi, magnitude), 13)), scale);
+    lo = _mm_or_ps(lo, _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(magnitude, h_lo), 16)));
+    hi = _mm_or_ps(hi, _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(magnitude, h_hi), 16)));
+}
+
+#endif
+
+// Weighted squared distance between a query given in quantized
+// units (`(query - offset) / scale`) and a quantized row, where
+// the weights are `scale * scale`. Stops early once `best_cost`
+// is reached, eight features at a time.
+static inline float quantized_distance_int8(
+    const float* __restrict query,
+    const float* __restrict weights,
+    const int8_t* __restrict row,
+    const int nfeatures,
+    const float best_cost)
+{
+    float cost = 0.0f;
+    int j = 0;
+
+#if MM_SIMD_AVX2
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(row + j))));
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + j), v);
+        cost += hsum_avx(_mm256_mul_ps(_mm256_loadu_ps(weights + j), _mm256_mul_ps(d, d)));
+        if (cost >= best_cost) { return cost; }
+    }
+#elif MM_SIMD_SSE
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m128 v0, v1;
+        quantized_load_int8_sse(v0, v1, row + j);
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(query + j + 0), v0);
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(query + j + 4), v1);
+        cost += hsum_sse(_mm_add_ps(
+            _mm_mul_ps(_mm_loadu_ps(weights + j + 0), _mm_mul_ps(d0, d0)),
+            _mm_mul_ps(_mm_loadu_ps(weights + j + 4), _mm_mul_ps(d1, d1))));
+        if (cost >= best_cost) { return cost; }
+    }
+#endif
+
+    for (; j < nfeatures; j++)
+    {
+        cost += weights[j] * squaref(query[j] - (float)row[j]);
+        if (cost >= best_cost) { break; }
+    }
+
+    return cost;
+}
+
+static inline float quantized_distance_fp16(
+    const float* __restrict query,
+    const float* __restrict weights,
+    const uint16_t* __restrict row,
+    const int nfeatures,
+    const float best_cost)
+{
+    float cost = 0.0f;
+    int j = 0;
+
+#if MM_SIMD_AVX2 && MM_SIMD_F16C
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m256 v = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(row + j)));
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(query + j), v);
+        cost += hsum_avx(_mm256_mul_ps(_mm256_loadu_ps(weights + j), _mm256_mul_ps(d, d)));
+        if (cost >= best_cost) { return cost; }
+    }
+#elif MM_SIMD_SSE
+    for (; j + 8 <= nfeatures; j += 8)
+    {
+        __m128 v0, v1;
+        quantized_load_fp16_sse(v0, v1, row + j);
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(query + j + 0), v0);
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(query + j + 4), v1);
+        cost += hsum_sse(_mm_add_ps(
+            _mm_mul_ps(_mm_loadu_ps(weights + j + 0), _mm_mul_ps(d0, d0)),
+            _mm_mul_ps(_mm_loadu_ps(weights + j + 4), _mm_mul_ps(d1, d1))));
+        if (cost >= best_cost) { return cost; }
+    }
+#endif
+
+    for (; j < nfeatures; j++)
+    {
+        cost += weights[j] * squaref(query[j] - half_to_float(row[j]));
+        if (cost >= best_cost) { break; }
+    }
+
+    return cost;
+}
+
+// Converts a normalized query into quantized units and weights
+static inline void quantized_query(
+    slice1d<float> query_quantized,
+    slice1d<float> weights,
+    const quantized_features& qf,
+    const slice1d<float> query_normalized)
+{
+    assert(query_quantized.size == qf.nfeatures && weights.size == qf.nfeatures && query_normalized.size == qf.nfeatures);
+
+    for (int j = 0; j < qf.nfeatures; j++)
+    {
+        query_quantized(j) = (query_normalized(j) - qf.offset(j)) / qf.scale(j);
+        weights(j) = qf.scale(j) * qf.scale(j);
+    }
+}
+
+static inline float quantized_distance(
+    const quantized_features& qf,
+    const float* __restrict query_quantized,
+    const float* __restrict weights,
+    const int i,
+    const float best_cost)
+{
+    return qf.format == QUANTIZED_INT8 ?
+        quantized_distance_int8(query_quantized, weights, &qf.values_int8.data[i * qf.nfeatures], qf.nfeatures, best_cost) :
+        quantized_distance_fp16(query_quantized, weights, &qf.values_fp16.data[i * qf.nfeatures], qf.nfeatures, best_cost);
+}
@@ -2,18 +2,7 @@
 
 #pragma once
 
-#include "CoreMinimal.h"
-#include "MMvec.h"
-
-/**
- * 
- */
-class LEARNEDMM_API MMQuat
-{
-public:
-	MMQuat();
-	~MMQuat();
-};
+#include "MMVec.h"
 
 struct quat
 {
@@ -0,0 +1,269 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMSearch.h"
+
+//--------------------------------------
+
+search_scheduler::~search_scheduler()
+{
+    delete[] shared_costs;
+}
+
+static void search_shared_cost_min(std::atomic<float>& shared, const float cost)
+{
+    float curr = shared.load(std::memory_order_relaxed);
+    while (cost < curr && !shared.compare_exchange_weak(curr, cost, std::memory_order_relaxed)) {}
+}
+
+static void search_task_run(void* data, const int t)
+{
+    search_scheduler& s = *(search_scheduler*)data;
+    const search_task& task = s.tasks(t);
+    const search_group& group = s.groups(task.group);
+    const database& db = *group.db;
+
+    frame_arena_scope scratch;
+
+    // Clip the ranges to the task. The ends of ranges are
+    // excluded here since the task may not contain them.
+    array1d<int, frame_allocator> range_starts(group.nranges);
+    array1d<int, frame_allocator> range_stops(group.nranges);
+
+    int nranges = 0;
+    for (int r = 0; r < group.nranges; r++)
+    {
+        int start = maxi(db.range_starts(r), task.start);
+        int stop = mini(db.range_stops(r) - s.ignore_range_end, task.stop);
+
+        if (start < stop)
+        {
+            range_starts(nranges) = start;
+            range_stops(nranges) = stop;
+            nranges++;
+        }
+    }
+
+    slice1d<int> best_indices(group.nqueries, &s.task_best_indices.data[task.result_offset]);
+    slice1d<float> best_costs(group.nqueries, &s.task_best_costs.data[task.result_offset]);
+    std::atomic<float>* shared_costs = &s.shared_costs[group.request_offset];
+
+    // Without a current frame the search starts from the best 
+    // cost of the other tasks. Nudging it up keeps frames of equal 
+    // cost so ties are still resolved in frame order. With one, the 
+    // current frame's cost is used instead.
+    for (int q = 0; q < group.nqueries; q++)
+    {
+        best_indices(q) = s.requests(s.group_requests(group.request_offset + q)).curr_index;
+        best_costs(q) = nextafterf(shared_costs[q].load(std::memory_order_relaxed), FLT_MAX);
+    }
+
+    bool padded = group.padded;
+    bool bounds = group.use_bounds && padded && db.bound_sm_min.rows > 0;
+    slice2d<float> empty(0, 0, NULL);
+
+    motion_matching_search_batch(
+        best_indices,
+        best_costs,
+        slice1d<int>(nranges, range_starts.data),
+        slice1d<int>(nranges, range_stops.data),
+        padded ? (slice2d<float>)db.features_padded : db.features,
+        bounds ? (slice2d<float>)db.bound_sm_min : empty,
+        bounds ? (slice2d<float>)db.bound_sm_max : empty,
+        bounds ? (slice2d<float>)db.bound_lr_min : empty,
+        bounds ? (slice2d<float>)db.bound_lr_max : empty,
+        slice2d<float>(group.nqueries, group.nfeatures, &s.group_queries.data[group.query_offset]),
+        s.transition_cost,
+        0,
+        s.ignore_surrounding);
+
+    for (int q = 0; q < group.nqueries; q++)
+    {
+        if (best_indices(q) != -1)
+        {
+            search_shared_cost_min(shared_costs[q], best_costs(q));
+        }
+    }
+}
+
+int search_submit(
+    search_scheduler& s,
+    const database* db,
+    const slice1d<float> query,
+    const int curr_index,
+    const bool use_bounds)
+{
+    assert(db != NULL && query.size == db->nfeatures());
+
+    int ticket = s.requests.size;
+    int query_offset = s.request_queries.size;
+
+    s.request_queries.resize(query_offset + query.size);
+    memcpy(&s.request_queries.data[query_offset], query.data, query.size * sizeof(float));
+
+    s.requests.resize(ticket + 1);
+    s.requests(ticket).db = db;
+    s.requests(ticket).use_bounds = use_bounds;
+    s.requests(ticket).curr_index = curr_index;
+    s.requests(ticket).query_offset = query_offset;
+    s.requests(ticket).group = -1;
+
+    return ticket;
+}
+
+int search_pending(const search_scheduler& s)
+{
+    return s.requests.size;
+}
+
+static void search_build_groups(search_scheduler& s)
+{
+    s.groups.resize(0);
+
+    for (int r = 0; r < s.requests.size; r++)
+    {
+        search_request& request = s.requests(r);
+
+        for (int g = 0; g < s.groups.size; g++)
+        {
+            if (s.groups(g).db == request.db && s.groups(g).use_bounds == request.use_bounds)
+            {
+                request.group = g;
+                break;
+            }
+        }
+
+        if (request.group == -1)
+        {
+            request.group = s.groups.size;
+            s.groups.resize(s.groups.size + 1);
+            s.groups(request.group).db = request.db;
+            s.groups(request.group).use_bounds = request.use_bounds;
+            s.groups(request.group).padded = database_search_padded(*request.db);
+            s.groups(request.group).nranges = database_nranges_ready(*request.db);
+            s.groups(request.group).nqueries = 0;
+            s.groups(request.group).nfeatures = s.groups(request.group).padded ?
+                request.db->nfeatures_padded() : request.db->nfeatures();
+        }
+
+        s.groups(request.group).nqueries++;
+    }
+
+    // Lay out the requests and normalized queries of each group
+    // contiguously, and cut each database into tasks
+    int request_offset = 0;
+    int query_offset = 0;
+    int result_offset = 0;
+
+    s.tasks.resize(0);
+
+    for (int g = 0; g < s.groups.size; g++)
+    {
+        search_group& group = s.groups(g);
+        group.request_offset = request_offset;
+        group.query_offset = query_offset;
+        group.task_start = s.tasks.size;
+
+        for (int start = 0; start < group.db->nframes(); start += SEARCH_TASK_FRAMES)
+        {
+            s.tasks.resize(s.tasks.size + 1);
+            s.tasks(s.tasks.size - 1).group = g;
+            s.tasks(s.tasks.size - 1).start = start;
+            s.tasks(s.tasks.size - 1).stop = mini(start + SEARCH_TASK_FRAMES, group.db->nframes());
+            s.tasks(s.tasks.size - 1).result_offset = result_offset;
+            result_offset += group.nqueries;
+        }
+
+        group.task_stop = s.tasks.size;
+        request_offset += group.nqueries;
+        query_offset += group.nqueries * group.nfeatures;
+        group.nqueries = 0;
+    }
+
+    s.group_requests.resize(request_offset);
+    s.group_queries.resize(query_offset);
+    s.task_best_indices.resize(result_offset);
+    s.task_best_costs.resize(result_offset);
+
+    if (request_offset > s.shared_capacity)
+    {
+        delete[] s.shared_costs;
+        s.shared_capacity = maxi(request_offset, s.shared_capacity + s.shared_capacity / 2);
+        s.shared_costs = new std::atomic<float>[s.shared_capacity];
+    }
+
+    for (int r = 0; r < request_offset; r++)
+    {
+        s.shared_costs[r].store(FLT_MAX, std::memory_order_relaxed);
+    }
+
+    for (int r = 0; r < s.requests.size; r++)
+    {
+        const search_request& request = s.requests(r);
+        search_group& group = s.groups(request.group);
+
+        s.group_requests(group.request_offset + group.nqueries) = r;
+
+        database_normalize_query(
+            slice1d<float>(group.nfeatures, &s.group_queries.data[group.query_offset + group.nqueries * group.nfeatures]),
+            *request.db,
+            slice1d<float>(request.db->nfeatures(), &s.request_queries.data[request.query_offset]));
+
+        group.nqueries++;
+    }
+}
+
+void search_run(search_scheduler& s)
+{
+    s.result_indices.resize(s.requests.size);
+    s.result_costs.resize(s.requests.size);
+
+    if (s.requests.size == 0) { return; }
+
+    search_build_groups(s);
+
+    worker_pool_run(s.workers, s.tasks.size, search_task_run, &s);
+
+    // Reduce in frame order so ties resolve the same way as a
+    // single search over the whole database
+    for (int g = 0; g < s.groups.size; g++)
+    {
+        const search_group& group = s.groups(g);
+
+        for (int q = 0; q < group.nqueries; q++)
+        {
+            int best_index = -1;
+            float best_cost = FLT_MAX;
+
+            for (int t = group.task_start; t < group.task_stop; t++)
+            {
+                int o = s.tasks(t).result_offset + q;
+
+                if (s.task_best_indices(o) != -1 && s.task_best_costs(o) < best_cost)
+                {
+                    best_index = s.task_best_indices(o);
+                    best_cost = s.task_best_costs(o);
+                }
+            }
+
+            int r = s.group_requests(group.request_offset + q);
+            s.result_indices(r) = best_index;
+            s.result_costs(r) = best_cost;
+        }
+    }
+
+    s.requests.resize(0);
+    s.request_queries.resize(0);
+}
+
+int search_result(const search_scheduler& s, const int ticket, float* best_cost)
+{
+    assert(ticket >= 0 && ticket < s.result_indices.size);
+
+    if (best_cost != NULL)
+    {
+        *best_cost = s.result_costs(ticket);
+    }
+
+    return s.result_indices(ticket);
+}
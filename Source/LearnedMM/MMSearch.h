@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMArray.h"
+#include "MMDatabase.h"
+#include "MMWorkers.h"
+
+#include <atomic>
+
+//--------------------------------------
+
+// Gathers the queries of every character for a frame and runs
+// them together. Queries against the same database are grouped,
+// the database is cut into tasks of `SEARCH_TASK_FRAMES` frames
+// and each task searches all queries of its group at once using
+// `motion_matching_search_batch`. Tasks are spread over the
+// workers of a `worker_pool`. Each query has a best cost shared between its tasks
+// so that a task can skip boxes already beaten by another. The
+// per task results are then reduced in frame order, so the 
+// result is exactly the same as `database_search`.
+
+enum
+{
+    SEARCH_TASK_FRAMES = 64 * BOUND_LR_SIZE,
+};
+
+struct search_request
+{
+    const database* db;
+    bool use_bounds;
+    int curr_index;
+    int query_offset;
+    int group;
+};
+
+// The padded layout and ranges ready of a database streaming in
+// can change at any time, so they are fixed once per run
+struct search_group
+{
+    const database* db;
+    bool use_bounds;
+    bool padded;
+    int nranges;
+    int nqueries;
+    int nfeatures;
+    int request_offset;
+    int query_offset;
+    int task_start;
+    int task_stop;
+};
+
+struct search_task
+{
+    int group;
+    int start;
+    int stop;
+    int result_offset;
+};
+
+struct search_scheduler
+{
+    float transition_cost;
+    int ignore_range_end;
+    int ignore_surrounding;
+
+    // Submitted since the last run
+    array1d<search_request> requests;
+    array1d<float> request_queries;
+
+    // Results of the last run, indexed by ticket
+    array1d<int> result_indices;
+    array1d<float> result_costs;
+
+    // Scratch rebuilt on each run
+    array1d<search_group> groups;
+    array1d<int> group_requests;
+    array1d<float> group_queries;
+    array1d<search_task> tasks;
+    array1d<int> task_best_indices;
+    array1d<float> task_best_costs;
+
+    // Best cost found so far by any task, one per group query
+    std::atomic<float>* shared_costs;
+    int shared_capacity;
+
+    // Workers the tasks run on, or NULL for the calling thread only
+    worker_pool* workers;
+
+    search_scheduler() : transition_cost(0.0f), ignore_range_end(20), ignore_surrounding(20), shared_costs(NULL), shared_capacity(0), workers(NULL) {}
+    search_scheduler(const search_scheduler&) = delete;
+    search_scheduler& operator=(const search_scheduler&) = delete;
+    ~search_scheduler();
+};
+
+// Queues a search and returns a ticket for reading the result
+// after the next `search_run`. `curr_index` is the frame being
+// played or -1. The database must stay loaded until the run.
+int search_submit(
+    search_scheduler& s,
+    const database* db,
+    const slice1d<float> query,
+    const int curr_index,
+    const bool use_bounds = true);
+
+int search_pending(const search_scheduler& s);
+
+// Runs every queued search, blocking until they are all done.
+// Results stay valid until the next run.
+void search_run(search_scheduler& s);
+
+// Returns the best index for a ticket, or -1 if nothing better
+// than the current frame was found and there was none.
+int search_result(const search_scheduler& s, const int ticket, float* best_cost = NULL);
+
+//--------------------------------------
+
+// Counts full searches and the local searches done instead when
+// the query has barely changed, and turns them into rates once a
+// second.
+struct search_stats
+{
+    int full_searches;
+    int local_searches;
+    float elapsed;
+
+    // Rates over the last whole second
+    float full_per_second;
+    float avoided_per_second;
+
+    search_stats() : full_searches(0), local_searches(0), elapsed(0.0f), full_per_second(0.0f), avoided_per_second(0.0f) {}
+};
+
+static inline void search_stats_record(search_stats& s, const bool full)
+{
+    if (full) { s.full_searches++; } else { s.local_searches++; }
+}
+
+// Returns true when new rates are available
+static inline bool search_stats_update(search_stats& s, const float dt)
+{
+    s.elapsed += dt;
+    if (s.elapsed < 1.0f) { return false; }
+
+    s.full_per_second = s.full_searches / s.elapsed;
+    s.avoided_per_second = s.local_searches / s.elapsed;
+    s.full_searches = 0;
+    s.local_searches = 0;
+    s.elapsed = 0.0f;
+    return true;
+}
@@ -0,0 +1,272 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMSearchSubsystem.h"
+#include "LearnedMMCharacter.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMisc.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+#include "MMDatabase.h"
+
+static TAutoConsoleVariable<int32> CVarSearchThreads(
+	TEXT("mm.SearchThreads"),
+	-1,
+	TEXT("Number of worker threads used for motion matching searches and learned motion matching networks in addition to the game thread. -1 uses all cores except those of the game and render threads. Takes effect for new worlds."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarSearchStats(
+	TEXT("mm.SearchStats"),
+	false,
+	TEXT("Logs the number of full motion matching searches per second, how many were avoided by local searches, the progress of databases streaming in, and the time spent in each learned motion matching network."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLodMaxFull(
+	TEXT("mm.LodMaxFull"),
+	-1,
+	TEXT("Most characters updating their motion matching at full rate, closest first. The rest drop to reduced rate. -1 for no limit."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarLodMaxReduced(
+	TEXT("mm.LodMaxReduced"),
+	-1,
+	TEXT("Most characters updating their motion matching at reduced rate. The rest only move their root. -1 for no limit."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarFrameBudgetMs(
+	TEXT("mm.FrameBudgetMs"),
+	0.0f,
+	TEXT("Milliseconds per frame for motion matching searches and projections. Work over the budget waits for a later frame, player controlled, on screen and close characters first. 0 for no limit."),
+	ECVF_Default);
+
+//--------------------------------------------------------------------------//
+
+void FMMSearchTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if (Target != nullptr)
+	{
+		Target->RunSearches();
+		Target->RunNetworks();
+		Target->UpdateLods();
+		Target->UpdateStats(DeltaTime);
+		Target->EndBudgetFrame();
+	}
+}
+
+FString FMMSearchTickFunction::DiagnosticMessage()
+{
+	return TEXT("FMMSearchTickFunction");
+}
+
+//--------------------------------------------------------------------------//
+
+void UMMSearchSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	int32 NumThreads = CVarSearchThreads.GetValueOnGameThread();
+	if (NumThreads < 0)
+	{
+		NumThreads = FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 2;
+	}
+
+	worker_pool_start(Workers, FMath::Clamp(NumThreads, 0, WORKERS_MAX - 1));
+	Scheduler.workers = &Workers;
+	Inference.workers = &Workers;
+
+	SearchTickFunction.Target = this;
+	SearchTickFunction.TickGroup = TG_DuringPhysics;
+	SearchTickFunction.bCanEverTick = true;
+	SearchTickFunction.bStartWithTickEnabled = true;
+}
+
+void UMMSearchSubsystem::Deinitialize()
+{
+	if (SearchTickFunction.IsTickFunctionRegistered())
+	{
+		SearchTickFunction.UnRegisterTickFunction();
+	}
+
+	worker_pool_stop(Workers);
+
+	Super::Deinitialize();
+}
+
+void UMMSearchSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	SearchTickFunction.RegisterTickFunction(InWorld.PersistentLevel);
+}
+
+bool UMMSearchSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+int32 UMMSearchSubsystem::Submit(const database* Database, const slice1d<float> Query, int32 CurrentIndex, bool bUseBounds)
+{
+	return search_submit(Scheduler, Database, Query, CurrentIndex, bUseBounds);
+}
+
+int32 UMMSearchSubsystem::GetResult(int32 Ticket, float* OutCost)
+{
+	if (search_pending(Scheduler) > 0)
+	{
+		RunSearches();
+	}
+
+	return search_result(Scheduler, Ticket, OutCost);
+}
+
+void UMMSearchSubsystem::RunSearches()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UMMSearchSubsystem::RunSearches);
+
+	const int32 NumSearches = search_pending(Scheduler);
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	search_run(Scheduler);
+
+	// Searches run together, so each is charged its share of the run
+	if (NumSearches > 0)
+	{
+		budget_cost_record(Budget, BUDGET_SEARCH, FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) / NumSearches);
+	}
+}
+
+int32 UMMSearchSubsystem::SubmitNetwork(ALearnedMMCharacter* Character, int32 Stage, const nnet* Network, const slice1d<float> Input)
+{
+	NetworkStages.Add(Stage);
+	NetworkCharacters.AddUnique(Character);
+
+	return inference_submit(Inference, Network, Input);
+}
+
+slice1d<float> UMMSearchSubsystem::GetNetworkResult(int32 Ticket) const
+{
+	return inference_result(Inference, Ticket);
+}
+
+void UMMSearchSubsystem::RunNetworks()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(UMMSearchSubsystem::RunNetworks);
+
+	while (inference_pending(Inference) > 0)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		inference_run(Inference);
+
+		// Networks run together, so each is charged its share of the round
+		const double Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles) / NetworkStages.Num();
+
+		for (const int32 Stage : NetworkStages)
+		{
+			RecordNetwork(Stage, Seconds);
+		}
+
+		NetworkStages.Reset();
+
+		// Characters continued here submit the next round
+		TArray<TWeakObjectPtr<ALearnedMMCharacter>> Characters = MoveTemp(NetworkCharacters);
+		NetworkCharacters.Reset();
+
+		for (const TWeakObjectPtr<ALearnedMMCharacter>& Character : Characters)
+		{
+			if (Character.IsValid())
+			{
+				Character->LearnedMotionMatchingContinue();
+			}
+		}
+	}
+}
+
+bool UMMSearchSubsystem::AdmitWork(int32 Kind, float Priority)
+{
+	return budget_admit(Budget, Kind, Priority);
+}
+
+void UMMSearchSubsystem::RecordWork(int32 Kind, double Seconds)
+{
+	budget_cost_record(Budget, Kind, Seconds);
+}
+
+void UMMSearchSubsystem::EndBudgetFrame()
+{
+	budget_frame(Budget, CVarFrameBudgetMs.GetValueOnGameThread() / 1000.0f);
+}
+
+void UMMSearchSubsystem::RecordSearch(bool bFull)
+{
+	search_stats_record(Stats, bFull);
+}
+
+int32 UMMSearchSubsystem::AddLod()
+{
+	return lod_add(Lods);
+}
+
+void UMMSearchSubsystem::RemoveLod(int32 Handle)
+{
+	lod_remove(Lods, Handle);
+}
+
+void UMMSearchSubsystem::RequestLod(int32 Handle, float Distance, int32 Tier)
+{
+	lod_request(Lods, Handle, Distance, Tier);
+}
+
+int32 UMMSearchSubsystem::GetLodTier(int32 Handle) const
+{
+	return lod_tier(Lods, Handle);
+}
+
+void UMMSearchSubsystem::UpdateLods()
+{
+	lod_assign(Lods, CVarLodMaxFull.GetValueOnGameThread(), CVarLodMaxReduced.GetValueOnGameThread());
+}
+
+void UMMSearchSubsystem::RecordNetwork(int32 Stage, double Seconds)
+{
+	lmm_stats_record(NetworkStats, Stage, Seconds);
+
+	if (Stage == LMM_PROJECTOR)
+	{
+		budget_cost_record(Budget, BUDGET_PROJECTOR, Seconds);
+	}
+}
+
+void UMMSearchSubsystem::UpdateStats(float DeltaTime)
+{
+	if (search_stats_update(Stats, DeltaTime) && CVarSearchStats.GetValueOnGameThread())
+	{
+		UE_LOG(LogTemp, Log, TEXT("Motion matching: %.1f full searches/s, %.1f avoided/s, characters at %d full, %d reduced, %d trajectory only"),
+			Stats.full_per_second, Stats.avoided_per_second,
+			Lods.counts[LOD_FULL], Lods.counts[LOD_REDUCED], Lods.counts[LOD_TRAJECTORY]);
+
+		if (Budget.budget > 0.0f)
+		{
+			UE_LOG(LogTemp, Log, TEXT("Motion matching budget: %d admitted and %d deferred last frame, %d deferred in total"),
+				Budget.last_admitted, Budget.last_deferred, Budget.total_deferred);
+		}
+
+		float StreamProgress = 1.0f;
+		const int32 NumStreaming = database_streaming(StreamProgress);
+
+		if (NumStreaming > 0)
+		{
+			UE_LOG(LogTemp, Log, TEXT("Motion matching: %d databases streaming in, %.0f%% done"), NumStreaming, 100.0f * StreamProgress);
+		}
+	}
+
+	if (lmm_stats_update(NetworkStats, DeltaTime) && CVarSearchStats.GetValueOnGameThread() && NetworkStats.evaluations_per_second[LMM_DECOMPRESSOR] > 0.0f)
+	{
+		UE_LOG(LogTemp, Log, TEXT("Learned motion matching: stepper %.3fms/frame (%.1f/s), projector %.3fms/frame (%.1f/s), decompressor %.3fms/frame (%.1f/s)"),
+			NetworkStats.ms_per_frame[LMM_STEPPER], NetworkStats.evaluations_per_second[LMM_STEPPER],
+			NetworkStats.ms_per_frame[LMM_PROJECTOR], NetworkStats.evaluations_per_second[LMM_PROJECTOR],
+			NetworkStats.ms_per_frame[LMM_DECOMPRESSOR], NetworkStats.evaluations_per_second[LMM_DECOMPRESSOR]);
+	}
+}
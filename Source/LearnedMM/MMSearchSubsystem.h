@@ -0,0 +1,141 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "MMArray.h"
+#include "MMSearch.h"
+#include "MMInference.h"
+#include "MMWorkers.h"
+#include "MMLmm.h"
+#include "MMLod.h"
+#include "MMBudget.h"
+#include "MMSearchSubsystem.generated.h"
+
+class UMMSearchSubsystem;
+class ALearnedMMCharacter;
+struct database;
+
+/** Runs the motion matching searches and networks of every character, after characters tick and before they update their pose */
+USTRUCT()
+struct FMMSearchTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	UMMSearchSubsystem* Target = nullptr;
+
+	virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FMMSearchTickFunction> : public TStructOpsTypeTraitsBase2<FMMSearchTickFunction>
+{
+	enum { WithCopy = false };
+};
+
+/**
+ * Gathers the motion matching queries of every character each frame and searches them together
+ * on worker threads, instead of each character searching on its own on the game thread.
+ * Characters submit in their Tick (TG_PrePhysics), the searches run in TG_DuringPhysics and
+ * characters read their results from a tick function in TG_PostPhysics.
+ *
+ * Learned motion matching networks are gathered the same way and evaluated in batches on the
+ * same worker threads. A step runs its networks one after another, so they run in rounds in
+ * TG_DuringPhysics: after each round the characters read their outputs and submit the next
+ * network of their step, until every step is done.
+ */
+UCLASS()
+class UMMSearchSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	/** Queues a search for this frame and returns a ticket for GetResult. CurrentIndex is the frame being played or -1 */
+	int32 Submit(const database* Database, const slice1d<float> Query, int32 CurrentIndex, bool bUseBounds);
+
+	/** Best frame for a ticket. Runs the queued searches first if they have not run yet */
+	int32 GetResult(int32 Ticket, float* OutCost = nullptr);
+
+	/** Runs every queued search */
+	void RunSearches();
+
+	/** Counts a search done by a character, either a full one or a local one done instead because its query barely changed */
+	void RecordSearch(bool bFull);
+
+	/** Registers a character for level of detail. Returns a handle for RequestLod and GetLodTier */
+	int32 AddLod();
+	void RemoveLod(int32 Handle);
+
+	/** Asks for a tier (an lod_tier) for a character at a distance from the camera. Tiers are given out once a frame in UpdateLods */
+	void RequestLod(int32 Handle, float Distance, int32 Tier);
+
+	/** Tier given to a character by the last UpdateLods */
+	int32 GetLodTier(int32 Handle) const;
+
+	/** Gives every character its requested tier, closest first, within the budget set by mm.LodMaxFull and mm.LodMaxReduced */
+	void UpdateLods();
+
+	/** Asks to run work which can wait (a budget_work) this frame. Returns false when it does not fit in mm.FrameBudgetMs, in which case the work should be tried again next frame */
+	bool AdmitWork(int32 Kind, float Priority);
+
+	/** Adds the time taken by admitted work of a kind (a budget_work) to the cost AdmitWork expects of it */
+	void RecordWork(int32 Kind, double Seconds);
+
+	/** Ends the frame's budget, working out which priorities get to run next frame */
+	void EndBudgetFrame();
+
+	/**
+	 * Queues the evaluation of one of a character's learned motion matching networks (an lmm_stage)
+	 * and returns a ticket for GetNetworkResult. Once the round runs, the character is continued
+	 * with LearnedMotionMatchingContinue, where it reads the output and may submit its next network.
+	 */
+	int32 SubmitNetwork(ALearnedMMCharacter* Character, int32 Stage, const nnet* Network, const slice1d<float> Input);
+
+	/** Output of a network run by the last round. Only valid while the round's characters are continued */
+	slice1d<float> GetNetworkResult(int32 Ticket) const;
+
+	/** Runs rounds of queued networks until no character submits any more */
+	void RunNetworks();
+
+	/** Adds the time a character spent evaluating one of its learned motion matching networks, an lmm_stage */
+	void RecordNetwork(int32 Stage, double Seconds);
+
+	/** Turns the recorded searches and network times into averages once a second and logs them when mm.SearchStats is set */
+	void UpdateStats(float DeltaTime);
+
+	const search_stats& GetStats() const { return Stats; }
+	const lmm_stats& GetNetworkStats() const { return NetworkStats; }
+	const lod_scheduler& GetLods() const { return Lods; }
+	const budget_scheduler& GetBudget() const { return Budget; }
+
+	FTickFunction& GetSearchTickFunction() { return SearchTickFunction; }
+
+private:
+	FMMSearchTickFunction SearchTickFunction;
+
+	/** Threads shared by the searches and the networks */
+	worker_pool Workers;
+
+	search_scheduler Scheduler;
+
+	inference_scheduler Inference;
+
+	/** Stage of each queued network and the characters waiting on them */
+	TArray<int32> NetworkStages;
+	TArray<TWeakObjectPtr<ALearnedMMCharacter>> NetworkCharacters;
+
+	lod_scheduler Lods;
+
+	budget_scheduler Budget;
+
+	search_stats Stats;
+	lmm_stats NetworkStats;
+};
@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+
+//--------------------------------------
+
+// Instruction sets available at compile time. Kernels have an
+// AVX2 path processing 8 floats at a time, an SSE path for 4 
+// and a scalar loop for the remainder or other platforms.
+
+#if defined(__AVX2__)
+#define MM_SIMD_AVX2 1
+#else
+#define MM_SIMD_AVX2 0
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MM_SIMD_SSE 1
+#else
+#define MM_SIMD_SSE 0
+#endif
+
+#if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define MM_SIMD_FMA 1
+#else
+#define MM_SIMD_FMA 0
+#endif
+
+// Half precision conversion instructions, present on every CPU
+// with AVX2
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define MM_SIMD_F16C 1
+#else
+#define MM_SIMD_F16C 0
+#endif
+
+#if MM_SIMD_AVX2 || MM_SIMD_SSE
+#include <immintrin.h>
+#endif
+
+//--------------------------------------
+
+#if MM_SIMD_SSE
+
+static inline __m128 fast_negexpf_sse(__m128 x)
+{
+    __m128 p = _mm_add_ps(_mm_set1_ps(0.48f), _mm_mul_ps(_mm_set1_ps(0.235f), x));
+    p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x, p));
+    p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x, p));
+    return _mm_div_ps(_mm_set1_ps(1.0f), p);
+}
+
+// Horizontal sum of all four lanes
+static inline float hsum_sse(__m128 x)
+{
+    __m128 s = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+    return _mm_cvtss_f32(s);
+}
+
+#endif
+
+#if MM_SIMD_AVX2
+
+static inline __m256 fast_negexpf_avx(__m256 x)
+{
+    __m256 p = _mm256_add_ps(_mm256_set1_ps(0.48f), _mm256_mul_ps(_mm256_set1_ps(0.235f), x));
+    p = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(x, p));
+    p = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(x, p));
+    return _mm256_div_ps(_mm256_set1_ps(1.0f), p);
+}
+
+static inline float hsum_avx(__m256 x)
+{
+    return hsum_sse(_mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1)));
+}
+
+// `a * b + c`, fused when FMA is available
+static inline __m256 fmadd_avx(__m256 a, __m256 b, __m256 c)
+{
+#if MM_SIMD_FMA
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+#endif
+
+// `fast_negexpf` over `n` values
+static inline void fast_negexpf_batch(float* out, const float* x, const int n)
+{
+    int i = 0;
+
+#if MM_SIMD_AVX2
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, fast_negexpf_avx(_mm256_loadu_ps(x + i)));
+    }
+#endif
+
+#if MM_SIMD_SSE
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, fast_negexpf_sse(_mm_loadu_ps(x + i)));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        out[i] = fast_negexpf(x[i]);
+    }
+}
@@ -0,0 +1,268 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMArray.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+
+//--------------------------------------
+
+// Structure-of-arrays versions of `slice1d<vec3>` and 
+// `slice1d<quat>` where each component is its own contiguous
+// `slice1d<float>`. Per-bone loops over these read and write
+// whole lanes of one component at a time, so the batched 
+// functions below compile to straight SIMD code.
+
+struct soa_vec3_slice
+{
+    slice1d<float> x, y, z;
+
+    soa_vec3_slice(slice1d<float> _x, slice1d<float> _y, slice1d<float> _z) : x(_x), y(_y), z(_z) 
+    {
+        assert(x.size == y.size && x.size == z.size);
+    }
+
+    inline int size() const { return x.size; }
+    inline vec3 operator()(int i) const { return vec3(x(i), y(i), z(i)); }
+    inline void set(int i, const vec3 v) const { x(i) = v.x; y(i) = v.y; z(i) = v.z; }
+
+    // Sub-range of `count` elements starting at `start`
+    inline soa_vec3_slice range(int start, int count) const
+    {
+        assert(start >= 0 && start + count <= size());
+        return soa_vec3_slice(
+            slice1d<float>(count, x.data + start),
+            slice1d<float>(count, y.data + start),
+            slice1d<float>(count, z.data + start));
+    }
+};
+
+struct soa_quat_slice
+{
+    slice1d<float> w, x, y, z;
+
+    soa_quat_slice(slice1d<float> _w, slice1d<float> _x, slice1d<float> _y, slice1d<float> _z) : w(_w), x(_x), y(_y), z(_z) 
+    {
+        assert(w.size == x.size && w.size == y.size && w.size == z.size);
+    }
+
+    inline int size() const { return w.size; }
+    inline quat operator()(int i) const { return quat(w(i), x(i), y(i), z(i)); }
+    inline void set(int i, const quat q) const { w(i) = q.w; x(i) = q.x; y(i) = q.y; z(i) = q.z; }
+
+    inline soa_quat_slice range(int start, int count) const
+    {
+        assert(start >= 0 && start + count <= size());
+        return soa_quat_slice(
+            slice1d<float>(count, w.data + start),
+            slice1d<float>(count, x.data + start),
+            slice1d<float>(count, y.data + start),
+            slice1d<float>(count, z.data + start));
+    }
+};
+
+// Owning storage. All components are allocated in one block
+// with each component padded to a multiple of 16 floats, so
+// every component starts on a 64 byte boundary.
+struct soa_vec3_array
+{
+    int size;
+    array1d<float> storage;
+
+    soa_vec3_array() : size(0) {}
+    soa_vec3_array(int _size) : soa_vec3_array() { resize(_size); }
+
+    inline int stride() const { return (size + 15) & ~15; }
+
+    void resize(int _size)
+    {
+        size = _size;
+        storage.resize(stride() * 3);
+    }
+
+    operator soa_vec3_slice() const
+    {
+        return soa_vec3_slice(
+            slice1d<float>(size, storage.data + stride() * 0),
+            slice1d<float>(size, storage.data + stride() * 1),
+            slice1d<float>(size, storage.data + stride() * 2));
+    }
+
+    inline vec3 operator()(int i) const { return ((soa_vec3_slice)*this)(i); }
+    inline void set(int i, const vec3 v) const { ((soa_vec3_slice)*this).set(i, v); }
+};
+
+struct soa_quat_array
+{
+    int size;
+    array1d<float> storage;
+
+    soa_quat_array() : size(0) {}
+    soa_quat_array(int _size) : soa_quat_array() { resize(_size); }
+
+    inline int stride() const { return (size + 15) & ~15; }
+
+    void resize(int _size)
+    {
+        size = _size;
+        storage.resize(stride() * 4);
+    }
+
+    operator soa_quat_slice() const
+    {
+        return soa_quat_slice(
+            slice1d<float>(size, storage.data + stride() * 0),
+            slice1d<float>(size, storage.data + stride() * 1),
+            slice1d<float>(size, storage.data + stride() * 2),
+            slice1d<float>(size, storage.data + stride() * 3));
+    }
+
+    inline quat operator()(int i) const { return ((soa_quat_slice)*this)(i); }
+    inline void set(int i, const quat q) const { ((soa_quat_slice)*this).set(i, q); }
+};
+
+//--------------------------------------
+
+static inline void soa_from_aos(soa_vec3_slice out, const slice1d<vec3> in)
+{
+    assert(out.size() == in.size);
+    for (int i = 0; i < in.size; i++)
+    {
+        out.x.data[i] = in.data[i].x;
+        out.y.data[i] = in.data[i].y;
+        out.z.data[i] = in.data[i].z;
+    }
+}
+
+static inline void soa_from_aos(soa_quat_slice out, const slice1d<quat> in)
+{
+    assert(out.size() == in.size);
+    for (int i = 0; i < in.size; i++)
+    {
+        out.w.data[i] = in.data[i].w;
+        out.x.data[i] = in.data[i].x;
+        out.y.data[i] = in.data[i].y;
+        out.z.data[i] = in.data[i].z;
+    }
+}
+
+static inline void aos_from_soa(slice1d<vec3> out, const soa_vec3_slice in)
+{
+    assert(out.size == in.size());
+    for (int i = 0; i < out.size; i++)
+    {
+        out.data[i] = vec3(in.x.data[i], in.y.data[i], in.z.data[i]);
+    }
+}
+
+static inline void aos_from_soa(slice1d<quat> out, const soa_quat_slice in)
+{
+    assert(out.size == in.size());
+    for (int i = 0; i < out.size; i++)
+    {
+        out.data[i] = quat(in.w.data[i], in.x.data[i], in.y.data[i], in.z.data[i]);
+    }
+}
+
+//--------------------------------------
+
+// Batched versions of the functions in MMVec.h and MMQuat.h.
+// Outputs may be the same arrays as inputs. They are written
+// as plain loops over single components with no branches so 
+// the compiler can vectorize them across 4 or 8 lanes.
+
+static inline void lerp_batch(
+    soa_vec3_slice out, 
+    const soa_vec3_slice v, 
+    const soa_vec3_slice w, 
+    const float alpha)
+{
+    assert(out.size() == v.size() && out.size() == w.size());
+    const int n = out.size();
+
+    for (int i = 0; i < n; i++) { out.x.data[i] = v.x.data[i] * (1.0f - alpha) + w.x.data[i] * alpha; }
+    for (int i = 0; i < n; i++) { out.y.data[i] = v.y.data[i] * (1.0f - alpha) + w.y.data[i] * alpha; }
+    for (int i = 0; i < n; i++) { out.z.data[i] = v.z.data[i] * (1.0f - alpha) + w.z.data[i] * alpha; }
+}
+
+static inline void quat_mul_batch(
+    soa_quat_slice out, 
+    const soa_quat_slice q, 
+    const soa_quat_slice p)
+{
+    assert(out.size() == q.size() && out.size() == p.size());
+    const int n = out.size();
+
+    for (int i = 0; i < n; i++)
+    {
+        float qw = q.w.data[i], qx = q.x.data[i], qy = q.y.data[i], qz = q.z.data[i];
+        float pw = p.w.data[i], px = p.x.data[i], py = p.y.data[i], pz = p.z.data[i];
+
+        out.w.data[i] = pw * qw - px * qx - py * qy - pz * qz;
+        out.x.data[i] = pw * qx + px * qw - py * qz + pz * qy;
+        out.y.data[i] = pw * qy + px * qz + py * qw - pz * qx;
+        out.z.data[i] = pw * qz - px * qy + py * qx + pz * qw;
+    }
+}
+
+static inline void quat_mul_vec3_batch(
+    soa_vec3_slice out, 
+    const soa_quat_slice q, 
+    const soa_vec3_slice v)
+{
+    assert(out.size() == q.size() && out.size() == v.size());
+    const int n = out.size();
+
+    for (int i = 0; i < n; i++)
+    {
+        float qw = q.w.data[i], qx = q.x.data[i], qy = q.y.data[i], qz = q.z.data[i];
+        float vx = v.x.data[i], vy = v.y.data[i], vz = v.z.data[i];
+
+        // t = 2 * cross(q.xyz, v)
+        float tx = 2.0f * (qy * vz - qz * vy);
+        float ty = 2.0f * (qz * vx - qx * vz);
+        float tz = 2.0f * (qx * vy - qy * vx);
+
+        // v + q.w * t + cross(q.xyz, t)
+        out.x.data[i] = vx + qw * tx + (qy * tz - qz * ty);
+        out.y.data[i] = vy + qw * ty + (qz * tx - qx * tz);
+        out.z.data[i] = vz + qw * tz + (qx * ty - qy * tx);
+    }
+}
+
+static inline void quat_slerp_shortest_approx_batch(
+    soa_quat_slice out, 
+    const soa_quat_slice q, 
+    const soa_quat_slice p, 
+    const float alpha)
+{
+    assert(out.size() == q.size() && out.size() == p.size());
+    const int n = out.size();
+
+    for (int i = 0; i < n; i++)
+    {
+        float qw = q.w.data[i], qx = q.x.data[i], qy = q.y.data[i], qz = q.z.data[i];
+        float pw = p.w.data[i], px = p.x.data[i], py = p.y.data[i], pz = p.z.data[i];
+
+        float ca = qw * pw + qx * px + qy * py + qz * pz;
+        float d = fabsf(ca);
+        float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+        float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+        float k = a * (alpha - 0.5f) * (alpha - 0.5f) + b;
+        float oalpha = alpha + alpha * (alpha - 0.5f) * (alpha - 1) * k;
+
+        // Flip `p` onto the same hemisphere without branching
+        float s = copysignf(oalpha, ca);
+        float rw = (1.0f - oalpha) * qw + s * pw;
+        float rx = (1.0f - oalpha) * qx + s * px;
+        float ry = (1.0f - oalpha) * qy + s * py;
+        float rz = (1.0f - oalpha) * qz + s * pz;
+
+        float inv_length = 1.0f / (sqrtf(rw * rw + rx * rx + ry * ry + rz * rz) + 1e-8f);
+        out.w.data[i] = rw * inv_length;
+        out.x.data[i] = rx * inv_length;
+        out.y.data[i] = ry * inv_length;
+        out.z.data[i] = rz * inv_length;
+    }
+}
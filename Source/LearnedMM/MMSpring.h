@@ -2,23 +2,11 @@
 
 #pragma once
 
-#include "CoreMinimal.h"
 #include "MMCommon.h"
 #include "MMVec.h"
 #include "MMQuat.h"
-
-/**
- * 
- */
-class LEARNEDMM_API MMSpring
-{
-public:
-	MMSpring();
-	~MMSpring();
-};
-
-
-
+#include "MMArray.h"
+#include "MMSimd.h"
 
 //--------------------------------------
 // 
@@ -229,3 +217,239 @@ static inline void inertialize_update(
     out_x = quat_mul(off_x, in_x);
     out_v = off_v + quat_mul_vec3(off_x, in_v);
 }
+
+//--------------------------------------
+
+// Batched versions of the springs above for whole poses. As 
+// the halflife and dt are shared by every element, the 
+// exponential is evaluated once and the rest is a handful of 
+// multiply-adds over flat arrays of floats. With `HasGoal` 
+// false this is the decay spring, i.e. a goal of zero.
+template<bool HasGoal>
+static inline void spring_damper_exact_kernel(
+    float* x,
+    float* v,
+    const float* x_goal,
+    const int n,
+    const float halflife,
+    const float dt)
+{
+    const float y = halflife_to_damping(halflife) / 2.0f;
+    const float eydt = fast_negexpf(y * dt);
+    int i = 0;
+
+#if MM_SIMD_AVX2
+    {
+        const __m256 y8 = _mm256_set1_ps(y);
+        const __m256 dt8 = _mm256_set1_ps(dt);
+        const __m256 ydt8 = _mm256_set1_ps(y * dt);
+        const __m256 eydt8 = _mm256_set1_ps(eydt);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 xi = _mm256_loadu_ps(x + i);
+            __m256 vi = _mm256_loadu_ps(v + i);
+            __m256 gi = HasGoal ? _mm256_loadu_ps(x_goal + i) : _mm256_setzero_ps();
+            __m256 j0 = _mm256_sub_ps(xi, gi);
+            __m256 j1 = _mm256_add_ps(vi, _mm256_mul_ps(j0, y8));
+
+            _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_mul_ps(eydt8, _mm256_add_ps(j0, _mm256_mul_ps(j1, dt8))), gi));
+            _mm256_storeu_ps(v + i, _mm256_mul_ps(eydt8, _mm256_sub_ps(vi, _mm256_mul_ps(j1, ydt8))));
+        }
+    }
+#endif
+
+#if MM_SIMD_SSE
+    {
+        const __m128 y4 = _mm_set1_ps(y);
+        const __m128 dt4 = _mm_set1_ps(dt);
+        const __m128 ydt4 = _mm_set1_ps(y * dt);
+        const __m128 eydt4 = _mm_set1_ps(eydt);
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 xi = _mm_loadu_ps(x + i);
+            __m128 vi = _mm_loadu_ps(v + i);
+            __m128 gi = HasGoal ? _mm_loadu_ps(x_goal + i) : _mm_setzero_ps();
+            __m128 j0 = _mm_sub_ps(xi, gi);
+            __m128 j1 = _mm_add_ps(vi, _mm_mul_ps(j0, y4));
+
+            _mm_storeu_ps(x + i, _mm_add_ps(_mm_mul_ps(eydt4, _mm_add_ps(j0, _mm_mul_ps(j1, dt4))), gi));
+            _mm_storeu_ps(v + i, _mm_mul_ps(eydt4, _mm_sub_ps(vi, _mm_mul_ps(j1, ydt4))));
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        float g = HasGoal ? x_goal[i] : 0.0f;
+        float j0 = x[i] - g;
+        float j1 = v[i] + j0 * y;
+
+        x[i] = eydt * (j0 + j1 * dt) + g;
+        v[i] = eydt * (v[i] - j1 * y * dt);
+    }
+}
+
+static_assert(sizeof(vec3) == 3 * sizeof(float), "vec3 must be tightly packed to be treated as floats");
+
+static inline void simple_spring_damper_exact_batch(
+    slice1d<vec3> x,
+    slice1d<vec3> v,
+    const slice1d<vec3> x_goal,
+    const float halflife,
+    const float dt)
+{
+    assert(x.size == v.size && x.size == x_goal.size);
+    spring_damper_exact_kernel<true>((float*)x.data, (float*)v.data, (const float*)x_goal.data, x.size * 3, halflife, dt);
+}
+
+static inline void decay_spring_damper_exact_batch(
+    slice1d<vec3> x,
+    slice1d<vec3> v,
+    const float halflife,
+    const float dt)
+{
+    assert(x.size == v.size);
+    spring_damper_exact_kernel<false>((float*)x.data, (float*)v.data, NULL, x.size * 3, halflife, dt);
+}
+
+// Rotations need the log and exp maps per element, but the
+// exponential of the damping is still only evaluated once.
+static inline void decay_spring_damper_exact_batch(
+    slice1d<quat> x,
+    slice1d<vec3> v,
+    const float halflife,
+    const float dt)
+{
+    assert(x.size == v.size);
+
+    const float y = halflife_to_damping(halflife) / 2.0f;
+    const float eydt = fast_negexpf(y * dt);
+
+    for (int i = 0; i < x.size; i++)
+    {
+        vec3 j0 = quat_to_scaled_angle_axis(x.data[i]);
+        vec3 j1 = v.data[i] + j0 * y;
+
+        x.data[i] = quat_from_scaled_angle_axis(eydt * (j0 + j1 * dt));
+        v.data[i] = eydt * (v.data[i] - j1 * y * dt);
+    }
+}
+
+// Scalar springs where every element has its own halflife, 
+// such as the gaits or facing of a crowd of characters. Here 
+// the exponential itself is vectorized.
+static inline void simple_spring_damper_exact_batch(
+    slice1d<float> x,
+    slice1d<float> v,
+    const slice1d<float> x_goal,
+    const slice1d<float> halflife,
+    const float dt,
+    const float eps = 1e-5f)
+{
+    assert(x.size == v.size && x.size == x_goal.size && x.size == halflife.size);
+
+    const int n = x.size;
+    int i = 0;
+
+#if MM_SIMD_AVX2
+    {
+        const __m256 dt8 = _mm256_set1_ps(dt);
+        const __m256 eps8 = _mm256_set1_ps(eps);
+        const __m256 damping8 = _mm256_set1_ps(2.0f * LN2f);
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 y = _mm256_div_ps(damping8, _mm256_add_ps(_mm256_loadu_ps(halflife.data + i), eps8));
+            __m256 ydt = _mm256_mul_ps(y, dt8);
+            __m256 eydt = fast_negexpf_avx(ydt);
+            __m256 xi = _mm256_loadu_ps(x.data + i);
+            __m256 vi = _mm256_loadu_ps(v.data + i);
+            __m256 gi = _mm256_loadu_ps(x_goal.data + i);
+            __m256 j0 = _mm256_sub_ps(xi, gi);
+            __m256 j1 = _mm256_add_ps(vi, _mm256_mul_ps(j0, y));
+
+            _mm256_storeu_ps(x.data + i, _mm256_add_ps(_mm256_mul_ps(eydt, _mm256_add_ps(j0, _mm256_mul_ps(j1, dt8))), gi));
+            _mm256_storeu_ps(v.data + i, _mm256_mul_ps(eydt, _mm256_sub_ps(vi, _mm256_mul_ps(j1, ydt))));
+        }
+    }
+#endif
+
+#if MM_SIMD_SSE
+    {
+        const __m128 dt4 = _mm_set1_ps(dt);
+        const __m128 eps4 = _mm_set1_ps(eps);
+        const __m128 damping4 = _mm_set1_ps(2.0f * LN2f);
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 y = _mm_div_ps(damping4, _mm_add_ps(_mm_loadu_ps(halflife.data + i), eps4));
+            __m128 ydt = _mm_mul_ps(y, dt4);
+            __m128 eydt = fast_negexpf_sse(ydt);
+            __m128 xi = _mm_loadu_ps(x.data + i);
+            __m128 vi = _mm_loadu_ps(v.data + i);
+            __m128 gi = _mm_loadu_ps(x_goal.data + i);
+            __m128 j0 = _mm_sub_ps(xi, gi);
+            __m128 j1 = _mm_add_ps(vi, _mm_mul_ps(j0, y));
+
+            _mm_storeu_ps(x.data + i, _mm_add_ps(_mm_mul_ps(eydt, _mm_add_ps(j0, _mm_mul_ps(j1, dt4))), gi));
+            _mm_storeu_ps(v.data + i, _mm_mul_ps(eydt, _mm_sub_ps(vi, _mm_mul_ps(j1, ydt))));
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        simple_spring_damper_exact(x.data[i], v.data[i], x_goal.data[i], halflife.data[i], dt);
+    }
+}
+
+//--------------------------------------
+
+static inline void inertialize_update_batch(
+    slice1d<vec3> out_x,
+    slice1d<vec3> out_v,
+    slice1d<vec3> off_x,
+    slice1d<vec3> off_v,
+    const slice1d<vec3> in_x,
+    const slice1d<vec3> in_v,
+    const float halflife,
+    const float dt)
+{
+    assert(out_x.size == off_x.size && out_x.size == in_x.size);
+
+    decay_spring_damper_exact_batch(off_x, off_v, halflife, dt);
+
+    const int n = out_x.size * 3;
+    float* ox = (float*)out_x.data;
+    float* ov = (float*)out_v.data;
+    const float* fx = (const float*)off_x.data;
+    const float* fv = (const float*)off_v.data;
+    const float* ix = (const float*)in_x.data;
+    const float* iv = (const float*)in_v.data;
+
+    for (int i = 0; i < n; i++) { ox[i] = ix[i] + fx[i]; }
+    for (int i = 0; i < n; i++) { ov[i] = iv[i] + fv[i]; }
+}
+
+static inline void inertialize_update_batch(
+    slice1d<quat> out_x,
+    slice1d<vec3> out_v,
+    slice1d<quat> off_x,
+    slice1d<vec3> off_v,
+    const slice1d<quat> in_x,
+    const slice1d<vec3> in_v,
+    const float halflife,
+    const float dt)
+{
+    assert(out_x.size == off_x.size && out_x.size == in_x.size);
+
+    decay_spring_damper_exact_batch(off_x, off_v, halflife, dt);
+
+    for (int i = 0; i < out_x.size; i++)
+    {
+        out_x.data[i] = quat_mul(off_x.data[i], in_x.data[i]);
+        out_v.data[i] = off_v.data[i] + quat_mul_vec3(off_x.data[i], in_v.data[i]);
+    }
+}
@@ -0,0 +1,162 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMStream.h"
+#include "MMDatabase.h"
+
+//--------------------------------------
+
+database_stream::~database_stream()
+{
+    stream_close(*this);
+}
+
+static void stream_add_table(database_stream& s, const void* data, const size_t row_bytes)
+{
+    assert(s.ntables < STREAM_MAX_TABLES);
+
+    s.tables[s.ntables].data = (const char*)data;
+    s.tables[s.ntables].row_bytes = row_bytes;
+    s.bytes_total += row_bytes * s.db->nframes();
+    s.ntables++;
+}
+
+// Reads one byte of every page so the operating system brings
+// them all in. Returns something depending on the reads so they
+// are not optimized away.
+static char stream_touch(const char* data, const size_t bytes)
+{
+    const size_t page = 4096;
+
+    char sum = 0;
+    for (size_t i = 0; i < bytes; i += page)
+    {
+        sum ^= ((const volatile char*)data)[i];
+    }
+
+    return bytes > 0 ? sum ^ ((const volatile char*)data)[bytes - 1] : sum;
+}
+
+static void stream_prefetch_range(const database_stream& s, const int r)
+{
+    const database& db = *s.db;
+
+    for (int t = 0; t < s.ntables; t++)
+    {
+        const stream_table& table = s.tables[t];
+        mapped_file_prefetch(
+            table.data + table.row_bytes * db.range_starts(r),
+            table.row_bytes * (db.range_stops(r) - db.range_starts(r)));
+    }
+}
+
+static void stream_run(database_stream* s)
+{
+    database& db = *s->db;
+    volatile char sink = 0;
+
+    if (db.nranges() > 0) { stream_prefetch_range(*s, 0); }
+
+    for (int r = 0; r < db.nranges(); r++)
+    {
+        // Have the next range read while this one is touched
+        if (r + 1 < db.nranges()) { stream_prefetch_range(*s, r + 1); }
+
+        // Large ranges are touched in chunks so that progress and
+        // cancellation stay responsive
+        for (int i = db.range_starts(r); i < db.range_stops(r); i += STREAM_CHUNK_ROWS)
+        {
+            if (s->cancel.load(std::memory_order_relaxed))
+            {
+                s->state.store(STREAM_FAILED, std::memory_order_release);
+                return;
+            }
+
+            int nrows = mini(db.range_stops(r) - i, STREAM_CHUNK_ROWS);
+
+            for (int t = 0; t < s->ntables; t++)
+            {
+                const stream_table& table = s->tables[t];
+                size_t bytes = table.row_bytes * nrows;
+                sink ^= stream_touch(table.data + table.row_bytes * i, bytes);
+                s->bytes_done.fetch_add(bytes, std::memory_order_relaxed);
+            }
+        }
+
+        s->ranges_ready.store(r + 1, std::memory_order_release);
+    }
+
+    // The pages are all in now, so checking them is cheap. A
+    // corrupt section invalidates the whole database.
+    if (s->verify)
+    {
+        for (int i = 0; i < db.source.nsections; i++)
+        {
+            if (container_checksum(db.source.data[i], (size_t)db.source.sections[i].bytes) != db.source.sections[i].checksum)
+            {
+                s->ranges_ready.store(0, std::memory_order_release);
+                s->state.store(STREAM_FAILED, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    // Searches only read these once the state is done
+    database_build_search(db);
+
+    s->state.store(STREAM_DONE, std::memory_order_release);
+}
+
+bool stream_start(database_stream& s, database& db, const bool verify)
+{
+    if (stream_get_state(s) != STREAM_IDLE || db.nframes() == 0) { return false; }
+
+    s.db = &db;
+    s.verify = verify;
+    s.ntables = 0;
+    s.bytes_total = 0;
+    s.bytes_done.store(0);
+    s.ranges_ready.store(0);
+    s.cancel.store(false);
+
+    stream_add_table(s, db.bone_positions.data, sizeof(vec3) * db.bone_positions.cols);
+    stream_add_table(s, db.bone_velocities.data, sizeof(vec3) * db.bone_velocities.cols);
+    stream_add_table(s, db.bone_rotations.data, sizeof(quat) * db.bone_rotations.cols);
+    stream_add_table(s, db.bone_angular_velocities.data, sizeof(vec3) * db.bone_angular_velocities.cols);
+    stream_add_table(s, db.contact_states.data, sizeof(bool) * db.contact_states.cols);
+    stream_add_table(s, db.features.data, sizeof(float) * db.features.cols);
+
+    db.stream = &s;
+    s.state.store(STREAM_LOADING, std::memory_order_release);
+    s.worker = std::thread(stream_run, &s);
+    return true;
+}
+
+bool stream_wait(database_stream& s)
+{
+    if (s.worker.joinable())
+    {
+        s.worker.join();
+    }
+
+    return stream_get_state(s) == STREAM_DONE;
+}
+
+void stream_close(database_stream& s)
+{
+    s.cancel.store(true, std::memory_order_relaxed);
+
+    if (s.worker.joinable())
+    {
+        s.worker.join();
+    }
+
+    if (s.db != NULL && s.db->stream == &s)
+    {
+        s.db->stream = NULL;
+    }
+
+    s.db = NULL;
+    s.ntables = 0;
+    s.state.store(STREAM_IDLE, std::memory_order_release);
+}
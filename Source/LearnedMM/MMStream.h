@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMArray.h"
+
+#include <atomic>
+#include <thread>
+
+//--------------------------------------
+
+// Brings a mapped database into memory on a worker thread, one
+// animation range at a time, so that opening a large database
+// does not stall the game thread. The tables already point into
+// the mapped file, so nothing is copied. The worker touches the
+// pages of each range in chunks while the operating system is
+// asked to read the next range in the background, so the disk
+// and the worker are always busy with different ranges. Once
+// `stream_ranges_ready` reports `n` the first `n` ranges can be
+// searched without a page fault, which the database searches do
+// while the stream is loading.
+//
+// When every range is in, the worker verifies the checksums if
+// asked and builds the padded features and bounds, after which
+// the stream is done and searches use the bounds. If a checksum
+// fails no range is reported ready again.
+
+struct database;
+
+enum
+{
+    STREAM_MAX_TABLES = 8,
+    STREAM_CHUNK_ROWS = 1024,
+};
+
+enum stream_state
+{
+    STREAM_IDLE,
+    STREAM_LOADING,
+    STREAM_DONE,
+    STREAM_FAILED,
+};
+
+struct stream_table
+{
+    const char* data;
+    size_t row_bytes;
+};
+
+struct database_stream
+{
+    database* db;
+    bool verify;
+
+    int ntables;
+    stream_table tables[STREAM_MAX_TABLES];
+
+    uint64_t bytes_total;
+    std::atomic<uint64_t> bytes_done;
+    std::atomic<int> ranges_ready;
+    std::atomic<int> state;
+    std::atomic<bool> cancel;
+    std::thread worker;
+
+    database_stream() : db(NULL), verify(false), ntables(0), bytes_total(0), bytes_done(0), ranges_ready(0), state(STREAM_IDLE), cancel(false) {}
+    database_stream(const database_stream&) = delete;
+    database_stream& operator=(const database_stream&) = delete;
+    ~database_stream();
+};
+
+// Starts the worker on a database opened with `database_map`,
+// and points `db.stream` at `s`. The database must outlive the
+// stream and must not be searched from other threads before
+// this returns.
+bool stream_start(database_stream& s, database& db, const bool verify = true);
+
+// Blocks until the worker has finished
+bool stream_wait(database_stream& s);
+
+// Stops the worker (if still running) and detaches the stream
+// from its database
+void stream_close(database_stream& s);
+
+static inline int stream_ranges_ready(const database_stream& s)
+{
+    return s.ranges_ready.load(std::memory_order_acquire);
+}
+
+static inline stream_state stream_get_state(const database_stream& s)
+{
+    return (stream_state)s.state.load(std::memory_order_acquire);
+}
+
+static inline float stream_progress(const database_stream& s)
+{
+    return s.bytes_total == 0 ? 1.0f : (float)((double)s.bytes_done.load(std::memory_order_relaxed) / s.bytes_total);
+}
@@ -0,0 +1,197 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+#include "MMArray.h"
+#include "MMVec.h"
+#include "MMQuat.h"
+#include "MMSoa.h"
+#include "MMSpring.h"
+
+//--------------------------------------
+
+// Trajectory prediction for many characters at once, giving the
+// future positions, velocities and facings used as query features.
+//
+// Arrays of predictions are stored sample major, so the value of
+// sample `s` of character `c` is at `s * ncharacters + c` and each
+// sample is a contiguous run over characters. Sample 0 is the
+// current state. Every character shares the halflife and the
+// sample interval, so the exponential of each spring is evaluated
+// once per sample rather than once per character, and the loops
+// over characters are plain arithmetic which vectorizes.
+//
+// Characters only ever turn about the vertical axis, so facings
+// are kept as yaw angles. The rotation spring then becomes a
+// scalar spring on the angle, which gives the same result as the
+// quaternion spring for rotations about a single axis.
+
+// Yaw of a rotation about the vertical axis
+static inline float trajectory_yaw(const quat q)
+{
+    return 2.0f * atan2f(q.y, q.w);
+}
+
+// Same as stepping `simulation_positions_update` once per sample
+// towards each sample's desired velocity, for every character
+static inline void trajectory_positions_predict_batch(
+    soa_vec3_slice positions,
+    soa_vec3_slice velocities,
+    soa_vec3_slice accelerations,
+    const soa_vec3_slice position,
+    const soa_vec3_slice velocity,
+    const soa_vec3_slice acceleration,
+    const soa_vec3_slice desired_velocities,
+    const float halflife,
+    const float dt)
+{
+    const int n = position.size();
+    const int nsamples = positions.size() / n;
+
+    assert(positions.size() == nsamples * n && desired_velocities.size() == positions.size());
+
+    const float y = halflife_to_damping(halflife) / 2.0f;
+    const float eydt = fast_negexpf(y * dt);
+    const float inv_y = 1.0f / y;
+    const float inv_y2 = inv_y * inv_y;
+
+    for (int c = 0; c < n; c++)
+    {
+        positions.set(c, position(c));
+        velocities.set(c, velocity(c));
+        accelerations.set(c, acceleration(c));
+    }
+
+    for (int s = 1; s < nsamples; s++)
+    {
+        const int prev = (s - 1) * n;
+        const int curr = s * n;
+
+        const slice1d<float>* outs[3][3] = {
+            { &positions.x, &velocities.x, &accelerations.x },
+            { &positions.y, &velocities.y, &accelerations.y },
+            { &positions.z, &velocities.z, &accelerations.z } };
+        const slice1d<float>* goals[3] = { &desired_velocities.x, &desired_velocities.y, &desired_velocities.z };
+
+        for (int k = 0; k < 3; k++)
+        {
+            float* __restrict px = outs[k][0]->data;
+            float* __restrict pv = outs[k][1]->data;
+            float* __restrict pa = outs[k][2]->data;
+            const float* __restrict g = goals[k]->data + curr;
+
+            for (int c = 0; c < n; c++)
+            {
+                float j0 = pv[prev + c] - g[c];
+                float j1 = pa[prev + c] + j0 * y;
+
+                px[curr + c] = eydt * (-j1 * inv_y2 + (-j0 - j1 * dt) * inv_y) +
+                    j1 * inv_y2 + j0 * inv_y + g[c] * dt + px[prev + c];
+                pv[curr + c] = eydt * (j0 + j1 * dt) + g[c];
+                pa[curr + c] = eydt * (pa[prev + c] - j1 * y * dt);
+            }
+        }
+    }
+}
+
+// Same as `trajectory_rotations_predict`: every sample springs
+// from the current facing towards its desired facing over the
+// time to that sample
+static inline void trajectory_yaws_predict_batch(
+    slice1d<float> yaws,
+    slice1d<float> yaw_velocities,
+    const slice1d<float> yaw,
+    const slice1d<float> yaw_velocity,
+    const slice1d<float> desired_yaws,
+    const float halflife,
+    const float dt)
+{
+    const int n = yaw.size;
+    const int nsamples = yaws.size / n;
+
+    assert(yaws.size == nsamples * n && yaw_velocities.size == yaws.size && desired_yaws.size == yaws.size);
+
+    const float y = halflife_to_damping(halflife) / 2.0f;
+
+    for (int c = 0; c < n; c++)
+    {
+        yaws(c) = yaw(c);
+        yaw_velocities(c) = yaw_velocity(c);
+    }
+
+    for (int s = 1; s < nsamples; s++)
+    {
+        const float t = s * dt;
+        const float eydt = fast_negexpf(y * t);
+
+        float* __restrict out_yaw = yaws.data + s * n;
+        float* __restrict out_vel = yaw_velocities.data + s * n;
+        const float* __restrict goal = desired_yaws.data + s * n;
+
+        for (int c = 0; c < n; c++)
+        {
+            // The shortest way round, like `quat_abs`
+            float j0 = wrap_anglef(yaw.data[c] - goal[c]);
+            float j1 = yaw_velocity.data[c] + j0 * y;
+
+            out_yaw[c] = eydt * (j0 + j1 * t) + goal[c];
+            out_vel[c] = eydt * (yaw_velocity.data[c] - j1 * y * t);
+        }
+    }
+}
+
+// Facing directions on the ground, `quat_mul_vec3(rotation, vec3(0, 0, 1))`
+static inline void trajectory_directions_batch(
+    slice1d<float> directions_x,
+    slice1d<float> directions_z,
+    const slice1d<float> yaws)
+{
+    assert(directions_x.size == yaws.size && directions_z.size == yaws.size);
+
+    for (int i = 0; i < yaws.size; i++) { directions_x.data[i] = fast_sinf(yaws.data[i]); }
+    for (int i = 0; i < yaws.size; i++) { directions_z.data[i] = fast_cosf(yaws.data[i]); }
+}
+
+// Writes the trajectory part of every character's query, the
+// same as `query_compute_trajectory_position_feature` followed by
+// `query_compute_trajectory_direction_feature` with sample 0 as
+// the root. `offset` is where the trajectory features start in
+// each row of `queries`.
+static inline void trajectory_query_features_batch(
+    slice2d<float> queries,
+    const int offset,
+    const soa_vec3_slice positions,
+    const slice1d<float> directions_x,
+    const slice1d<float> directions_z)
+{
+    const int n = queries.rows;
+    const int nsamples = positions.size() / n;
+
+    assert(positions.size() == nsamples * n && directions_x.size == positions.size() && directions_z.size == positions.size());
+    assert(offset + 4 * (nsamples - 1) <= queries.cols);
+
+    // Rotating by the inverse root facing (sin, cos) is
+    // x' = cos * x - sin * z, z' = sin * x + cos * z
+    for (int s = 1; s < nsamples; s++)
+    {
+        const int curr = s * n;
+        const int position_offset = offset + 2 * (s - 1);
+        const int direction_offset = offset + 2 * (nsamples - 1) + 2 * (s - 1);
+
+        for (int c = 0; c < n; c++)
+        {
+            float root_sin = directions_x.data[c];
+            float root_cos = directions_z.data[c];
+            float dx = positions.x.data[curr + c] - positions.x.data[c];
+            float dz = positions.z.data[curr + c] - positions.z.data[c];
+            float fx = directions_x.data[curr + c];
+            float fz = directions_z.data[curr + c];
+
+            queries(c, position_offset + 0) = root_cos * dx - root_sin * dz;
+            queries(c, position_offset + 1) = root_sin * dx + root_cos * dz;
+            queries(c, direction_offset + 0) = root_cos * fx - root_sin * fz;
+            queries(c, direction_offset + 1) = root_sin * fx + root_cos * fz;
+        }
+    }
+}
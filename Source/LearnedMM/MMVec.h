@@ -2,20 +2,8 @@
 
 #pragma once
 
-#include "CoreMinimal.h"
 #include "MMCommon.h"
 
-
-/**
- * 
- */
-class LEARNEDMM_API MMVec
-{
-public:
-	MMVec();
-	~MMVec();
-};
-
 struct vec2
 {
     vec2() : x(0.0f), y(0.0f) {}
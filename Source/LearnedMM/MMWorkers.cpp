@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MMWorkers.h"
+
+//--------------------------------------
+
+worker_pool::~worker_pool()
+{
+    worker_pool_stop(*this);
+}
+
+// Drains the worker's own queue first, then steals from the
+// front of the others
+static void worker_pool_work(worker_pool& p, const int worker)
+{
+    for (int k = 0; k < p.nworkers; k++)
+    {
+        int victim = (worker + k) % p.nworkers;
+
+        while (true)
+        {
+            int t = p.queue_heads[victim].fetch_add(1);
+            if (t >= p.queue_tails[victim]) { break; }
+            p.task_run(p.task_data, t);
+        }
+    }
+}
+
+static void worker_pool_worker(worker_pool* p, const int worker)
+{
+    uint64_t seen = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(p->mutex);
+            p->wake.wait(lock, [&]() { return p->stop || p->generation != seen; });
+            if (p->stop) { return; }
+            seen = p->generation;
+        }
+
+        worker_pool_work(*p, worker);
+
+        {
+            std::lock_guard<std::mutex> lock(p->mutex);
+            if (--p->nbusy == 0) { p->done.notify_one(); }
+        }
+    }
+}
+
+void worker_pool_start(worker_pool& p, int nthreads)
+{
+    worker_pool_stop(p);
+
+    nthreads = clamp(nthreads, 0, WORKERS_MAX - 1);
+
+    p.stop = false;
+    p.generation = 0;
+    p.nworkers = nthreads + 1;
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        p.threads[i] = std::thread(worker_pool_worker, &p, i + 1);
+    }
+}
+
+void worker_pool_stop(worker_pool& p)
+{
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        p.stop = true;
+    }
+    p.wake.notify_all();
+
+    for (int i = 0; i < p.nworkers - 1; i++)
+    {
+        if (p.threads[i].joinable())
+        {
+            p.threads[i].join();
+        }
+    }
+
+    p.nworkers = 1;
+}
+
+void worker_pool_run(
+    worker_pool* p,
+    const int ntasks,
+    void (*task_run)(void* data, const int task),
+    void* data)
+{
+    if (p == NULL || p->nworkers == 1)
+    {
+        for (int t = 0; t < ntasks; t++) { task_run(data, t); }
+        return;
+    }
+
+    p->task_run = task_run;
+    p->task_data = data;
+
+    // Give each worker a contiguous block of tasks
+    for (int w = 0; w < p->nworkers; w++)
+    {
+        p->queue_heads[w].store((w * ntasks) / p->nworkers);
+        p->queue_tails[w] = ((w + 1) * ntasks) / p->nworkers;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        p->generation++;
+        p->nbusy = p->nworkers - 1;
+    }
+    p->wake.notify_all();
+
+    worker_pool_work(*p, 0);
+
+    std::unique_lock<std::mutex> lock(p->mutex);
+    p->done.wait(lock, [&]() { return p->nbusy == 0; });
+}
@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "MMCommon.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//--------------------------------------
+
+// A pool of worker threads shared by the search and inference
+// schedulers. A run hands out tasks by index: each worker gets a
+// contiguous block in its own queue, drains it, and then steals
+// from the front of the other queues. The calling thread works as
+// worker 0 and the run blocks until every task is done, so the
+// tasks can read anything the caller set up before the run and
+// the caller can read their results afterwards.
+//
+// Only one thread may run tasks on a pool at a time.
+
+enum
+{
+    WORKERS_MAX = 64,
+};
+
+struct worker_pool
+{
+    // Worker 0 is the thread calling `worker_pool_run`
+    int nworkers;
+    std::atomic<int> queue_heads[WORKERS_MAX];
+    int queue_tails[WORKERS_MAX];
+
+    // Task of the current run
+    void (*task_run)(void* data, const int task);
+    void* task_data;
+
+    std::thread threads[WORKERS_MAX];
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation;
+    int nbusy;
+    bool stop;
+
+    worker_pool() : nworkers(1), task_run(NULL), task_data(NULL), generation(0), nbusy(0), stop(false) {}
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+    ~worker_pool();
+};
+
+// Starts `nthreads` worker threads in addition to the calling
+// thread. With zero threads tasks run on the calling thread.
+void worker_pool_start(worker_pool& p, int nthreads);
+void worker_pool_stop(worker_pool& p);
+
+// Calls `task_run(data, t)` for every `t` below `ntasks`, spread
+// over the workers, and returns once they have all finished. A
+// NULL pool runs every task on the calling thread.
+void worker_pool_run(
+    worker_pool* p,
+    const int ntasks,
+    void (*task_run)(void* data, const int task),
+    void* data);